@@ -1,111 +1,569 @@
 #include "http_server.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "stream_pacer.h"
+#include "stream_metrics.h"
+#include "web_assets.h"
+#include "lwip/sockets.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include <string.h>
+#include <stdio.h>
+#include <errno.h>
 
 #define TAG "HTTP_SERVER"
 
+#define HTTP_TEXT_MAX_URIS      4
+#define HTTP_TEXT_BUF_SIZE      (16 * 1024) // 容纳完整的 /metrics 输出
+#define HTTP_STREAM_MAX_CLIENTS 4       // 推流任务数，即同时推流的连接上限
+#define HTTP_STREAM_WAIT_MS     1000    // 无新帧时的等待上限
+#define HTTP_STREAM_TASK_STACK  4096
+#define HTTP_STREAM_TASK_PRIO   5
+#define HTTP_TCP_MSS            1436    // 估算 TCP 段数用
+#define HTTP_FRAME_US           (1000000 / CONFIG_CAMERA_STREAM_FRAME_RATE)
+#define HTTP_RETIRE_MAX         4       // 等待读者退出后才释放的旧帧上限
+
+// MJPEG 发送统计 (各推流任务并发累加)
+typedef struct {
+    uint32_t frames;
+    uint64_t bytes;                     // 写入 socket 的字节 (含分段头与 chunk 封装)
+    uint32_t writes;                    // 写调用次数
+    uint32_t segments;                  // 估算的 TCP 段数: 每次写调用至少起一个新段
+    uint64_t send_us;                   // 写调用耗时累计
+    uint32_t retire_deferred;           // 发布时有读者在取帧，旧帧延后释放的次数
+    stream_hist_t send_hist;            // 单帧发送耗时
+} http_mjpeg_stats_t;
+
+typedef struct {
+    const char *uri;
+    const char *content_type;
+    http_text_render_t render;
+} http_text_entry_t;
+
 static httpd_handle_t server = NULL;
 
-static uint8_t *latest_frame = NULL;
-static size_t latest_frame_len = 0;
-static SemaphoreHandle_t frame_mutex;
-static bool http_stream_flag = false;
+/*
+ * 最新帧槽: 生产者 (摄像头任务，唯一) 原子交换指针发布，推流任务无锁读取。
+ * 读者取帧时先登记 readers_active 再读指针、加引用; 生产者换下的旧帧只有在
+ * readers_active 为 0 时才能立即 unref，否则放入 retired 等下次观察到 0 时再释放
+ * (此前开始的读者必已拿到自己的引用)。发布从不等待读者，也从不丢帧。
+ */
+static lcd_camera_frame_t *latest_frame = NULL;   // 最新编码帧，持有一个引用
+static int readers_active = 0;                      // 正在读指针、加引用的推流任务数
+static lcd_camera_frame_t *retired[HTTP_RETIRE_MAX];    // 延后释放的旧帧，仅生产者访问
+static int retired_count = 0;
+static TaskHandle_t stream_waiters[HTTP_STREAM_MAX_CLIENTS];   // 发布新帧时通知的推流任务，CAS 登记
+static int stream_clients = 0;                      // 正在推流的连接数
+static QueueHandle_t stream_req_queue;              // 转交给推流任务的异步请求
+static SemaphoreHandle_t stream_slots;              // 空闲推流任务计数，取不到时直接拒绝
+static http_mjpeg_stats_t mjpeg_stats;
+static stream_pacer_t stream_pacers[HTTP_STREAM_MAX_CLIENTS];   // 按推流任务分配，各自独立降帧
+static int stream_fds[HTTP_STREAM_MAX_CLIENTS];     // 推流任务当前服务的连接，-1 空闲
+
+static http_text_entry_t text_entries[HTTP_TEXT_MAX_URIS];
+static int text_entry_count = 0;
+static char *text_buf;      // 启动时分配一次 (优先 PSRAM)，httpd 单任务顺序处理请求，共用一个缓冲区
+static uint32_t etag_nonce;  // 每次启动随机取值，帧序号重启后从 0 开始，加上它才不会与重启前的 ETag 相同
 
 bool http_stream_flag_get(void)
 {
-	return http_stream_flag;
+	return __atomic_load_n(&stream_clients, __ATOMIC_RELAXED) > 0;
 }
 
-static esp_err_t mjpeg_handler(httpd_req_t *req) {
-	http_stream_flag = true;
-    ESP_LOGI(TAG, "MJPEG stream connected, http_stream_flag = [%s]", http_stream_flag ? "true" : "false");
+// 取最新帧的引用，调用方发送完后 unref; 不加锁，不会被生产者阻塞
+static lcd_camera_frame_t *latest_frame_get(void) {
+    __atomic_add_fetch(&readers_active, 1, __ATOMIC_SEQ_CST);
+    lcd_camera_frame_t *frame = lcd_camera_frame_ref(__atomic_load_n(&latest_frame, __ATOMIC_SEQ_CST));
+    __atomic_sub_fetch(&readers_active, 1, __ATOMIC_SEQ_CST);
+    return frame;
+}
+
+// 没有读者处于取帧过程中时，之前换下的旧帧都已无人会再读到，可以释放
+static void retired_release(void) {
+    if (retired_count == 0 || __atomic_load_n(&readers_active, __ATOMIC_SEQ_CST) != 0) return;
+    for (int i = 0; i < retired_count; i++) {
+        lcd_camera_frame_unref(retired[i]);
+    }
+    retired_count = 0;
+}
+
+// 登记/注销当前任务为新帧通知的接收者，槽位满时返回 false (退化为按超时轮询)
+static bool stream_waiter_set(TaskHandle_t from, TaskHandle_t to) {
+    for (int i = 0; i < HTTP_STREAM_MAX_CLIENTS; i++) {
+        TaskHandle_t expected = from;
+        if (__atomic_compare_exchange_n(&stream_waiters[i], &expected, to, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void mjpeg_stats_add(uint32_t writes, uint32_t segments, size_t bytes, uint32_t us) {
+    __atomic_fetch_add(&mjpeg_stats.writes, writes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&mjpeg_stats.segments, segments, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&mjpeg_stats.bytes, (uint64_t)bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&mjpeg_stats.send_us, (uint64_t)us, __ATOMIC_RELAXED);
+}
+
+#ifndef CONFIG_HTTP_MJPEG_GATHER
+// chunked 编码给 n 字节数据附加的长度行与结尾 CRLF
+static size_t chunk_overhead(size_t n) {
+    size_t digits = 1;
+    while (n >>= 4) digits++;
+    return digits + 4;
+}
+#else
+#define MJPEG_PART_HEADER "\r\n--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n"
+
+static const char mjpeg_response_head[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=frame\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Pragma: no-cache\r\n"
+#ifdef CONFIG_HTTP_MJPEG_RAW
+    "Connection: close\r\n"           // 不分块，响应体一直写到连接关闭
+#else
+    "Transfer-Encoding: chunked\r\n"
+#endif
+    "\r\n";
+
+// 一次 writev 写出所有片段，部分写入时从断点补齐; 写调用与估算段数记入统计
+static bool sock_writev_all(int fd, struct iovec *iov, int cnt) {
+    size_t total = 0;
+    uint32_t writes = 0, segments = 0;
+    int64_t start_us = esp_timer_get_time();
+    bool ok = true;
+
+    while (cnt > 0) {
+        ssize_t n = writev(fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        writes++;
+        segments += (n + HTTP_TCP_MSS - 1) / HTTP_TCP_MSS;
+        total += n;
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    mjpeg_stats_add(writes, segments, total, (uint32_t)(esp_timer_get_time() - start_us));
+    return ok;
+}
+
+// 分段边界、分段头与 JPEG (以及 chunk 封装) 合并为一次聚合写
+static bool mjpeg_write_part(int fd, const lcd_camera_frame_t *frame) {
+    char head[96];
+    int head_len;
+#ifdef CONFIG_HTTP_MJPEG_RAW
+    head_len = snprintf(head, sizeof(head), MJPEG_PART_HEADER, (unsigned)frame->len);
+    struct iovec iov[2] = {
+        { .iov_base = head, .iov_len = head_len },
+        { .iov_base = frame->buf, .iov_len = frame->len },
+    };
+#else
+    char part[80];
+    int part_len = snprintf(part, sizeof(part), MJPEG_PART_HEADER, (unsigned)frame->len);
+    head_len = snprintf(head, sizeof(head), "%x\r\n%s", (unsigned)(part_len + frame->len), part);
+    struct iovec iov[3] = {
+        { .iov_base = head, .iov_len = head_len },
+        { .iov_base = frame->buf, .iov_len = frame->len },
+        { .iov_base = (void *)"\r\n", .iov_len = 2 },
+    };
+#endif
+    return sock_writev_all(fd, iov, sizeof(iov) / sizeof(iov[0]));
+}
+#endif
 
+// 在推流任务中持续推送，直到连接断开; 返回 false 表示发送失败
+static bool mjpeg_stream(httpd_req_t *req, int slot) {
+    stream_pacer_t *pacer = &stream_pacers[slot];
+    stream_pacer_init(pacer, HTTP_FRAME_US, 0);    // 阻塞写，在途字节只用于统计
+    __atomic_store_n(&stream_fds[slot], httpd_req_to_sockfd(req), __ATOMIC_RELAXED);
+    int clients = __atomic_add_fetch(&stream_clients, 1, __ATOMIC_RELAXED);
+    ESP_LOGI(TAG, "MJPEG stream connected, %d client(s)", clients);
+
+#ifdef CONFIG_HTTP_MJPEG_GATHER
+    // 响应头与各分段直接写 socket，不经 httpd_resp_send_chunk
+    int fd = httpd_req_to_sockfd(req);
+    struct iovec head_iov = { .iov_base = (void *)mjpeg_response_head, .iov_len = sizeof(mjpeg_response_head) - 1 };
+    bool head_ok = sock_writev_all(fd, &head_iov, 1);
+#else
     // HTTP headers for MJPEG streaming
     httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=frame");
     httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
     httpd_resp_set_hdr(req, "Pragma", "no-cache");
+    bool head_ok = true;
+#endif
+
+    // 每个新帧只发一次: 阻塞等待发布通知，醒来时只取最新的一帧，慢连接自然跳过中间帧
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (!stream_waiter_set(NULL, self)) {
+        ESP_LOGW(TAG, "Too many MJPEG clients for notification, polling");
+    }
+    ulTaskNotifyTake(pdTRUE, 0);    // 丢弃登记前残留的通知 (含注销后迟到的通知)
+    uint32_t sent_seq = 0;
+    bool sent_any = false;
+
+    while (head_ok) {
+        // 每次发布的帧序号都不同，据此判断是否已发过
+        lcd_camera_frame_t *frame = latest_frame_get();
+        if (frame == NULL || (sent_any && frame->seq == sent_seq)) {
+            lcd_camera_frame_unref(frame);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTP_STREAM_WAIT_MS));
+            continue;
+        }
+        // 本连接落后时按降帧系数跳过，其他连接不受影响
+        sent_seq = frame->seq;
+        sent_any = true;
+        if (!stream_pacer_due(pacer, frame->seq)) {
+            lcd_camera_frame_unref(frame);
+            continue;
+        }
+
+        // 发送期间帧由本连接的引用保持有效，生产者可随时发布新帧
+        int64_t start_us = esp_timer_get_time();
+        stream_pacer_begin(pacer, frame->seq, frame->len);
+#ifdef CONFIG_HTTP_MJPEG_GATHER
+        bool ok = mjpeg_write_part(fd, frame);
+#else
+        char part_header[128];
+        int hdr_len = snprintf(part_header, sizeof(part_header),
+            "\r\n--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n",
+            (int)frame->len);
+
+        bool ok = httpd_resp_send_chunk(req, part_header, hdr_len) == ESP_OK &&
+                  httpd_resp_send_chunk(req, (const char *)frame->buf, frame->len) == ESP_OK;
+        // 每次 httpd_resp_send_chunk 分别写出 chunk 长度行、数据与结尾 CRLF，按 6 次写调用计
+        mjpeg_stats_add(6, 5 + (frame->len + HTTP_TCP_MSS - 1) / HTTP_TCP_MSS,
+                        hdr_len + frame->len + chunk_overhead(hdr_len) + chunk_overhead(frame->len),
+                        (uint32_t)(esp_timer_get_time() - start_us));
+#endif
+        uint32_t send_us = (uint32_t)(esp_timer_get_time() - start_us);
+        stream_hist_observe(&mjpeg_stats.send_hist, send_us);
+        if (stream_pacer_end(pacer, frame->len, send_us)) {
+            ESP_LOGI(TAG, "MJPEG client %d: every %u frame(s), send %u us avg",
+                     slot, pacer->factor, (unsigned)pacer->send_us_avg);
+        }
+        lcd_camera_frame_unref(frame);
+        if (!ok) {
+            break;
+        }
+        __atomic_fetch_add(&mjpeg_stats.frames, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&stream_fds[slot], -1, __ATOMIC_RELAXED);
+    stream_waiter_set(self, NULL);
+    clients = __atomic_sub_fetch(&stream_clients, 1, __ATOMIC_RELAXED);
+    ESP_LOGI(TAG, "MJPEG stream disconnected, %d client(s)", clients);
+    return false; // Client disconnected
+}
 
+// 每个推流任务一次服务一个连接，结束后关闭会话并归还名额
+static void stream_worker_task(void *arg) {
+    int slot = (int)(intptr_t)arg;
+    httpd_req_t *req;
     while (1) {
-        if (xSemaphoreTake(frame_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            if (latest_frame && latest_frame_len > 0) {
-                char part_header[128];
-                int hdr_len = snprintf(part_header, sizeof(part_header),
-                    "\r\n--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n",
-                    (int)latest_frame_len);
-
-                if (httpd_resp_send_chunk(req, part_header, hdr_len) != ESP_OK) {
-                    xSemaphoreGive(frame_mutex);
-                    break;
-                }
-                if (httpd_resp_send_chunk(req, (const char *)latest_frame, latest_frame_len) != ESP_OK) {
-                    xSemaphoreGive(frame_mutex);
-                    break;
-                }
-            }
-            xSemaphoreGive(frame_mutex);
+        if (xQueueReceive(stream_req_queue, &req, portMAX_DELAY) != pdTRUE) continue;
+        if (!mjpeg_stream(req, slot)) {
+            httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
         }
-        vTaskDelay(pdMS_TO_TICKS(50)); // 20 fps approx
+        httpd_req_async_handler_complete(req);
+        xSemaphoreGive(stream_slots);
     }
-	http_stream_flag = false;
-    ESP_LOGI(TAG, "MJPEG stream disconnected, http_stream_flag = [%s]", http_stream_flag ? "true" : "false");
-    return ESP_FAIL; // Client disconnected
 }
 
-static esp_err_t index_handler(httpd_req_t *req) {
-    const char *html = "<html><head><title>ESP32 MJPEG Stream</title></head>"
-                   "<body><h2>ESP32 MJPEG Stream</h2>"
-                   "<img src=\"/mjpeg\" style=\"width:100%; height:auto;\" />"
-                   "</body></html>";	// 响应式写法
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, html, strlen(html));
+// 推流请求转交给推流任务，httpd 任务立即返回继续处理页面、统计等其他请求
+static esp_err_t mjpeg_handler(httpd_req_t *req) {
+    if (xSemaphoreTake(stream_slots, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "All %d MJPEG stream tasks busy", HTTP_STREAM_MAX_CLIENTS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    httpd_req_t *async_req = NULL;
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        xSemaphoreGive(stream_slots);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "async begin failed");
+        return ESP_FAIL;
+    }
+    // 队列长度等于推流任务数，取得名额后必有空位
+    xQueueSend(stream_req_queue, &async_req, 0);
     return ESP_OK;
 }
 
-void http_server_start(void) {
-    frame_mutex = xSemaphoreCreateMutex();
+// 单帧快照: 推流中直接取最近的编码帧，否则现场采集; 启动随机数加帧序号作 ETag，未变化时回 304
+static esp_err_t capture_handler(httpd_req_t *req) {
+    uint32_t capture_us = 0;
+    lcd_camera_frame_t *frame = lcd_camera_snapshot(&capture_us);
+    if (frame == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "capture failed");
+        return ESP_FAIL;
+    }
+    if (capture_us > 0) {
+        ESP_LOGI(TAG, "On-demand capture %u bytes in %u us", (unsigned)frame->len, (unsigned)capture_us);
+    }
+
+    char etag[24];
+    char if_none_match[64];
+    snprintf(etag, sizeof(etag), "\"%08x-%u\"", (unsigned)etag_nonce, (unsigned)frame->seq);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    esp_err_t err;
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        (strstr(if_none_match, etag) != NULL || strcmp(if_none_match, "*") == 0)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        err = httpd_resp_send(req, NULL, 0);
+    } else {
+        // 采集耗时 (0 表示取自推流帧) 与帧龄，供轮询方判断新鲜度
+        char capture_hdr[16];
+        char age_hdr[16];
+        snprintf(capture_hdr, sizeof(capture_hdr), "%u", (unsigned)capture_us);
+        snprintf(age_hdr, sizeof(age_hdr), "%u", (unsigned)((esp_timer_get_time() - frame->timestamp_us) / 1000));
+        httpd_resp_set_type(req, "image/jpeg");
+        httpd_resp_set_hdr(req, "X-Capture-Time-Us", capture_hdr);
+        httpd_resp_set_hdr(req, "X-Frame-Age-Ms", age_hdr);
+        httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+        err = httpd_resp_send(req, (const char *)frame->buf, frame->len);
+    }
+    lcd_camera_frame_unref(frame);
+    return err;
+}
+
+int http_server_render_stats(char *buf, size_t size) {
+    http_mjpeg_stats_t st;
+    st.frames = __atomic_load_n(&mjpeg_stats.frames, __ATOMIC_RELAXED);
+    st.bytes = __atomic_load_n(&mjpeg_stats.bytes, __ATOMIC_RELAXED);
+    st.writes = __atomic_load_n(&mjpeg_stats.writes, __ATOMIC_RELAXED);
+    st.segments = __atomic_load_n(&mjpeg_stats.segments, __ATOMIC_RELAXED);
+    st.send_us = __atomic_load_n(&mjpeg_stats.send_us, __ATOMIC_RELAXED);
+    uint32_t frames = st.frames ? st.frames : 1;
+#if defined(CONFIG_HTTP_MJPEG_RAW)
+    const char *mode = "gather-raw";
+#elif defined(CONFIG_HTTP_MJPEG_GATHER)
+    const char *mode = "gather-chunked";
+#else
+    const char *mode = "httpd-chunked";
+#endif
+    int len = snprintf(buf, size,
+        "{\"mjpeg\":{\"mode\":\"%s\",\"clients\":%d,\"frames\":%u,\"bytes\":%llu,\"writes\":%u,"
+        "\"segments\":%u,\"writes_per_frame\":%u.%02u,\"segments_per_frame\":%u.%02u,\"send_kbps\":%u,\"retire_deferred\":%u},",
+        mode, __atomic_load_n(&stream_clients, __ATOMIC_RELAXED), (unsigned)st.frames,
+        (unsigned long long)st.bytes, (unsigned)st.writes, (unsigned)st.segments,
+        (unsigned)(st.writes / frames), (unsigned)(st.writes * 100ULL / frames % 100),
+        (unsigned)(st.segments / frames), (unsigned)(st.segments * 100ULL / frames % 100),
+        (unsigned)(st.send_us ? st.bytes * 8000 / st.send_us : 0),
+        (unsigned)__atomic_load_n(&mjpeg_stats.retire_deferred, __ATOMIC_RELAXED));
+    // 各推流连接的降帧系数、平均发送耗时与在途字节
+    if (len >= 0 && (size_t)len < size) len += snprintf(buf + len, size - len, "\"streams\":[");
+    bool first = true;
+    for (int i = 0; i < HTTP_STREAM_MAX_CLIENTS && len >= 0 && (size_t)len < size; i++) {
+        int fd = __atomic_load_n(&stream_fds[i], __ATOMIC_RELAXED);
+        if (fd < 0) continue;
+        const stream_pacer_t *p = &stream_pacers[i];
+        len += snprintf(buf + len, size - len,
+            "%s{\"fd\":%d,\"factor\":%u,\"send_us_avg\":%u,\"inflight\":%u,\"sent\":%u,\"skipped\":%u}",
+            first ? "" : ",", fd, p->factor, (unsigned)p->send_us_avg,
+            (unsigned)__atomic_load_n(&p->inflight, __ATOMIC_RELAXED), (unsigned)p->sent, (unsigned)p->skipped);
+        first = false;
+    }
+    if (len >= 0 && (size_t)len < size) len += snprintf(buf + len, size - len, "]}");
+    return (len < 0 || (size_t)len >= size) ? (int)size - 1 : len;
+}
+
+int http_server_render_metrics(char *buf, size_t size) {
+    size_t len = 0;
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    stream_metrics_type(buf, size, &len, "camera_http_clients", "gauge");
+    stream_metrics_append(buf, size, &len, "camera_http_clients %d\n",
+                          __atomic_load_n(&stream_clients, __ATOMIC_RELAXED));
+    stream_metrics_type(buf, size, &len, "camera_http_frames_sent_total", "counter");
+    stream_metrics_append(buf, size, &len, "camera_http_frames_sent_total %u\n",
+                          (unsigned)__atomic_load_n(&mjpeg_stats.frames, __ATOMIC_RELAXED));
+    stream_metrics_type(buf, size, &len, "camera_http_sent_bytes_total", "counter");
+    stream_metrics_append(buf, size, &len, "camera_http_sent_bytes_total %llu\n",
+                          (unsigned long long)__atomic_load_n(&mjpeg_stats.bytes, __ATOMIC_RELAXED));
+    stream_metrics_type(buf, size, &len, "camera_http_socket_writes_total", "counter");
+    stream_metrics_append(buf, size, &len, "camera_http_socket_writes_total %u\n",
+                          (unsigned)__atomic_load_n(&mjpeg_stats.writes, __ATOMIC_RELAXED));
+    stream_metrics_type(buf, size, &len, "camera_http_retire_deferred_total", "counter");
+    stream_metrics_append(buf, size, &len, "camera_http_retire_deferred_total %u\n",
+                          (unsigned)__atomic_load_n(&mjpeg_stats.retire_deferred, __ATOMIC_RELAXED));
+    stream_metrics_type(buf, size, &len, "camera_http_send_seconds", "histogram");
+    stream_hist_render(buf, size, &len, "camera_http_send_seconds", NULL, &mjpeg_stats.send_hist);
+
+    // 每个推流连接一组样本，按推流任务槽位区分
+    static const char *const client_metrics[][2] = {
+        { "camera_http_client_decimation", "gauge" },
+        { "camera_http_client_send_seconds_avg", "gauge" },
+        { "camera_http_client_inflight_bytes", "gauge" },
+        { "camera_http_client_frames_sent_total", "counter" },
+        { "camera_http_client_frames_skipped_total", "counter" },
+    };
+    for (int m = 0; m < sizeof(client_metrics) / sizeof(client_metrics[0]); m++) {
+        stream_metrics_type(buf, size, &len, client_metrics[m][0], client_metrics[m][1]);
+        for (int i = 0; i < HTTP_STREAM_MAX_CLIENTS; i++) {
+            int fd = __atomic_load_n(&stream_fds[i], __ATOMIC_RELAXED);
+            if (fd < 0) continue;
+            const stream_pacer_t *p = &stream_pacers[i];
+            stream_metrics_append(buf, size, &len, "%s{slot=\"%d\",fd=\"%d\"} ", client_metrics[m][0], i, fd);
+            switch (m) {
+            case 0: stream_metrics_append(buf, size, &len, "%u\n", p->factor); break;
+            case 1: stream_metrics_append(buf, size, &len, "%u.%06u\n", (unsigned)(p->send_us_avg / 1000000),
+                                          (unsigned)(p->send_us_avg % 1000000)); break;
+            case 2: stream_metrics_append(buf, size, &len, "%u\n",
+                                          (unsigned)__atomic_load_n(&p->inflight, __ATOMIC_RELAXED)); break;
+            case 3: stream_metrics_append(buf, size, &len, "%u\n", (unsigned)p->sent); break;
+            default: stream_metrics_append(buf, size, &len, "%u\n", (unsigned)p->skipped); break;
+            }
+        }
+    }
+    return (int)len;
+}
+
+static esp_err_t text_handler(httpd_req_t *req) {
+    const http_text_entry_t *entry = req->user_ctx;
+    int len = entry->render(text_buf, HTTP_TEXT_BUF_SIZE);
+    if (len < 0) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "render failed");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, entry->content_type);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, text_buf, len);
+}
+
+static void text_uri_register(http_text_entry_t *entry) {
+    httpd_uri_t uri = {
+        .uri       = entry->uri,
+        .method    = HTTP_GET,
+        .handler   = text_handler,
+        .user_ctx  = entry
+    };
+    if (httpd_register_uri_handler(server, &uri) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s", entry->uri);
+    }
+}
+
+void http_server_register_text(const char *uri, const char *content_type, http_text_render_t render) {
+    if (text_entry_count >= HTTP_TEXT_MAX_URIS) {
+        ESP_LOGE(TAG, "Too many text URIs, drop %s", uri);
+        return;
+    }
+    http_text_entry_t *entry = &text_entries[text_entry_count++];
+    entry->uri = uri;
+    entry->content_type = content_type;
+    entry->render = render;
+    if (server) {
+        text_uri_register(entry);
+    }
+}
+
+// with_stream 为 false 时只提供快照与文本接口，不建推流任务，也不注册页面与 /mjpeg
+static void http_server_start_internal(bool with_stream) {
+    etag_nonce = esp_random();
+    text_buf = heap_caps_malloc(HTTP_TEXT_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!text_buf) {
+        text_buf = heap_caps_malloc(HTTP_TEXT_BUF_SIZE, MALLOC_CAP_8BIT);
+    }
+    if (!text_buf) {
+        ESP_LOGE(TAG, "Failed to allocate text buffer");
+        return;
+    }
+    for (int i = 0; i < HTTP_STREAM_MAX_CLIENTS; i++) {
+        stream_fds[i] = -1;
+    }
+    if (with_stream) {
+        stream_req_queue = xQueueCreate(HTTP_STREAM_MAX_CLIENTS, sizeof(httpd_req_t *));
+        stream_slots = xSemaphoreCreateCounting(HTTP_STREAM_MAX_CLIENTS, HTTP_STREAM_MAX_CLIENTS);
+        if (!stream_req_queue || !stream_slots) {
+            ESP_LOGE(TAG, "Failed to allocate stream queue");
+            return;
+        }
+        for (int i = 0; i < HTTP_STREAM_MAX_CLIENTS; i++) {
+            xTaskCreate(stream_worker_task, "mjpeg_stream", HTTP_STREAM_TASK_STACK, (void *)(intptr_t)i,
+                        HTTP_STREAM_TASK_PRIO, NULL);
+        }
+    }
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = 12;   // 页面与静态资源、推流、快照，加上文本接口
 
     if (httpd_start(&server, &config) == ESP_OK) {
-        httpd_uri_t index_uri = {
-            .uri       = "/",
-            .method    = HTTP_GET,
-            .handler   = index_handler,
-            .user_ctx  = NULL
-        };
-        httpd_register_uri_handler(server, &index_uri);
+        if (with_stream) {
+            // 页面与统计浮层脚本为构建时预压缩的资源
+            web_assets_register(server, "/", "index.html");
+            web_assets_register_common(server);
+
+            httpd_uri_t mjpeg_uri = {
+                .uri       = "/mjpeg",
+                .method    = HTTP_GET,
+                .handler   = mjpeg_handler,
+                .user_ctx  = NULL
+            };
+            httpd_register_uri_handler(server, &mjpeg_uri);
+        }
 
-        httpd_uri_t mjpeg_uri = {
-            .uri       = "/mjpeg",
+        httpd_uri_t capture_uri = {
+            .uri       = "/capture.jpg",
             .method    = HTTP_GET,
-            .handler   = mjpeg_handler,
+            .handler   = capture_handler,
             .user_ctx  = NULL
         };
-        httpd_register_uri_handler(server, &mjpeg_uri);
+        httpd_register_uri_handler(server, &capture_uri);
 
-        ESP_LOGI(TAG, "HTTP Server started");
+        for (int i = 0; i < text_entry_count; i++) {
+            text_uri_register(&text_entries[i]);
+        }
+
+        ESP_LOGI(TAG, "HTTP Server started%s", with_stream ? "" : " (text only)");
     } else {
         ESP_LOGE(TAG, "Failed to start HTTP Server");
     }
 }
 
-void http_server_send_frame(uint8_t *jpeg, size_t len) {
-    if (xSemaphoreTake(frame_mutex, 0) == pdTRUE) {
-        if (latest_frame) {
-            free(latest_frame);
-            latest_frame = NULL;
-        }
-        latest_frame = malloc(len);
-        if (latest_frame) {
-            memcpy(latest_frame, jpeg, len);
-            latest_frame_len = len;
-        } else {
-            ESP_LOGE(TAG, "Failed to allocate memory for JPEG frame");
-            latest_frame_len = 0;
-        }
-        xSemaphoreGive(frame_mutex);
+void http_server_start(void) {
+    http_server_start_internal(true);
+}
+
+void http_server_start_text(void) {
+    http_server_start_internal(false);
+}
+
+// 发布新帧: 一次原子交换替换引用，旧帧在最后一个读者发送完后释放
+void http_server_send_frame(lcd_camera_frame_t *frame) {
+    lcd_camera_frame_ref(frame);
+    lcd_camera_frame_t *old = __atomic_exchange_n(&latest_frame, frame, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < HTTP_STREAM_MAX_CLIENTS; i++) {
+        TaskHandle_t waiter = __atomic_load_n(&stream_waiters[i], __ATOMIC_ACQUIRE);
+        if (waiter) xTaskNotifyGive(waiter);
+    }
+    if (old == NULL) return;
+
+    retired_release();
+    if (__atomic_load_n(&readers_active, __ATOMIC_SEQ_CST) == 0) {
+        lcd_camera_frame_unref(old);
+        return;
+    }
+    // 有读者可能刚读到 old 还未加引用; 取帧过程只有几条指令，延后列表满时让出一个 tick 再看
+    __atomic_fetch_add(&mjpeg_stats.retire_deferred, 1, __ATOMIC_RELAXED);
+    while (retired_count >= HTTP_RETIRE_MAX) {
+        vTaskDelay(1);
+        retired_release();
     }
+    retired[retired_count++] = old;
 }
@@ -4,9 +4,23 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "lcd_camera.h"
 
 void http_server_start(void);
-void http_server_send_frame(uint8_t *jpeg, size_t len);
+void http_server_start_text(void);     // 只提供 /capture.jpg 与文本接口，供其他推流模式查询统计
+void http_server_send_frame(lcd_camera_frame_t *frame);   // 持有帧引用直到下一帧发布，不拷贝
 bool http_stream_flag_get(void);
 
+// 文本接口 (统计/状态)：render 把完整响应体写入 buf，返回长度
+typedef int (*http_text_render_t)(char *buf, size_t size);
+
+// 注册 GET uri，可在 http_server_start 前后调用
+void http_server_register_text(const char *uri, const char *content_type, http_text_render_t render);
+
+// MJPEG 推流发送统计 (JSON)，可直接注册为文本接口
+int http_server_render_stats(char *buf, size_t size);
+
+// 同上，Prometheus 文本格式，含每连接的降帧系数与在途字节
+int http_server_render_metrics(char *buf, size_t size);
+
 #endif
@@ -11,6 +11,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "esp_err.h"
 #include "esp_lcd_types.h"
@@ -41,13 +42,64 @@ extern "C" {
 #define CAM_PIN_HREF                GPIO_NUM_38
 #define CAM_PIN_PCLK                GPIO_NUM_11
 
+/**
+ * @brief 推流分层 (simulcast)，同一次采集按需编码出多路分辨率
+ */
+#define LCD_CAMERA_TIER_FULL        0           // 采集分辨率
+#define LCD_CAMERA_TIER_QUARTER     1           // 宽高各减半 (1/4 面积)，较低质量
+#define LCD_CAMERA_TIER_COUNT       2
+#define LCD_CAMERA_TIER_BIT(t)      (1u << (t))
+
+/**
+ * @brief 编码后的 JPEG 帧，引用计数管理
+ *
+ * send_jpeg 回调期间帧保证有效；需要在回调返回后继续使用(如重传缓存)时
+ * 调用 lcd_camera_frame_ref() 持有，用完 lcd_camera_frame_unref() 释放。
+ */
+typedef struct {
+    uint8_t *buf;               // JPEG 数据
+    size_t len;
+    int64_t timestamp_us;       // 帧采集时刻(esp_timer 时基)
+    uint32_t seq;               // 帧序号，单调递增
+    uint16_t width;
+    uint16_t height;
+    uint8_t tier;               // LCD_CAMERA_TIER_*，同一次采集的各分层 seq 相同
+    int refcount;               // 仅通过 ref/unref 访问
+} lcd_camera_frame_t;
+
 typedef struct {
 	bool (*stream_flag)(void);					   // 转换标志
-    void (*send_jpeg)(uint8_t *jpeg, size_t len, uint8_t type);  // 注册 MJPEG 回调
+    void (*send_jpeg)(lcd_camera_frame_t *frame, uint8_t type);  // 注册 MJPEG 回调
+    uint8_t (*stream_tiers)(void);                 // 可选: 需要编码的分层位图，NULL 时只编码全分辨率
+    /*
+     * 可选: 边编码边输出。注册后推流帧不再经 send_jpeg，而是在编码过程中以同一个 frame
+     * 多次回调，frame->buf 前 frame->len 字节已就绪 (buf 地址不变，len 只增不减)，
+     * 最后以 done = true 结束; 编码中途失败时以 len = 0、done = true 结束本帧。
+     */
+    void (*send_jpeg_chunk)(lcd_camera_frame_t *frame, uint8_t type, bool done);
 } lcd_camera_config_t;
 
 esp_err_t lcd_camera_start(const lcd_camera_config_t *config);
 esp_lcd_panel_handle_t lcd_camera_get_panel(void);
+void lcd_camera_get_resolution(uint16_t *width, uint16_t *height);
+
+/**
+ * @brief 取一帧全分辨率 JPEG 快照，用完 lcd_camera_frame_unref()
+ *
+ * 推流进行中直接返回最近编码的帧 (capture_us 为 0)；未推流时现场采集并编码，
+ * capture_us 返回采集加编码的耗时。失败返回 NULL。
+ */
+lcd_camera_frame_t *lcd_camera_snapshot(uint32_t *capture_us);
+
+/**
+ * @brief 采集/编码计数与耗时直方图，Prometheus 文本格式，返回写入长度
+ *
+ * 只写入 buf，不分配内存，缓冲区不足时截断。
+ */
+int lcd_camera_render_metrics(char *buf, size_t size);
+
+lcd_camera_frame_t *lcd_camera_frame_ref(lcd_camera_frame_t *frame);
+void lcd_camera_frame_unref(lcd_camera_frame_t *frame);
 
 #ifdef __cplusplus
 }
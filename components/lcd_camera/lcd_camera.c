@@ -1,5 +1,6 @@
 #include "lcd_camera.h"
 #include "esp_camera.h"
+#include "img_converters.h"
 #include "esp_log.h"
 #include "esp_lcd_panel_ops.h"
 #include "driver/gpio.h"
@@ -13,6 +14,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include "esp_timer.h"
+#include "stream_metrics.h"
 
 #define TAG "lcd_camera"
 
@@ -22,6 +24,7 @@
 #define LCD_V_RES 240
 #define DISPLAY_STREAM_FRAME_RATE CONFIG_CAMERA_STREAM_FRAME_RATE
 #define DISPLAY_SW_QUALITY 80 // 0~100
+#define STREAM_QUARTER_QUALITY 60 // 1/4 分层给弱链路，质量再降一档
 
 static esp_lcd_panel_handle_t panel_handle = NULL;
 static lcd_camera_config_t user_config;
@@ -160,6 +163,25 @@ static void release_camera_fb(camera_fb_t *fb) {
     }
 }
 
+lcd_camera_frame_t *lcd_camera_frame_ref(lcd_camera_frame_t *frame) {
+    if (frame) {
+        __atomic_add_fetch(&frame->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return frame;
+}
+
+void lcd_camera_frame_unref(lcd_camera_frame_t *frame) {
+    if (frame && __atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(frame->buf);
+        free(frame);
+    }
+}
+
+// 帧采集时间戳(esp_timer 时基, us)，由驱动在 VSYNC 时写入 fb->timestamp
+static inline int64_t camera_fb_timestamp_us(const camera_fb_t *fb) {
+    return (int64_t)fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec;
+}
+
 // 精准帧间隔延时
 static inline void delay_frame_us(int frame_interval_us, uint64_t *last_time) {
     uint64_t now = esp_timer_get_time();
@@ -212,27 +234,257 @@ static void display_task(void *arg) {
     }
 }
 
+// 2x2 均值缩小 RGB565 (大端，与摄像头输出一致)
+static void rgb565_downscale_2x(const uint8_t *src, uint8_t *dst, int width, int height) {
+    for (int y = 0; y < height / 2; y++) {
+        const uint8_t *r0 = src + (size_t)(2 * y) * width * 2;
+        const uint8_t *r1 = r0 + width * 2;
+        for (int x = 0; x < width / 2; x++) {
+            int r = 0, g = 0, b = 0;
+            const uint8_t *px[4] = { r0 + x * 4, r0 + x * 4 + 2, r1 + x * 4, r1 + x * 4 + 2 };
+            for (int k = 0; k < 4; k++) {
+                uint16_t p = (px[k][0] << 8) | px[k][1];
+                r += p >> 11;
+                g += (p >> 5) & 0x3F;
+                b += p & 0x1F;
+            }
+            uint16_t p = ((r / 4) << 11) | ((g / 4) << 5) | (b / 4);
+            *dst++ = (uint8_t)(p >> 8);
+            *dst++ = (uint8_t)(p & 0xFF);
+        }
+    }
+}
+
+// 2x2 均值缩小 YUV422 (Y0 U Y1 V): 输出每组 2 像素对应源 4x2 像素
+static void yuv422_downscale_2x(const uint8_t *src, uint8_t *dst, int width, int height) {
+    for (int y = 0; y < height / 2; y++) {
+        const uint8_t *r0 = src + (size_t)(2 * y) * width * 2;
+        const uint8_t *r1 = r0 + width * 2;
+        for (int x = 0; x + 4 <= width; x += 4) {
+            const uint8_t *a0 = r0 + x * 2, *a1 = r1 + x * 2;
+            *dst++ = (a0[0] + a0[2] + a1[0] + a1[2] + 2) / 4;
+            *dst++ = (a0[1] + a0[5] + a1[1] + a1[5] + 2) / 4;
+            *dst++ = (a0[4] + a0[6] + a1[4] + a1[6] + 2) / 4;
+            *dst++ = (a0[3] + a0[7] + a1[3] + a1[7] + 2) / 4;
+        }
+    }
+}
+
+// 边编码边输出的帧缓冲区大小，与 frame2jpg 内部的输出缓冲一致
+#define STREAM_CHUNK_BUF_SIZE (128*1024)
+// 快照复用最近全分辨率帧的时效，超过即视为未在推流，现场采集
+#define SNAPSHOT_MAX_AGE_US   (2*1000000/DISPLAY_STREAM_FRAME_RATE)
+
+static uint32_t frame_seq = 0;                  // 推流与快照共用的帧序号
+static uint8_t *chunk_buf = NULL;               // 常驻的边编码边发送输出缓冲，分层在推流任务中依次编码，一个即可
+static lcd_camera_frame_t *latest_full = NULL;  // 最近编码的全分辨率帧 (持有引用)，供快照复用
+static SemaphoreHandle_t latest_mutex = NULL;   // 只保护 latest_full 指针的替换与取引用
+
+// 推流流水线统计，只有推流任务写入
+static struct {
+    uint32_t captured;
+    uint32_t capture_failures;
+    uint32_t encoded[LCD_CAMERA_TIER_COUNT];
+    uint32_t encode_failures[LCD_CAMERA_TIER_COUNT];
+    uint64_t encoded_bytes[LCD_CAMERA_TIER_COUNT];
+    stream_hist_t capture_hist;                 // 等待并取得摄像头帧
+    stream_hist_t encode_hist[LCD_CAMERA_TIER_COUNT];   // 边编码边发送时含发送
+} pipeline_stats;
+
+// 记下最近的全分辨率帧，替换下来的旧帧在最后一个读者用完后释放
+static void latest_full_set(lcd_camera_frame_t *frame){
+    lcd_camera_frame_ref(frame);
+    xSemaphoreTake(latest_mutex, portMAX_DELAY);
+    lcd_camera_frame_t *old = latest_full;
+    latest_full = frame;
+    xSemaphoreGive(latest_mutex);
+    lcd_camera_frame_unref(old);
+}
+
+typedef struct {
+    lcd_camera_frame_t *frame;
+    bool overflow;
+} stream_chunk_ctx_t;
+
+// 编码器输出回调: 追加到帧缓冲区后立即把已就绪的部分交给推流端
+static size_t stream_chunk_out(void *arg, size_t index, const void *data, size_t len){
+    stream_chunk_ctx_t *ctx = (stream_chunk_ctx_t *)arg;
+    lcd_camera_frame_t *frame = ctx->frame;
+    if(ctx->overflow || index + len > STREAM_CHUNK_BUF_SIZE){
+        ctx->overflow = true;   // 编码器不检查返回值，这里记下失败，编码结束后整帧作废
+        return 0;
+    }
+    memcpy(frame->buf + index, data, len);
+    frame->len = index + len;
+    user_config.send_jpeg_chunk(frame, 1, false);
+    return len;
+}
+
+// 分层编码的源图像与参数: 1/4 分层先缩小到常驻缓冲
+static uint8_t *tier_source(camera_fb_t *fb, uint8_t tier, uint16_t *width, uint16_t *height, uint8_t *quality){
+    static uint8_t *scaled_buf = NULL;     // 1/4 分层的缩小缓冲，首次使用时分配并常驻
+    *width = fb->width;
+    *height = fb->height;
+    *quality = DISPLAY_SW_QUALITY;
+    if(tier != LCD_CAMERA_TIER_QUARTER){
+        return fb->buf;
+    }
+
+    *width /= 2;
+    *height /= 2;
+    *quality = STREAM_QUARTER_QUALITY;
+    if(!scaled_buf){
+        scaled_buf = heap_caps_malloc((size_t)*width * *height * 2, MALLOC_CAP_SPIRAM|MALLOC_CAP_8BIT);
+    }
+    if(!scaled_buf){
+        ESP_LOGW(TAG,"No memory for scaled frame");
+        return NULL;
+    }
+    if(fb->format==PIXFORMAT_YUV422){
+        yuv422_downscale_2x(fb->buf, scaled_buf, fb->width, fb->height);
+    } else {
+        rgb565_downscale_2x(fb->buf, scaled_buf, fb->width, fb->height);
+    }
+    return scaled_buf;
+}
+
+static lcd_camera_frame_t *frame_new(camera_fb_t *fb, uint8_t tier, uint32_t seq, uint16_t width, uint16_t height){
+    lcd_camera_frame_t *frame = calloc(1, sizeof(lcd_camera_frame_t));
+    if(!frame){
+        ESP_LOGW(TAG,"No memory for frame");
+        return NULL;
+    }
+    frame->timestamp_us = camera_fb_timestamp_us(fb);
+    frame->seq = seq;
+    frame->width = width;
+    frame->height = height;
+    frame->tier = tier;
+    frame->refcount = 1;
+    return frame;
+}
+
+// 整帧编码一个分层，返回持有一个引用的帧，失败返回 NULL
+static lcd_camera_frame_t *encode_tier(camera_fb_t *fb, uint8_t tier, uint32_t seq){
+    uint16_t width, height;
+    uint8_t quality;
+    uint8_t *src = tier_source(fb, tier, &width, &height, &quality);
+    if(!src){
+        return NULL;
+    }
+    lcd_camera_frame_t *frame = frame_new(fb, tier, seq, width, height);
+    if(!frame){
+        return NULL;
+    }
+    if(!fmt2jpg(src, (size_t)width*height*2, width, height, fb->format, quality, &frame->buf, &frame->len)){
+        free(frame);
+        ESP_LOGW(TAG,"SW JPEG encode failed (tier %u)", tier);
+        return NULL;
+    }
+    return frame;
+}
+
+// 边编码边推送一个分层，返回持有一个引用的帧 (编码失败时 len 为 0)
+static lcd_camera_frame_t *encode_tier_chunked(camera_fb_t *fb, uint8_t tier, uint32_t seq){
+    uint16_t width, height;
+    uint8_t quality;
+    uint8_t *src = tier_source(fb, tier, &width, &height, &quality);
+    if(!src){
+        return NULL;
+    }
+    lcd_camera_frame_t *frame = frame_new(fb, tier, seq, width, height);
+    if(!frame){
+        return NULL;
+    }
+    // 输出缓冲区在编码期间地址不变，推流端可以直接引用已就绪的数据; 常驻缓冲被上一帧带走时才重新分配
+    frame->buf = chunk_buf ? chunk_buf : heap_caps_malloc(STREAM_CHUNK_BUF_SIZE, MALLOC_CAP_SPIRAM|MALLOC_CAP_8BIT);
+    chunk_buf = NULL;
+    if(!frame->buf){
+        free(frame);
+        ESP_LOGW(TAG,"No memory for JPEG buffer");
+        return NULL;
+    }
+    stream_chunk_ctx_t ctx = { .frame = frame };
+    bool ok = fmt2jpg_cb(src, (size_t)width*height*2, width, height, fb->format, quality,
+                         stream_chunk_out, &ctx) && !ctx.overflow;
+    if(!ok){
+        ESP_LOGW(TAG,"SW JPEG encode failed (tier %u%s)", tier, ctx.overflow ? ", overflow" : "");
+        frame->len = 0;
+    }
+    user_config.send_jpeg_chunk(frame, 1, true);
+
+    // 重传历史 (已持有引用) 与快照 (全分辨率分层) 会留住帧，拷到按实际长度分配的缓冲，输出缓冲留给下一帧;
+    // 重传也在推流任务中进行，此处替换 frame->buf 不会与读者并发
+    uint8_t *out = frame->buf;
+    bool kept = frame->len > 0 &&
+                (tier == LCD_CAMERA_TIER_FULL || __atomic_load_n(&frame->refcount, __ATOMIC_ACQUIRE) > 1);
+    if(kept){
+        uint8_t *buf = heap_caps_malloc(frame->len, MALLOC_CAP_SPIRAM|MALLOC_CAP_8BIT);
+        if(!buf){
+            return frame;   // 内存不足时帧带走输出缓冲，下一帧重新分配
+        }
+        memcpy(buf, out, frame->len);
+        frame->buf = buf;
+    } else {
+        frame->buf = NULL;  // 帧不再被读取，只保留长度供统计
+    }
+    chunk_buf = out;
+    return frame;
+}
+
+// 编码一个分层并推送，失败时只记日志，不影响同一次采集的其他分层
+static void stream_send_tier(camera_fb_t *fb, uint8_t tier, uint32_t seq) {
+    lcd_camera_frame_t *frame;
+    int64_t start_us = esp_timer_get_time();
+    if(user_config.send_jpeg_chunk){
+        frame = encode_tier_chunked(fb, tier, seq);
+    } else {
+        frame = encode_tier(fb, tier, seq);
+    }
+    if(frame && frame->len > 0){
+        stream_hist_observe(&pipeline_stats.encode_hist[tier], (uint32_t)(esp_timer_get_time() - start_us));
+        __atomic_fetch_add(&pipeline_stats.encoded[tier], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pipeline_stats.encoded_bytes[tier], (uint64_t)frame->len, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&pipeline_stats.encode_failures[tier], 1, __ATOMIC_RELAXED);
+    }
+    if(frame && !user_config.send_jpeg_chunk){
+        user_config.send_jpeg(frame,1);
+    }
+    if(frame && frame->len > 0 && tier == LCD_CAMERA_TIER_FULL){
+        latest_full_set(frame);
+    }
+    lcd_camera_frame_unref(frame);
+}
+
 static void stream_task(void *arg){
     uint64_t last_time = esp_timer_get_time();
     const int frame_interval_us = 1000000 / DISPLAY_STREAM_FRAME_RATE;
 
     while(1){
         if(user_config.send_jpeg && user_config.stream_flag && user_config.stream_flag()){
+            // 只编码有订阅者的分层，全部未订阅时跳过本次采集
+            uint8_t tiers = user_config.stream_tiers ? user_config.stream_tiers()
+                                                      : LCD_CAMERA_TIER_BIT(LCD_CAMERA_TIER_FULL);
+            if(!tiers){
+                delay_frame_us(frame_interval_us,&last_time);
+                continue;
+            }
+            int64_t capture_start_us = esp_timer_get_time();
             camera_fb_t *fb = acquire_camera_fb();
             if(!fb){
+                __atomic_fetch_add(&pipeline_stats.capture_failures, 1, __ATOMIC_RELAXED);
                 delay_frame_us(frame_interval_us,&last_time);
                 continue;
             }
-
-            uint8_t *jpeg_buf=NULL;
-            size_t jpeg_len=0;
+            stream_hist_observe(&pipeline_stats.capture_hist, (uint32_t)(esp_timer_get_time() - capture_start_us));
+            __atomic_fetch_add(&pipeline_stats.captured, 1, __ATOMIC_RELAXED);
 
             if(fb->format==PIXFORMAT_YUV422 || fb->format==PIXFORMAT_RGB565){
-                if(frame2jpg(fb,DISPLAY_SW_QUALITY,&jpeg_buf,&jpeg_len)){
-                    user_config.send_jpeg(jpeg_buf,jpeg_len,1);
-                    free(jpeg_buf);
-                } else {
-                    ESP_LOGW(TAG,"SW JPEG encode failed");
+                uint32_t seq = __atomic_fetch_add(&frame_seq, 1, __ATOMIC_RELAXED);
+                for(uint8_t tier = 0; tier < LCD_CAMERA_TIER_COUNT; tier++){
+                    if(tiers & LCD_CAMERA_TIER_BIT(tier)){
+                        stream_send_tier(fb, tier, seq);
+                    }
                 }
             } else {
                 ESP_LOGE(TAG,"Unsupported FB format:%d",fb->format);
@@ -244,6 +496,87 @@ static void stream_task(void *arg){
     }
 }
 
+lcd_camera_frame_t *lcd_camera_snapshot(uint32_t *capture_us){
+    *capture_us = 0;
+    if(!latest_mutex){
+        return NULL;
+    }
+
+    // 推流中 (或刚现场采集过) 直接复用最近的全分辨率帧
+    lcd_camera_frame_t *frame = NULL;
+    xSemaphoreTake(latest_mutex, portMAX_DELAY);
+    if(latest_full && esp_timer_get_time() - latest_full->timestamp_us < SNAPSHOT_MAX_AGE_US){
+        frame = lcd_camera_frame_ref(latest_full);
+    }
+    xSemaphoreGive(latest_mutex);
+    if(frame){
+        return frame;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    camera_fb_t *fb = acquire_camera_fb();
+    if(!fb){
+        ESP_LOGW(TAG,"Snapshot: no camera frame");
+        return NULL;
+    }
+    if(fb->format==PIXFORMAT_YUV422 || fb->format==PIXFORMAT_RGB565){
+        frame = encode_tier(fb, LCD_CAMERA_TIER_FULL, __atomic_fetch_add(&frame_seq, 1, __ATOMIC_RELAXED));
+    } else {
+        ESP_LOGE(TAG,"Unsupported FB format:%d",fb->format);
+    }
+    release_camera_fb(fb);
+    *capture_us = (uint32_t)(esp_timer_get_time() - start_us);
+    if(frame){
+        latest_full_set(frame);
+    }
+    return frame;
+}
+
+int lcd_camera_render_metrics(char *buf, size_t size){
+    size_t len = 0;
+    if(size == 0){
+        return 0;
+    }
+    buf[0] = '\0';
+    stream_metrics_type(buf, size, &len, "camera_frames_captured_total", "counter");
+    stream_metrics_append(buf, size, &len, "camera_frames_captured_total %u\n",
+                          (unsigned)__atomic_load_n(&pipeline_stats.captured, __ATOMIC_RELAXED));
+    stream_metrics_type(buf, size, &len, "camera_capture_failures_total", "counter");
+    stream_metrics_append(buf, size, &len, "camera_capture_failures_total %u\n",
+                          (unsigned)__atomic_load_n(&pipeline_stats.capture_failures, __ATOMIC_RELAXED));
+    stream_metrics_type(buf, size, &len, "camera_capture_seconds", "histogram");
+    stream_hist_render(buf, size, &len, "camera_capture_seconds", NULL, &pipeline_stats.capture_hist);
+
+    stream_metrics_type(buf, size, &len, "camera_frames_encoded_total", "counter");
+    for(int t = 0; t < LCD_CAMERA_TIER_COUNT; t++){
+        stream_metrics_append(buf, size, &len, "camera_frames_encoded_total{tier=\"%d\"} %u\n", t,
+                              (unsigned)__atomic_load_n(&pipeline_stats.encoded[t], __ATOMIC_RELAXED));
+    }
+    stream_metrics_type(buf, size, &len, "camera_encode_failures_total", "counter");
+    for(int t = 0; t < LCD_CAMERA_TIER_COUNT; t++){
+        stream_metrics_append(buf, size, &len, "camera_encode_failures_total{tier=\"%d\"} %u\n", t,
+                              (unsigned)__atomic_load_n(&pipeline_stats.encode_failures[t], __ATOMIC_RELAXED));
+    }
+    stream_metrics_type(buf, size, &len, "camera_encoded_bytes_total", "counter");
+    for(int t = 0; t < LCD_CAMERA_TIER_COUNT; t++){
+        stream_metrics_append(buf, size, &len, "camera_encoded_bytes_total{tier=\"%d\"} %llu\n", t,
+                              (unsigned long long)__atomic_load_n(&pipeline_stats.encoded_bytes[t], __ATOMIC_RELAXED));
+    }
+    stream_metrics_type(buf, size, &len, "camera_encode_seconds", "histogram");
+    for(int t = 0; t < LCD_CAMERA_TIER_COUNT; t++){
+        char labels[16];
+        snprintf(labels, sizeof(labels), "tier=\"%d\"", t);
+        stream_hist_render(buf, size, &len, "camera_encode_seconds", labels, &pipeline_stats.encode_hist[t]);
+    }
+    return (int)len;
+}
+
+// 推流分辨率(编码前的帧尺寸)，摄像头未启动时也可查询
+void lcd_camera_get_resolution(uint16_t *width, uint16_t *height){
+    *width = resolution[camera_config.frame_size].width;
+    *height = resolution[camera_config.frame_size].height;
+}
+
 esp_err_t lcd_camera_start(const lcd_camera_config_t *config){
     if(config==NULL || config->send_jpeg==NULL || config->stream_flag==NULL){
         ESP_LOGE(TAG,"Invalid lcd_camera_config! send_jpeg or stream_flag is NULL");
@@ -252,12 +585,19 @@ esp_err_t lcd_camera_start(const lcd_camera_config_t *config){
 
     // 创建互斥锁用于帧缓冲区保护
     fb_mutex = xSemaphoreCreateMutex();
-    if (fb_mutex == NULL) {
+    latest_mutex = xSemaphoreCreateMutex();
+    if (fb_mutex == NULL || latest_mutex == NULL) {
         ESP_LOGE(TAG, "Failed to create mutex");
         return ESP_FAIL;
     }
 
     user_config = *config;
+    if(user_config.send_jpeg_chunk){
+        chunk_buf = heap_caps_malloc(STREAM_CHUNK_BUF_SIZE, MALLOC_CAP_SPIRAM|MALLOC_CAP_8BIT);
+        if(!chunk_buf){
+            ESP_LOGW(TAG,"No memory for JPEG chunk buffer, allocate on first frame");
+        }
+    }
     ESP_ERROR_CHECK(esp_camera_init(&camera_config));
     
 #ifdef LCD_DISPLAY_EN
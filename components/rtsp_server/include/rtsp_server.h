@@ -4,15 +4,19 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "lcd_camera.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void rtsp_server_start(void);
-void rtsp_server_send_frame(uint8_t *jpeg, size_t len, uint8_t type);
+void rtsp_server_send_frame(lcd_camera_frame_t *frame, uint8_t type);
+// 边编码边发送 (lcd_camera send_jpeg_chunk): 满一个包即发出，done 时发出带 marker 的末包
+void rtsp_server_send_chunk(lcd_camera_frame_t *frame, uint8_t type, bool done);
 void rtsp_server_on_ip_assigned(uint32_t client_ip);
 bool rtsp_stream_flag_get(void);
+uint8_t rtsp_stream_tiers_get(void);    // 有会话订阅的分层位图 (LCD_CAMERA_TIER_BIT)
 
 #ifdef __cplusplus
 }
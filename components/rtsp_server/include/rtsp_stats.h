@@ -0,0 +1,126 @@
+// rtsp_stats.h
+// RTSP/RTP 推流统计: 每会话与全局累计计数
+// 只有推流任务写入 (单写者)，各槽位带 seqlock，读者无锁取得一致快照
+#ifndef __RTSP_STATS_H__
+#define __RTSP_STATS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "stream_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTSP_STATS_MAX_SESSIONS 4      // 会话槽位 (单播 + 组播)，满时复用最早结束的槽
+
+typedef enum {
+    RTSP_DROP_ADMISSION = 0,           // 准入预估超出预算，整帧跳过
+    RTSP_DROP_INVALID,                 // 非法 JPEG
+    RTSP_DROP_SEND_ABORT,              // 整帧放弃: 首包发送失败，或边编码边发送时编码中途失败
+    RTSP_DROP_PKT_SEND,                // 帧中途发送失败的包
+    RTSP_DROP_MAX,
+} rtsp_drop_reason_t;
+
+typedef enum {
+    RTSP_STATS_UDP = 0,
+    RTSP_STATS_TCP,
+    RTSP_STATS_MCAST,
+} rtsp_stats_transport_t;
+
+typedef struct {
+    uint32_t frames;                   // 发出的帧
+    uint64_t bytes;                    // 发出的 JPEG 字节
+    uint32_t packets;                  // 发出的 RTP 媒体包
+    uint32_t fec_packets;
+    uint32_t rtx_packets;              // NACK 重传
+    uint32_t retries;                  // 发送退避重试次数
+    uint32_t drops[RTSP_DROP_MAX];
+    uint32_t send_calls;               // sendto/writev/批量提交调用次数
+    uint64_t send_us_total;            // 发送调用耗时累计 (含退避)
+    uint32_t send_us_max;
+    uint32_t rr_count;                 // 收到的 RTCP RR
+    uint8_t rr_fraction_lost;          // 最近一次 RR 的 fraction lost (x/256)
+    uint32_t rr_cum_lost;              // 最近一次 RR 的累计丢包
+    uint32_t rr_jitter;                // 最近一次 RR 的到达抖动 (RTP 时钟单位)
+    // 以下仅全局累计: 进入推流的源帧
+    uint32_t frames_in;
+    uint64_t bytes_in;
+    uint64_t frame_us_total;           // 每帧发送耗时累计
+    uint32_t wire_frames;              // 统计了采集到发出时延的帧
+    uint64_t wire_us_total;            // 采集 (VSYNC) 到最后一个包交给协议栈的时延累计
+    uint32_t wire_us_max;
+    stream_hist_t frame_hist;          // 每帧发送耗时分布
+    stream_hist_t wire_hist;           // 采集到发出时延分布
+} rtsp_stats_counters_t;
+
+typedef struct {
+    uint32_t session_id;               // 0 表示空槽
+    uint8_t transport;                 // rtsp_stats_transport_t
+    uint8_t tier;                      // 当前订阅的分层 (LCD_CAMERA_TIER_*)
+    bool active;
+    uint32_t peer_ip;                  // 网络字节序
+    uint16_t peer_port;
+    int64_t start_us;
+    int64_t end_us;                    // active 为 false 时有效
+    rtsp_stats_counters_t c;
+} rtsp_stats_session_t;
+
+typedef struct {
+    int64_t now_us;
+    rtsp_stats_session_t total;        // 只用到计数 c，自启动起累计
+    rtsp_stats_session_t sessions[RTSP_STATS_MAX_SESSIONS];
+} rtsp_stats_snapshot_t;
+
+/* 写端: 仅推流任务调用 */
+
+// 登记新会话，返回槽位号
+int rtsp_stats_session_open(uint32_t session_id, rtsp_stats_transport_t transport,
+                            uint32_t peer_ip, uint16_t peer_port);
+void rtsp_stats_session_close(int slot);
+
+// 会话切换分层 (SETUP 选定后经 SET_PARAMETER 切换)
+void rtsp_stats_session_tier(int slot, uint8_t tier);
+
+// 把一帧内累积的增量并入会话 (slot >= 0) 与全局计数
+void rtsp_stats_commit(int slot, const rtsp_stats_counters_t *delta);
+
+// 记录 RTCP RR 的第一个 report block
+void rtsp_stats_rtcp_rr(int slot, uint8_t fraction_lost, uint32_t cum_lost, uint32_t jitter);
+
+// 推流任务读取自身写入的计数，不需要快照
+const rtsp_stats_counters_t *rtsp_stats_total(void);
+const rtsp_stats_counters_t *rtsp_stats_session(int slot);
+
+// 记录一次发送调用的耗时
+static inline void rtsp_stats_send_call(rtsp_stats_counters_t *c, uint32_t us) {
+    c->send_calls++;
+    c->send_us_total += us;
+    if (us > c->send_us_max) c->send_us_max = us;
+}
+
+// 记录一帧从采集到最后一个包发出的时延 (glass-to-wire，仅全局)
+static inline void rtsp_stats_wire_latency(rtsp_stats_counters_t *c, uint32_t us) {
+    c->wire_frames++;
+    c->wire_us_total += us;
+    if (us > c->wire_us_max) c->wire_us_max = us;
+    stream_hist_observe(&c->wire_hist, us);
+}
+
+/* 读端: 任意任务 */
+
+void rtsp_stats_snapshot(rtsp_stats_snapshot_t *out);
+
+// 渲染为文本 (shell) 或 JSON (HTTP)，返回写入长度，缓冲区不足时截断
+int rtsp_stats_render_text(char *buf, size_t size);
+int rtsp_stats_render_json(char *buf, size_t size);
+
+// Prometheus 文本格式，只由 HTTP 服务任务调用 (内部快照为静态缓冲，不分配内存)
+int rtsp_stats_render_metrics(char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RTSP_STATS_H__
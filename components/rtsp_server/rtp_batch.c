@@ -0,0 +1,272 @@
+// rtp_batch.c
+#ifndef ESP_PLATFORM
+#define _GNU_SOURCE     // sendmmsg
+#endif
+#include "rtp_batch.h"
+#include <string.h>
+#include <errno.h>
+
+#define RTP_FIXED_HDR_SIZE  12
+
+#ifdef ESP_PLATFORM
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+#include "lwip/priv/tcpip_priv.h"
+
+// tcpip 线程内执行的调用参数
+typedef struct {
+    struct tcpip_api_call_data call;
+    rtp_batch_t *b;
+    uint16_t port;
+    uint8_t ttl;
+    int sent;
+} rtp_batch_api_t;
+
+static err_t rtp_batch_open_cb(struct tcpip_api_call_data *call) {
+    rtp_batch_api_t *api = (rtp_batch_api_t *)call;
+    struct udp_pcb *pcb = udp_new_ip_type(IPADDR_TYPE_V4);
+    if (!pcb) return ERR_MEM;
+    ip_set_option(pcb, SOF_REUSEADDR);
+    err_t err = udp_bind(pcb, IP4_ADDR_ANY, api->port);
+    if (err != ERR_OK) {
+        udp_remove(pcb);
+        return err;
+    }
+#if LWIP_MULTICAST_TX_OPTIONS
+    if (api->ttl) udp_set_multicast_ttl(pcb, api->ttl);
+#endif
+    api->b->pcb = pcb;
+    return ERR_OK;
+}
+
+static err_t rtp_batch_close_cb(struct tcpip_api_call_data *call) {
+    rtp_batch_api_t *api = (rtp_batch_api_t *)call;
+    udp_remove(api->b->pcb);
+    api->b->pcb = NULL;
+    return ERR_OK;
+}
+
+// 依次 udp_sendto，遇到第一个失败即停止，剩余包留给调用方退避后重试
+static err_t rtp_batch_send_cb(struct tcpip_api_call_data *call) {
+    rtp_batch_api_t *api = (rtp_batch_api_t *)call;
+    rtp_batch_t *b = api->b;
+    err_t err = ERR_OK;
+
+    while (b->head < b->count) {
+        rtp_batch_pkt_t *e = &b->pkts[b->head];
+        ip_addr_t dst = IPADDR4_INIT(e->addr);
+        err = udp_sendto(b->pcb, e->p, &dst, lwip_ntohs(e->port));
+        if (err != ERR_OK) {
+            // 协议栈已在 pbuf 前部填入 UDP/IP 头，恢复后才能重发
+            if (e->p->tot_len > e->len) pbuf_remove_header(e->p, e->p->tot_len - e->len);
+            break;
+        }
+        pbuf_free(e->p);
+        e->p = NULL;
+        if (e->flags & RTP_BATCH_F_MEDIA) {
+            b->media_sent++;
+            b->media_octets += e->len - RTP_FIXED_HDR_SIZE;
+        }
+        b->head++;
+        api->sent++;
+    }
+    return err;
+}
+
+int rtp_batch_open(rtp_batch_t *b, uint16_t local_port, uint8_t mcast_ttl, uint8_t limit) {
+    memset(b, 0, sizeof(*b));
+    b->limit = (limit == 0 || limit > RTP_BATCH_MAX_PKTS) ? RTP_BATCH_MAX_PKTS : limit;
+    rtp_batch_api_t api = { .b = b, .port = local_port, .ttl = mcast_ttl };
+    err_t err = tcpip_api_call(rtp_batch_open_cb, &api.call);
+    if (err != ERR_OK) {
+        b->last_err = err_to_errno(err);
+        return -1;
+    }
+    return 0;
+}
+
+void rtp_batch_close(rtp_batch_t *b) {
+    rtp_batch_discard(b);
+    if (b->pcb) {
+        rtp_batch_api_t api = { .b = b };
+        tcpip_api_call(rtp_batch_close_cb, &api.call);
+    }
+}
+
+int rtp_batch_add(rtp_batch_t *b, const struct sockaddr_in *dst,
+                  const uint8_t *hdr, size_t hdr_len,
+                  const uint8_t *payload, size_t payload_len, uint8_t flags) {
+    if (rtp_batch_full(b)) {
+        b->last_err = ENOBUFS;
+        return -1;
+    }
+    // 拷贝在发送任务中完成，tcpip 线程只做协议处理
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, hdr_len + payload_len, PBUF_RAM);
+    if (!p) {
+        b->last_err = ENOMEM;
+        return -1;
+    }
+    if (hdr_len) memcpy(p->payload, hdr, hdr_len);
+    if (payload_len) memcpy((uint8_t *)p->payload + hdr_len, payload, payload_len);
+
+    rtp_batch_pkt_t *e = &b->pkts[b->count++];
+    e->addr = dst->sin_addr.s_addr;
+    e->port = dst->sin_port;
+    e->flags = flags;
+    e->len = hdr_len + payload_len;
+    e->p = p;
+    return 0;
+}
+
+int rtp_batch_flush(rtp_batch_t *b) {
+    b->last_err = 0;
+    if (rtp_batch_pending(b) == 0) return 0;
+
+    rtp_batch_api_t api = { .b = b };
+    err_t err = tcpip_api_call(rtp_batch_send_cb, &api.call);
+    if (err == ERR_MEM || err == ERR_BUF || err == ERR_WOULDBLOCK) {
+        b->last_err = err_to_errno(err);
+        return api.sent;
+    }
+    if (err != ERR_OK) {
+        b->last_err = err_to_errno(err);
+        return -1;
+    }
+    b->count = 0;
+    b->head = 0;
+    return api.sent;
+}
+
+int rtp_batch_discard(rtp_batch_t *b) {
+    int dropped = 0;
+    for (int i = b->head; i < b->count; i++) {
+        if (b->pkts[i].flags & RTP_BATCH_F_MEDIA) dropped++;
+        pbuf_free(b->pkts[i].p);
+        b->pkts[i].p = NULL;
+    }
+    b->count = 0;
+    b->head = 0;
+    return dropped;
+}
+
+#else // 主机构建
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+int rtp_batch_open(rtp_batch_t *b, uint16_t local_port, uint8_t mcast_ttl, uint8_t limit) {
+    memset(b, 0, sizeof(*b));
+    b->limit = (limit == 0 || limit > RTP_BATCH_MAX_PKTS) ? RTP_BATCH_MAX_PKTS : limit;
+    b->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (b->sock < 0) {
+        b->last_err = errno;
+        return -1;
+    }
+    int one = 1;
+    setsockopt(b->sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (local_port) {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(local_port),
+                                    .sin_addr.s_addr = htonl(INADDR_ANY) };
+        if (bind(b->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            b->last_err = errno;
+            close(b->sock);
+            b->sock = -1;
+            return -1;
+        }
+    }
+    if (mcast_ttl) {
+        setsockopt(b->sock, IPPROTO_IP, IP_MULTICAST_TTL, &mcast_ttl, sizeof(mcast_ttl));
+    }
+    return 0;
+}
+
+void rtp_batch_close(rtp_batch_t *b) {
+    rtp_batch_discard(b);
+    if (b->sock >= 0) close(b->sock);
+    b->sock = -1;
+}
+
+int rtp_batch_add(rtp_batch_t *b, const struct sockaddr_in *dst,
+                  const uint8_t *hdr, size_t hdr_len,
+                  const uint8_t *payload, size_t payload_len, uint8_t flags) {
+    if (rtp_batch_full(b) || hdr_len > RTP_BATCH_HDR_MAX) {
+        b->last_err = ENOBUFS;
+        return -1;
+    }
+    if (flags & RTP_BATCH_F_COPY) {
+        if (b->arena_used + payload_len > RTP_BATCH_ARENA) {
+            b->last_err = ENOBUFS;
+            return -1;
+        }
+        memcpy(b->arena + b->arena_used, payload, payload_len);
+        payload = b->arena + b->arena_used;
+        b->arena_used += payload_len;
+    }
+
+    rtp_batch_pkt_t *e = &b->pkts[b->count++];
+    e->addr = dst->sin_addr.s_addr;
+    e->port = dst->sin_port;
+    e->flags = flags;
+    e->hdr_len = hdr_len;
+    if (hdr_len) memcpy(e->hdr, hdr, hdr_len);
+    e->payload = payload;
+    e->payload_len = payload_len;
+    return 0;
+}
+
+int rtp_batch_flush(rtp_batch_t *b) {
+    b->last_err = 0;
+    int n = rtp_batch_pending(b);
+    if (n == 0) return 0;
+
+    struct mmsghdr msgs[RTP_BATCH_MAX_PKTS];
+    struct iovec iov[RTP_BATCH_MAX_PKTS][2];
+    struct sockaddr_in dst[RTP_BATCH_MAX_PKTS];
+    memset(msgs, 0, sizeof(msgs[0]) * n);
+    for (int i = 0; i < n; i++) {
+        rtp_batch_pkt_t *e = &b->pkts[b->head + i];
+        dst[i] = (struct sockaddr_in){ .sin_family = AF_INET, .sin_port = e->port,
+                                       .sin_addr.s_addr = e->addr };
+        iov[i][0] = (struct iovec){ .iov_base = e->hdr, .iov_len = e->hdr_len };
+        iov[i][1] = (struct iovec){ .iov_base = (void *)e->payload, .iov_len = e->payload_len };
+        msgs[i].msg_hdr.msg_name = &dst[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(dst[i]);
+        msgs[i].msg_hdr.msg_iov = iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    int sent = sendmmsg(b->sock, msgs, n, 0);
+    if (sent < 0) {
+        b->last_err = errno;
+        return (errno == EAGAIN || errno == ENOBUFS || errno == ENOMEM) ? 0 : -1;
+    }
+    for (int i = 0; i < sent; i++) {
+        rtp_batch_pkt_t *e = &b->pkts[b->head + i];
+        if (e->flags & RTP_BATCH_F_MEDIA) {
+            b->media_sent++;
+            b->media_octets += e->hdr_len + e->payload_len - RTP_FIXED_HDR_SIZE;
+        }
+    }
+    b->head += sent;
+    if (b->head < b->count) {
+        b->last_err = EAGAIN;
+        return sent;
+    }
+    b->count = 0;
+    b->head = 0;
+    b->arena_used = 0;
+    return sent;
+}
+
+int rtp_batch_discard(rtp_batch_t *b) {
+    int dropped = 0;
+    for (int i = b->head; i < b->count; i++) {
+        if (b->pkts[i].flags & RTP_BATCH_F_MEDIA) dropped++;
+    }
+    b->count = 0;
+    b->head = 0;
+    b->arena_used = 0;
+    return dropped;
+}
+#endif
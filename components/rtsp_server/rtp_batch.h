@@ -0,0 +1,85 @@
+// rtp_batch.h
+// RTP 包批量发送: 一帧内的若干包先入队，再一次性交给协议栈
+// ESP 上每包预先在发送任务中拷贝进 pbuf，整批通过一次 tcpip_api_call 调用 udp_sendto，
+// 省去逐包 sendto 的 socket 层开销与 tcpip 邮箱往返; 主机构建使用 sendmmsg
+#ifndef __RTP_BATCH_H__
+#define __RTP_BATCH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#ifdef ESP_PLATFORM
+#include "lwip/sockets.h"
+#else
+#include <netinet/in.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTP_BATCH_MAX_PKTS  64
+#define RTP_BATCH_HDR_MAX   32          // 按值保存的包头上限 (RTP + JPEG 头)
+#define RTP_BATCH_ARENA     (16 * 1024) // 主机构建: RTP_BATCH_F_COPY 负载的拷贝区
+
+#define RTP_BATCH_F_MEDIA   0x01        // 计入 media_sent/media_octets (RTCP SR)
+#define RTP_BATCH_F_COPY    0x02        // 负载缓冲区在 flush 前会被复用，入队时拷贝
+
+typedef struct {
+    uint32_t addr;                      // 网络字节序
+    uint16_t port;                      // 网络字节序
+    uint8_t flags;
+#ifdef ESP_PLATFORM
+    uint16_t len;
+    struct pbuf *p;
+#else
+    uint8_t hdr_len;
+    uint16_t payload_len;
+    const uint8_t *payload;
+    uint8_t hdr[RTP_BATCH_HDR_MAX];
+#endif
+} rtp_batch_pkt_t;
+
+typedef struct {
+    rtp_batch_pkt_t pkts[RTP_BATCH_MAX_PKTS];
+    uint8_t count;                      // 已入队
+    uint8_t head;                       // 第一个未发出的包
+    uint8_t limit;                      // 入队上限，达到后需 flush
+    int last_err;                       // 最近一次 flush 的 errno，0 表示全部发出
+    uint32_t media_sent;                // 累计值，由调用方读取后清零
+    uint32_t media_octets;              // RTP 负载字节 (不含 12 字节 RTP 头)
+#ifdef ESP_PLATFORM
+    struct udp_pcb *pcb;
+#else
+    int sock;
+    size_t arena_used;
+    uint8_t arena[RTP_BATCH_ARENA];
+#endif
+} rtp_batch_t;
+
+// 打开批量发送通道: local_port 为 0 时使用临时端口，mcast_ttl 非 0 时设置组播 TTL
+// ESP 上端口以 SO_REUSEADDR 绑定，可与同端口的 socket 共存; 主机上 b->sock 可直接复用外部 socket
+int rtp_batch_open(rtp_batch_t *b, uint16_t local_port, uint8_t mcast_ttl, uint8_t limit);
+void rtp_batch_close(rtp_batch_t *b);
+
+// 入队一个包 = hdr + payload; 队列满或内存不足返回 -1，调用方 flush 后重试
+// 未带 RTP_BATCH_F_COPY 时主机构建只保存 payload 指针，须保证在 flush 前有效
+int rtp_batch_add(rtp_batch_t *b, const struct sockaddr_in *dst,
+                  const uint8_t *hdr, size_t hdr_len,
+                  const uint8_t *payload, size_t payload_len, uint8_t flags);
+
+// 一次提交所有待发包，返回本次发出的包数; 协议栈缓冲不足时部分发出，
+// 剩余包保留在队列中并置 last_err (EAGAIN/ENOMEM); 其余错误返回 -1
+int rtp_batch_flush(rtp_batch_t *b);
+
+// 丢弃未发出的包并清空队列，返回被丢弃的媒体包数
+int rtp_batch_discard(rtp_batch_t *b);
+
+static inline int rtp_batch_pending(const rtp_batch_t *b) { return b->count - b->head; }
+static inline bool rtp_batch_full(const rtp_batch_t *b) { return b->count >= b->limit; }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RTP_BATCH_H__
@@ -0,0 +1,87 @@
+// rtp_fec.c
+#include "rtp_fec.h"
+#include <string.h>
+
+#define RTP_FIXED_HEADER_SIZE 12
+
+void rtp_fec_init(rtp_fec_encoder_t *fec, uint8_t group_size, uint32_t ssrc) {
+    memset(fec, 0, sizeof(*fec));
+    if (group_size > RTP_FEC_MAX_GROUP) group_size = RTP_FEC_MAX_GROUP;
+    fec->group_size = group_size;
+    fec->ssrc = ssrc;
+}
+
+static int rtp_fec_flush(rtp_fec_encoder_t *fec, uint8_t *out, int out_size) {
+    int total = RTP_FIXED_HEADER_SIZE + RTP_FEC_HEADER_SIZE + RTP_FEC_LEVEL_HDR_SIZE + fec->prot_len;
+    if (total > out_size) {
+        fec->count = 0;
+        return 0;
+    }
+
+    // FEC 组不跨帧，FEC 包沿用所保护帧的媒体时间戳
+    uint32_t ts = fec->timestamp;
+
+    int i = 0;
+    out[i++] = 0x80;
+    out[i++] = RTP_FEC_PAYLOAD_TYPE;
+    out[i++] = (fec->seq >> 8) & 0xFF; out[i++] = fec->seq & 0xFF;
+    out[i++] = (ts >> 24) & 0xFF; out[i++] = (ts >> 16) & 0xFF;
+    out[i++] = (ts >> 8) & 0xFF;  out[i++] = ts & 0xFF;
+    out[i++] = (fec->ssrc >> 24) & 0xFF; out[i++] = (fec->ssrc >> 16) & 0xFF;
+    out[i++] = (fec->ssrc >> 8) & 0xFF;  out[i++] = fec->ssrc & 0xFF;
+
+    // FEC header: E=0 L=0 | P X CC recovery | M PT recovery | SN base | TS recovery | length recovery
+    out[i++] = fec->hdr_recovery[0] & 0x3F;
+    out[i++] = fec->hdr_recovery[1];
+    out[i++] = (fec->sn_base >> 8) & 0xFF; out[i++] = fec->sn_base & 0xFF;
+    memcpy(out + i, fec->hdr_recovery + 4, 4); i += 4;
+    out[i++] = (fec->len_recovery >> 8) & 0xFF; out[i++] = fec->len_recovery & 0xFF;
+
+    // ULP level 0 header: protection length | mask (MSB 对应 SN base)
+    uint16_t mask = (uint16_t)(0xFFFF << (16 - fec->count));
+    out[i++] = (fec->prot_len >> 8) & 0xFF; out[i++] = fec->prot_len & 0xFF;
+    out[i++] = (mask >> 8) & 0xFF; out[i++] = mask & 0xFF;
+
+    memcpy(out + i, fec->payload, fec->prot_len);
+    i += fec->prot_len;
+
+    fec->seq++;
+    fec->count = 0;
+    return i;
+}
+
+int rtp_fec_add(rtp_fec_encoder_t *fec, const uint8_t *pkt, int len, bool end_of_frame,
+                uint8_t *out, int out_size) {
+    if (fec->group_size == 0 || len < RTP_FIXED_HEADER_SIZE) return 0;
+
+    int payload_len = len - RTP_FIXED_HEADER_SIZE;
+    if (payload_len > RTP_FEC_MAX_PROTECT) return 0;
+
+    if (fec->count == 0) {
+        fec->timestamp = ((uint32_t)pkt[4] << 24) | ((uint32_t)pkt[5] << 16) |
+                         ((uint32_t)pkt[6] << 8) | pkt[7];
+        fec->sn_base = ((uint16_t)pkt[2] << 8) | pkt[3];
+        memcpy(fec->hdr_recovery, pkt, 8);
+        fec->len_recovery = (uint16_t)payload_len;
+        fec->prot_len = (uint16_t)payload_len;
+        memcpy(fec->payload, pkt + RTP_FIXED_HEADER_SIZE, payload_len);
+    } else {
+        for (int k = 0; k < 8; k++) fec->hdr_recovery[k] ^= pkt[k];
+        fec->len_recovery ^= (uint16_t)payload_len;
+        if (payload_len > fec->prot_len) {
+            // 较短的负载视为尾部补零，扩展部分直接拷贝即为 XOR 结果
+            memcpy(fec->payload + fec->prot_len, pkt + RTP_FIXED_HEADER_SIZE + fec->prot_len,
+                   payload_len - fec->prot_len);
+            for (int k = 0; k < fec->prot_len; k++) fec->payload[k] ^= pkt[RTP_FIXED_HEADER_SIZE + k];
+            fec->prot_len = (uint16_t)payload_len;
+        } else {
+            for (int k = 0; k < payload_len; k++) fec->payload[k] ^= pkt[RTP_FIXED_HEADER_SIZE + k];
+        }
+    }
+    fec->count++;
+
+    if (fec->count >= fec->group_size || end_of_frame) {
+        return rtp_fec_flush(fec, out, out_size);
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+// rtp_fec.h
+// RFC 5109 ULPFEC 编码 (单层 XOR 奇偶校验)，FEC 包作为独立 RTP 流发送
+#ifndef __RTP_FEC_H__
+#define __RTP_FEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTP_FEC_PAYLOAD_TYPE   127
+#define RTP_FEC_HEADER_SIZE    10      // RFC 5109 FEC header
+#define RTP_FEC_LEVEL_HDR_SIZE 4       // ULP level 0 header (L=0, 16 位掩码)
+#define RTP_FEC_MAX_GROUP      16      // 16 位掩码最多覆盖 16 个媒体包
+#define RTP_FEC_MAX_PROTECT    1500    // 最大保护长度 (媒体包去掉 RTP 固定头)
+
+typedef struct {
+    uint8_t group_size;         // 每 group_size 个媒体包生成 1 个 FEC 包
+    uint8_t count;              // 当前组已累积的媒体包数
+    uint16_t sn_base;           // 当前组首个媒体包序号
+    uint16_t seq;               // FEC 流自身序号
+    uint32_t ssrc;
+    uint32_t timestamp;         // 当前组所属帧的媒体时间戳
+    uint8_t hdr_recovery[8];    // 媒体包前 8 字节的 XOR (P/X/CC/M/PT/TS)
+    uint16_t len_recovery;      // 媒体包负载长度的 XOR
+    uint16_t prot_len;          // 组内最长负载
+    uint8_t payload[RTP_FEC_MAX_PROTECT];
+} rtp_fec_encoder_t;
+
+void rtp_fec_init(rtp_fec_encoder_t *fec, uint8_t group_size, uint32_t ssrc);
+
+/**
+ * @brief 累加一个已发出的媒体 RTP 包
+ *
+ * @param end_of_frame 帧最后一个包，强制结束当前组，FEC 不跨帧
+ * @param out  FEC 包输出缓冲区，至少 RTP_HEADER(12) + 14 + RTP_FEC_MAX_PROTECT
+ * @return 组完成时返回 FEC 包长度，否则 0
+ */
+int rtp_fec_add(rtp_fec_encoder_t *fec, const uint8_t *pkt, int len, bool end_of_frame,
+                uint8_t *out, int out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RTP_FEC_H__
@@ -0,0 +1,73 @@
+// rtp_history.c
+#include "rtp_history.h"
+#include <string.h>
+
+void rtp_history_init(rtp_history_t *h, size_t budget_bytes) {
+    memset(h, 0, sizeof(*h));
+    h->budget_bytes = budget_bytes;
+}
+
+// 淘汰最旧的一帧，并清掉仍指向它的槽
+static void rtp_history_evict_oldest(rtp_history_t *h) {
+    lcd_camera_frame_t *old = h->frames[h->frame_head];
+    h->frames[h->frame_head] = NULL;
+    h->used_bytes -= h->frame_bytes[h->frame_head];
+    h->frame_head = (h->frame_head + 1) % RTP_HISTORY_MAX_FRAMES;
+    h->frame_count--;
+
+    for (int i = 0; i < RTP_HISTORY_SLOTS; i++) {
+        if (h->slots[i].frame == old) {
+            h->slots[i].frame = NULL;
+        }
+    }
+    lcd_camera_frame_unref(old);
+}
+
+void rtp_history_begin_frame(rtp_history_t *h, lcd_camera_frame_t *frame) {
+    // 至少保留当前帧，即使单帧已超出预算
+    while (h->frame_count > 0 &&
+           (h->frame_count >= RTP_HISTORY_MAX_FRAMES || h->used_bytes + frame->len > h->budget_bytes)) {
+        rtp_history_evict_oldest(h);
+    }
+
+    uint8_t tail = (h->frame_head + h->frame_count) % RTP_HISTORY_MAX_FRAMES;
+    h->frames[tail] = lcd_camera_frame_ref(frame);
+    h->frame_bytes[tail] = frame->len;
+    h->frame_count++;
+    h->used_bytes += frame->len;
+}
+
+void rtp_history_end_frame(rtp_history_t *h, lcd_camera_frame_t *frame) {
+    if (h->frame_count == 0) return;
+    uint8_t tail = (h->frame_head + h->frame_count - 1) % RTP_HISTORY_MAX_FRAMES;
+    if (h->frames[tail] != frame) return;
+    h->used_bytes += frame->len - h->frame_bytes[tail];
+    h->frame_bytes[tail] = frame->len;
+
+    // 只淘汰更早的帧，当前帧保留
+    while (h->frame_count > 1 && h->used_bytes > h->budget_bytes) {
+        rtp_history_evict_oldest(h);
+    }
+}
+
+void rtp_history_put(rtp_history_t *h, uint16_t seq, const uint8_t *hdr,
+                     lcd_camera_frame_t *frame, uint32_t offset, uint16_t chunk) {
+    rtp_history_entry_t *e = &h->slots[seq & (RTP_HISTORY_SLOTS - 1)];
+    e->frame = frame;
+    e->seq = seq;
+    e->offset = offset;
+    e->chunk = chunk;
+    memcpy(e->hdr, hdr, RTP_HISTORY_HDR_SIZE);
+}
+
+const rtp_history_entry_t *rtp_history_get(const rtp_history_t *h, uint16_t seq) {
+    const rtp_history_entry_t *e = &h->slots[seq & (RTP_HISTORY_SLOTS - 1)];
+    if (e->frame == NULL || e->seq != seq) return NULL;
+    return e;
+}
+
+void rtp_history_clear(rtp_history_t *h) {
+    while (h->frame_count > 0) {
+        rtp_history_evict_oldest(h);
+    }
+}
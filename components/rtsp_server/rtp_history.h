@@ -0,0 +1,60 @@
+// rtp_history.h
+// 已发送 RTP 包历史环，按序号索引，供 RTCP NACK 选择性重传
+// 只保存包头与 (帧, 偏移, 长度)，负载直接引用编码帧缓冲区，不做拷贝
+#ifndef __RTP_HISTORY_H__
+#define __RTP_HISTORY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "lcd_camera.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTP_HISTORY_SLOTS      256     // 2 的幂，seq & (SLOTS - 1) 索引
+#define RTP_HISTORY_MAX_FRAMES 16      // 同时引用的帧数上限
+#define RTP_HISTORY_HDR_SIZE   20      // RTP(12) + JPEG(8) 包头
+
+typedef struct {
+    lcd_camera_frame_t *frame;         // NULL 表示空槽
+    uint32_t offset;                   // 负载在 frame->buf 中的偏移
+    uint16_t seq;
+    uint16_t chunk;                    // 负载长度
+    uint8_t hdr[RTP_HISTORY_HDR_SIZE];
+} rtp_history_entry_t;
+
+typedef struct {
+    rtp_history_entry_t slots[RTP_HISTORY_SLOTS];
+    lcd_camera_frame_t *frames[RTP_HISTORY_MAX_FRAMES];  // 按时间先后的 FIFO
+    size_t frame_bytes[RTP_HISTORY_MAX_FRAMES];          // 各帧计入预算的长度
+    uint8_t frame_head;
+    uint8_t frame_count;
+    size_t budget_bytes;               // 引用帧总字节上限
+    size_t used_bytes;
+} rtp_history_t;
+
+void rtp_history_init(rtp_history_t *h, size_t budget_bytes);
+
+// 开始记录新帧: 引用帧并按字节预算淘汰最旧的帧
+void rtp_history_begin_frame(rtp_history_t *h, lcd_camera_frame_t *frame);
+
+// 结束当前帧: 边编码边发送的帧在开始时长度未定，按最终长度重新计入预算
+void rtp_history_end_frame(rtp_history_t *h, lcd_camera_frame_t *frame);
+
+// 记录一个已发送包，frame 必须已通过 rtp_history_begin_frame 登记
+void rtp_history_put(rtp_history_t *h, uint16_t seq, const uint8_t *hdr,
+                     lcd_camera_frame_t *frame, uint32_t offset, uint16_t chunk);
+
+// 按序号查找，未命中(已淘汰或被覆盖)返回 NULL
+const rtp_history_entry_t *rtp_history_get(const rtp_history_t *h, uint16_t seq);
+
+// 释放所有帧引用
+void rtp_history_clear(rtp_history_t *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RTP_HISTORY_H__
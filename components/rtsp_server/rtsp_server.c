@@ -4,12 +4,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "lwip/sockets.h"
 #include "lwip/inet.h"
+#include "lwip/netif.h"
 #include "esp_timer.h"
+#include "esp_random.h"
+#include "rtp_fec.h"
+#include "rtp_history.h"
+#include "rtp_batch.h"
+#include "rtsp_stats.h"
 
 #define TAG "RTSP_SERVER"
 
@@ -18,18 +27,27 @@
 
 #define RTSP_PORT 554
 #define RTP_PAYLOAD_TYPE_MJPEG 26
+#define RTP_SSRC            0x12345678
+#define RTP_CLOCK_RATE      90000
 #define RTP_HEADER_SIZE     12
 #define JPEG_HEADER_SIZE    8
-#define MAX_PACKET_SIZE     1400
-#define RTP_MAX_PAYLOAD     (MAX_PACKET_SIZE - RTP_HEADER_SIZE - JPEG_HEADER_SIZE)
+#define RTP_PKT_HDR_SIZE    (RTP_HEADER_SIZE + JPEG_HEADER_SIZE)
+
+// RTP 包长按会话选择: UDP 取接口 MTU 减 IP/UDP 头并随丢包率收缩/恢复，
+// TCP interleaved 不受 MTU 限制，使用大块减少发送调用
+#define IP_UDP_HEADER_SIZE  28
+#define RTP_MIN_PACKET_SIZE (576 - IP_UDP_HEADER_SIZE)
+#define RTP_TCP_PACKET_SIZE 4096
+#define RTP_MAX_PACKET_SIZE RTP_TCP_PACKET_SIZE
+#define RTP_LOSS_SHRINK_Q8  13          // RR fraction lost > 5% (x/256) 时缩小包长
+#define RTP_LOSS_GROW_Q8    2           // 连续若干个 RR 丢包 < 1% 时逐步恢复
+#define RTP_GROW_AFTER_RR   5
 
 #define FRAME_RATE CONFIG_CAMERA_STREAM_FRAME_RATE
 #define FRAME_INTERVAL_US (1000000 / FRAME_RATE)
 
 // JPEG参数
 #define JPEG_QUALITY  0x3F      // 质量因子（0-255，建议0x3F-0x7F）
-#define DISPLAY_H_RES (320 / 8)
-#define DISPLAY_V_RES (240 / 8)
 
 #define RTP_PORT 5004
 #define RTCP_PORT 5005
@@ -39,28 +57,330 @@
 
 #define RTP_RETRY_DELAY_MS    6       // 每次失败后延迟 1ms
 #define RTP_RETRY_LIMIT       3       // 每个包最多重试 3 次
-#define RTP_FRAME_TIMEOUT_US  80000   // 单帧最长耗时 80ms，超过直接跳帧
-#define RTP_ENABLE_DROP_FRAME 1       // 启用超时丢帧策略
-
-// ✅ 在全局变量中新增客户端连接状态标志
-static bool rtsp_client_connected = false;
-static bool rtsp_streaming = false;
-static bool use_tcp_transport = false;
-static int rtsp_client_socket = -1;
+#define RTP_FRAME_TIMEOUT_US  80000   // 单帧发送预算 80ms，准入时预估超出则整帧跳过
+
+// 单播 RTP/RTCP socket: 首次 UDP SETUP 时打开并常驻，所有 UDP 会话共用，会话只携带目的地址
 static int udp_rtcp_sock = -1;  // RTCP socket
 static int udp_sock = -1;
-static struct sockaddr_in udp_client_addr = {0};
-static uint16_t client_rtp_port = 0;
 static uint32_t latest_client_ip = 0;
 
-// 帧统计
-static uint32_t frame_count = 0;
-static uint32_t packet_count = 0;
-static uint32_t error_count = 0;
-static uint64_t last_stat_time = 0;
+// RTSP 会话: SETUP 时分配随机 ID，任何 RTSP 请求/RTCP 包都刷新活跃时间，
+// 超过 RTSP_SESSION_TIMEOUT_S 无活动则回收
+#define RTSP_SESSION_TIMEOUT_S  CONFIG_RTSP_SESSION_TIMEOUT_S
+#define RTSP_SESSION_FMT        "%08X;timeout=%d"
+#define RTSP_SESSION_ARGS(c)    (unsigned int)(c)->session_id, RTSP_SESSION_TIMEOUT_S
+#define RTSP_POLL_MS            1000   // select 超时，用于检查会话超时
+
+// 单任务事件循环: select 同时等待监听 socket、所有控制连接与 RTCP socket，
+// 每个连接只占一个客户端结构，请求在其接收缓冲中拼齐后交给状态机处理
+#define RTSP_MAX_CLIENTS        CONFIG_RTSP_MAX_CLIENTS
+#define RTSP_RX_BUF_SIZE        1024
+#define RTSP_SEND_TIMEOUT_MS    500    // 控制连接发送超时，卡住的客户端不会阻塞事件循环
+
+// 分层 (simulcast): streamid=N 对应 LCD_CAMERA_TIER_N，每层有独立的序号空间、FEC 与重传历史;
+// 会话切换分层时，推流任务调整该目的地的序号偏移，客户端看到的序号保持连续
+#ifdef CONFIG_RTSP_SIMULCAST_ENABLE
+#define RTSP_TIERS              LCD_CAMERA_TIER_COUNT
+#else
+#define RTSP_TIERS              1
+#endif
+
+typedef struct {
+    int sock;                           // -1 表示空闲
+    uint32_t session_id;                // 0 表示尚未 SETUP
+    uint32_t last_active_ms;
+    struct sockaddr_in peer;
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    bool multicast;                     // 会话使用组播
+    bool mcast_playing;
+#endif
+    bool tcp;                           // SETUP 为 TCP interleaved
+    uint8_t tier;                       // SETUP 的 streamid，SET_PARAMETER 可切换
+    uint16_t rtp_port;                  // SETUP 的 client_port，0 表示未 SETUP 单播 UDP
+    uint16_t fec_port;                  // fec 轨道的 client_port
+    uint32_t skip;                      // 尚待丢弃的 interleaved 数据字节 (4 + 最多 65535)
+    uint16_t rx_len;
+    char rx[RTSP_RX_BUF_SIZE + 1];
+} rtsp_client_t;
+
+static rtsp_client_t rtsp_clients[RTSP_MAX_CLIENTS];
+
+// 单播目的地: 与 rtsp_clients 同下标，PLAY 时发布、TEARDOWN/断开时撤下;
+// 推流任务打包发送期间持有 rtp_dest_lock，撤下返回后即可安全关闭对应连接
+typedef struct {
+    uint32_t session_id;                // 0 表示空闲
+    int tcp_sock;                       // >= 0 时走 TCP interleaved，否则经共享 UDP socket
+    struct sockaddr_in rtp_addr;
+    uint16_t fec_port;                  // 0 表示未 SETUP fec 轨道
+    uint8_t tier;
+} rtp_dest_t;
+
+static rtp_dest_t rtp_dests[RTSP_MAX_CLIENTS];
+static SemaphoreHandle_t rtp_dest_lock = NULL;
+static volatile int rtp_dest_count = 0;
+static volatile uint8_t rtp_dest_tiers = 0;     // 有目的地订阅的分层位图，决定采集端编码哪些分层
+
+// RTCP 在事件循环中接收，经队列交给推流任务处理 (重传历史与统计只由推流任务访问)
+#define RTCP_MSG_MAX        192
+#define RTCP_QUEUE_LEN      8
+
+typedef struct {
+    struct sockaddr_in from;
+    uint16_t len;
+    uint8_t data[RTCP_MSG_MAX];
+} rtcp_msg_t;
+
+static QueueHandle_t rtcp_queue = NULL;
+
+// RTP 时间戳: 由帧采集时刻换算 (90kHz)，rtp_ts_base 为随机起点
+static uint32_t rtp_ts_base = 0;
+
+#ifdef CONFIG_RTSP_FEC_ENABLE
+#define RTP_FEC_GROUP_SIZE  CONFIG_RTSP_FEC_GROUP_SIZE
+
+// ULPFEC: 每帧按 RTP_FEC_GROUP_SIZE 个媒体包一组生成 XOR 校验包，走独立的 "fec" 轨道
+static rtp_fec_encoder_t fec_encoder[RTSP_TIERS];
+#endif
+
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+#define RTP_MCAST_ADDR  CONFIG_RTSP_MULTICAST_ADDR
+#define RTP_MCAST_PORT  CONFIG_RTSP_MULTICAST_PORT
+#define RTP_MCAST_TTL   CONFIG_RTSP_MULTICAST_TTL
+
+// 组播发送端: 所有组播观众共享同一路 RTP/RTCP
+typedef struct {
+    int rtp_sock;
+    int rtcp_sock;
+    struct sockaddr_in rtp_addr;
+    struct sockaddr_in rtcp_addr;
+    int viewers;                // 处于 PLAY 状态的组播会话数
+    uint32_t sent_packets;      // RTCP SR sender's packet count
+    uint32_t sent_octets;       // RTCP SR sender's octet count
+} rtp_mcast_t;
+
+static rtp_mcast_t rtp_mcast = { .rtp_sock = -1, .rtcp_sock = -1 };
+#endif
+
+#define RTCP_PT_RR          201
+
+#ifdef CONFIG_RTSP_NACK_ENABLE
+// 单播 UDP 已发送包历史，收到 RTCP Generic NACK (RFC 4585) 时按序号重传
+#define RTCP_PT_RTPFB       205
+#define RTCP_FMT_NACK       1
+static rtp_history_t rtp_history[RTSP_TIERS];
+#endif
+
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+static rtp_batch_t ucast_batch;         // 单播 RTP/FEC，与 udp_sock 共用 RTP_PORT
+static bool ucast_batch_ok = false;
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+static rtp_batch_t mcast_batch;
+static bool mcast_batch_ok = false;
+#endif
+#endif
+
+// 统计: 推流任务按帧累积增量，帧结束时提交给 rtsp_stats (单写者)
+static rtsp_stats_counters_t stat_src;      // 源帧计数，只进全局
+static rtsp_stats_counters_t stat_ubatch;   // 单播批量提交同时服务多个会话，调用次数只进全局
+
+// 推流任务私有的每目的地状态，与 rtp_dests 同下标
+typedef struct {
+    uint32_t session_id;                // 与 rtp_dests 不同时重开统计槽与 SR 计数
+    int stat_slot;
+    rtsp_stats_counters_t stat;         // 本帧增量
+    uint32_t sent_packets;              // RTCP SR sender's packet count
+    uint32_t sent_octets;               // RTCP SR sender's octet count
+    bool failed;                        // 本帧已放弃
+    uint8_t tier;                       // 已生效的分层，与 rtp_dests 不同时在帧边界切换
+    uint16_t seq_offset;                // 客户端序号 = 分层序号 + 偏移
+    uint16_t fec_seq_offset;
+    bool rtx_guard;                     // 切换后不久: 切换前的序号不在本分层历史中，不能重传
+    uint16_t rtx_base;                  // 切换时的分层序号
+    uint16_t pkt_size;                  // 按本会话 RR 调整的 UDP 包长
+    uint8_t clean_rr;                   // 连续低丢包 RR 计数
+} rtp_dest_state_t;
+
+static uint16_t tier_seq[RTSP_TIERS];   // 各分层下一个 RTP 序号
+
+static rtp_dest_state_t rtp_dest_state[RTSP_MAX_CLIENTS];
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+static rtsp_stats_counters_t stat_mcast;
+static int stat_mcast_slot = -1;
+#endif
+static rtsp_stats_counters_t stat_log_prev; // 每秒日志取全局计数的差值
+
+// 帧级准入: 首包前决定整帧发送或整帧跳过，发送开始后不再中途放弃，保证客户端总能收到 marker
+static uint32_t pkt_send_us_avg = 0;    // 单包平均发送耗时 (EWMA 1/8)
+static uint32_t send_backlog_us = 0;    // 上一帧发送超出帧间隔的部分，反映协议栈/WiFi 队列积压
+
+static uint16_t stream_pkt_size[RTSP_TIERS];    // 各分层最近一帧的包长 (RTP 头 + JPEG 头 + 负载)，供日志
+
+// DESCRIBE 的 SDP 由实时流参数生成并缓存，参数不变时直接复用
+#define RTSP_SDP_BITRATE_STEP_KBPS  64      // 码率量化步长，避免每次 DESCRIBE 都重建
+
+typedef struct {
+    uint32_t local_ip;
+    uint8_t tier;
+    uint16_t width;
+    uint16_t height;
+    uint16_t fps;
+    uint16_t bitrate_kbps;
+} rtsp_sdp_key_t;
+
+typedef struct {
+    rtsp_sdp_key_t key;
+    bool valid;
+    char text[768];
+} rtsp_sdp_cache_t;
+
+static rtsp_sdp_cache_t sdp_cache[RTSP_TIERS + 1];  // [tier] 单播, [RTSP_TIERS] 组播 (只有全分辨率层)
+static uint32_t sdp_version = 0;
+
+// 各分层流参数: 分辨率跟随最近一帧，码率为每秒统计的平滑值 (发送任务更新)
+static uint16_t stream_width[RTSP_TIERS];
+static uint16_t stream_height[RTSP_TIERS];
+static uint32_t stream_bitrate_kbps[RTSP_TIERS];
+static uint32_t stream_tier_bytes[RTSP_TIERS];  // 本秒各分层编码字节
+
+// esp_timer 时基(us) -> RTP 90kHz 时间戳，32 位自然回绕
+static inline uint32_t rtp_ts_from_us(int64_t us) {
+    return rtp_ts_base + (uint32_t)((uint64_t)us * (RTP_CLOCK_RATE / 1000) / 1000);
+}
+
+static inline void rtp_put_seq(uint8_t *pkt, uint16_t seq) {
+    pkt[2] = (seq >> 8) & 0xFF;
+    pkt[3] = seq & 0xFF;
+}
+
+static inline uint16_t rtp_get_seq(const uint8_t *pkt) {
+    return ((uint16_t)pkt[2] << 8) | pkt[3];
+}
+
+static inline uint32_t rtsp_now_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static inline void rtsp_client_touch(rtsp_client_t *c) {
+    c->last_active_ms = rtsp_now_ms();
+}
+
+static inline bool rtsp_client_expired(const rtsp_client_t *c, uint32_t now_ms) {
+    return now_ms - c->last_active_ms > RTSP_SESSION_TIMEOUT_S * 1000u;
+}
+
+// 出接口 MTU 允许的最大 UDP RTP 包长 (SoftAP 只有一个接口，取默认 netif)
+static uint16_t rtp_udp_packet_size_max(void) {
+    struct netif *nif = netif_default;
+    uint16_t mtu = (nif && nif->mtu) ? nif->mtu : 1500;
+    uint16_t size = mtu - IP_UDP_HEADER_SIZE;
+    return size > RTP_MAX_PACKET_SIZE ? RTP_MAX_PACKET_SIZE : size;
+}
+
+// 根据会话自己的 RTCP RR fraction lost 调整其 UDP 包长: 丢包高时减半 (单包越小丢失代价越低)，
+// 长期无丢包再按 1/4 逐步回升到 MTU 上限; 只在推流任务中调用
+static void rtp_adapt_packet_size(int d, uint8_t fraction_lost) {
+    rtp_dest_state_t *ds = &rtp_dest_state[d];
+    uint16_t size = ds->pkt_size;
+    if (fraction_lost > RTP_LOSS_SHRINK_Q8) {
+        size /= 2;
+        ds->clean_rr = 0;
+    } else if (fraction_lost < RTP_LOSS_GROW_Q8 && ++ds->clean_rr >= RTP_GROW_AFTER_RR) {
+        size += size / 4;
+        ds->clean_rr = 0;
+    }
+
+    uint16_t max = rtp_udp_packet_size_max();
+    if (size < RTP_MIN_PACKET_SIZE) size = RTP_MIN_PACKET_SIZE;
+    if (size > max) size = max;
+    if (size != ds->pkt_size) {
+        ESP_LOGI(TAG, "Session %08X RTP packet size %u -> %u (fraction lost %u/256)",
+                 (unsigned int)ds->session_id, ds->pkt_size, size, fraction_lost);
+        ds->pkt_size = size;
+    }
+}
+
+uint8_t rtsp_stream_tiers_get(void) {
+    uint8_t tiers = rtp_dest_tiers;
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    if (rtp_mcast.viewers > 0) tiers |= LCD_CAMERA_TIER_BIT(LCD_CAMERA_TIER_FULL);
+#endif
+    return tiers;
+}
 
 bool rtsp_stream_flag_get(void) {
-    return rtsp_streaming && rtsp_client_connected;
+    return rtsp_stream_tiers_get() != 0;
+}
+
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+// 打开组播 RTP/RTCP 发送 socket，只在首次组播 SETUP 时创建，之后常驻
+static bool rtp_mcast_open(void) {
+    if (rtp_mcast.rtp_sock >= 0) return true;
+
+    rtp_mcast.rtp_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    rtp_mcast.rtcp_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (rtp_mcast.rtp_sock < 0 || rtp_mcast.rtcp_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create multicast socket, errno=%d", errno);
+        goto fail;
+    }
+
+    uint8_t ttl = RTP_MCAST_TTL;
+    if (setsockopt(rtp_mcast.rtp_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+        setsockopt(rtp_mcast.rtcp_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+        ESP_LOGE(TAG, "Failed to set multicast TTL, errno=%d", errno);
+        goto fail;
+    }
+
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = 50000};
+    setsockopt(rtp_mcast.rtp_sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int send_buf_size = UDP_SEND_BUF_SIZE;
+    setsockopt(rtp_mcast.rtp_sock, SOL_SOCKET, SO_SNDBUF, &send_buf_size, sizeof(send_buf_size));
+
+    rtp_mcast.rtp_addr.sin_family = AF_INET;
+    rtp_mcast.rtp_addr.sin_port = htons(RTP_MCAST_PORT);
+    rtp_mcast.rtp_addr.sin_addr.s_addr = inet_addr(RTP_MCAST_ADDR);
+    rtp_mcast.rtcp_addr = rtp_mcast.rtp_addr;
+    rtp_mcast.rtcp_addr.sin_port = htons(RTP_MCAST_PORT + 1);
+
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+    mcast_batch_ok = rtp_batch_open(&mcast_batch, 0, RTP_MCAST_TTL, CONFIG_RTSP_UDP_BATCH_PKTS) == 0;
+    if (!mcast_batch_ok) {
+        ESP_LOGW(TAG, "Multicast batch pcb unavailable (errno=%d), using sendto", mcast_batch.last_err);
+    }
+#endif
+
+    ESP_LOGI(TAG, "Multicast RTP %s:%d ttl=%d", RTP_MCAST_ADDR, RTP_MCAST_PORT, RTP_MCAST_TTL);
+    return true;
+
+fail:
+    if (rtp_mcast.rtp_sock >= 0) close(rtp_mcast.rtp_sock);
+    if (rtp_mcast.rtcp_sock >= 0) close(rtp_mcast.rtcp_sock);
+    rtp_mcast.rtp_sock = -1;
+    rtp_mcast.rtcp_sock = -1;
+    return false;
+}
+
+// 会话离开组播 (TEARDOWN 或断开)
+static void rtp_mcast_leave(rtsp_client_t *c) {
+    if (c->mcast_playing && rtp_mcast.viewers > 0) {
+        rtp_mcast.viewers--;
+        ESP_LOGI(TAG, "Multicast viewer left, viewers=%d", rtp_mcast.viewers);
+    }
+    c->mcast_playing = false;
+}
+#endif
+
+// 请求行 URL 或 Transport 头中带 multicast 即视为组播会话
+static bool rtsp_request_wants_multicast(const char *req) {
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    const char *eol = strstr(req, "\r\n");
+    const char *p = strstr(req, "multicast");
+    if (p && (!eol || p < eol)) return true;
+    const char *transport = strstr(req, "Transport:");
+    return transport && strstr(transport, "multicast");
+#else
+    (void)req;
+    return false;
+#endif
 }
 
 static void send_rtsp_response(int sock, int cseq, const char *response) {
@@ -69,7 +389,7 @@ static void send_rtsp_response(int sock, int cseq, const char *response) {
 }
 
 // 解析 client_port=xxxx-xxxx 中的第一个端口号
-static uint16_t parse_client_rtp_port_and_ip(const char *buf, uint32_t *ip_out) {
+static uint16_t parse_client_rtp_port(const char *buf) {
     const char *p = strstr(buf, "client_port=");
     if (!p) return 0;
 
@@ -77,15 +397,690 @@ static uint16_t parse_client_rtp_port_and_ip(const char *buf, uint32_t *ip_out)
     sscanf(p, "client_port=%d", &port1);
 
     if (port1 <= 0 || port1 > 65535) return 0;
-    if (ip_out) *ip_out = latest_client_ip;  // 暂时使用 TCP 连接 IP
     return (uint16_t)port1;
 }
 
+// SETUP 的 URL 指向 FEC 轨道 (a=control:fec)
+static bool rtsp_request_is_fec_track(const char *req) {
+    const char *eol = strstr(req, "\r\n");
+    const char *p = strstr(req, "/fec");
+    return p && (!eol || p < eol);
+}
+
+// 请求行 URL 中的 streamid=N 选择分层，缺省或超出范围时为全分辨率
+static uint8_t rtsp_request_tier(const char *req) {
+    const char *eol = strstr(req, "\r\n");
+    const char *p = strstr(req, "streamid=");
+    if (!p || (eol && p > eol)) return LCD_CAMERA_TIER_FULL;
+    int tier = atoi(p + 9);
+    return (tier > 0 && tier < RTSP_TIERS) ? (uint8_t)tier : LCD_CAMERA_TIER_FULL;
+}
+
+// 分层的编码分辨率: 推流中取最近一帧，否则按采集分辨率推算
+static void rtsp_tier_resolution(uint8_t tier, uint16_t *width, uint16_t *height) {
+    *width = stream_width[tier];
+    *height = stream_height[tier];
+    if (*width == 0 || *height == 0) {
+        lcd_camera_get_resolution(width, height);
+        if (tier == LCD_CAMERA_TIER_QUARTER) {
+            *width /= 2;
+            *height /= 2;
+        }
+    }
+}
+
+// 采集当前 SDP 参数: 控制连接的本地地址、分辨率、帧率与量化后的码率
+static void rtsp_sdp_key_get(rtsp_sdp_key_t *key, int sock, uint8_t tier) {
+    memset(key, 0, sizeof(*key));
+
+    struct sockaddr_in local;
+    socklen_t local_len = sizeof(local);
+    if (getsockname(sock, (struct sockaddr *)&local, &local_len) == 0) {
+        key->local_ip = local.sin_addr.s_addr;
+    }
+
+    uint16_t width, height;
+    rtsp_tier_resolution(tier, &width, &height);
+
+    uint32_t kbps = stream_bitrate_kbps[tier];
+    if (kbps == 0) {
+        // 尚未推流，按约 6 像素/字节的 JPEG 估算
+        kbps = (uint32_t)width * height / 6 * FRAME_RATE * 8 / 1000;
+    }
+    kbps += kbps / 20;  // RTP/UDP/IP 包头约 5%
+    kbps = (kbps + RTSP_SDP_BITRATE_STEP_KBPS - 1) / RTSP_SDP_BITRATE_STEP_KBPS * RTSP_SDP_BITRATE_STEP_KBPS;
+
+    key->tier = tier;
+    key->width = width;
+    key->height = height;
+    key->fps = FRAME_RATE;
+    key->bitrate_kbps = (uint16_t)(kbps > 0xFFFF ? 0xFFFF : kbps);
+}
+
+// 生成 DESCRIBE 的 SDP，multicast 时 m=/c= 给出组播地址端口
+static int rtsp_build_sdp(char *sdp, size_t size, bool multicast, const rtsp_sdp_key_t *key) {
+    char local_ip[16];
+    inet_ntoa_r(*(struct in_addr *)&key->local_ip, local_ip, sizeof(local_ip));
+
+    // 会话信息列出所有分层，客户端按 streamid 重新 DESCRIBE/SETUP 选择
+    char info[96] = "";
+#if RTSP_TIERS > 1
+    int info_len = snprintf(info, sizeof(info), "i=Streams:");
+    for (uint8_t t = 0; t < RTSP_TIERS && info_len < (int)sizeof(info); t++) {
+        uint16_t w, h;
+        rtsp_tier_resolution(t, &w, &h);
+        info_len += snprintf(info + info_len, sizeof(info) - info_len, "%s streamid=%u %ux%u",
+                             t ? "," : "", t, w, h);
+    }
+    if (info_len < (int)sizeof(info) - 2) strcat(info, "\r\n");
+#endif
+
+    char conn[40];
+    int port = 0;
+    snprintf(conn, sizeof(conn), "IN IP4 %s", local_ip);
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    if (multicast) {
+        snprintf(conn, sizeof(conn), "IN IP4 %s/%d", RTP_MCAST_ADDR, RTP_MCAST_TTL);
+        port = RTP_MCAST_PORT;
+    }
+#endif
+
+    int n = snprintf(sdp, size,
+                     "v=0\r\n"
+                     "o=- %u %u IN IP4 %s\r\n"
+                     "s=%s\r\n"
+                     "%s"
+                     "c=%s\r\n"
+                     "t=0 0\r\n"
+                     "a=range:npt=0-\r\n"
+#ifdef CONFIG_RTSP_FEC_ENABLE
+                     "a=group:FEC 0 1\r\n"
+#endif
+                     "m=video %d RTP/AVP 26\r\n"
+                     "b=AS:%u\r\n"
+                     "a=control:streamid=%u\r\n"
+                     "a=rtpmap:26 JPEG/90000\r\n"
+                     "a=framerate:%u\r\n"
+                     "a=framesize:26 %u-%u\r\n"
+                     "a=x-dimensions:%u,%u\r\n"
+#ifdef CONFIG_RTSP_NACK_ENABLE
+                     "a=rtcp-fb:26 nack\r\n"
+#endif
+                     ,
+                     (unsigned int)RTP_SSRC, (unsigned int)sdp_version, local_ip,
+                     multicast ? "ESP32-CAM Multicast Stream" : "ESP32-CAM Stream",
+                     info, conn, port, key->bitrate_kbps, key->tier, key->fps,
+                     key->width, key->height, key->width, key->height);
+#ifdef CONFIG_RTSP_FEC_ENABLE
+    // FEC 轨道: RFC 5109 独立流，fmtp 中给出保护比例 1/group-size
+    if (n > 0 && (size_t)n < size) {
+        n += snprintf(sdp + n, size - n,
+                      "a=mid:0\r\n"
+                      "m=video %d RTP/AVP %d\r\n"
+                      "b=AS:%u\r\n"
+                      "a=rtpmap:%d ulpfec/90000\r\n"
+                      "a=fmtp:%d group-size=%d\r\n"
+                      "a=control:fec\r\n"
+                      "a=mid:1\r\n",
+                      port ? port + 2 : 0, RTP_FEC_PAYLOAD_TYPE,
+                      (unsigned int)(key->bitrate_kbps / RTP_FEC_GROUP_SIZE),
+                      RTP_FEC_PAYLOAD_TYPE, RTP_FEC_PAYLOAD_TYPE, RTP_FEC_GROUP_SIZE);
+    }
+#endif
+    return n;
+}
+
+// 取缓存的 SDP，参数变化时才重建; 组播固定为全分辨率层
+static const char *rtsp_get_sdp(bool multicast, uint8_t tier, int sock) {
+    if (multicast) tier = LCD_CAMERA_TIER_FULL;
+    rtsp_sdp_cache_t *cache = &sdp_cache[multicast ? RTSP_TIERS : tier];
+    rtsp_sdp_key_t key;
+    rtsp_sdp_key_get(&key, sock, tier);
+
+    if (!cache->valid || memcmp(&key, &cache->key, sizeof(key)) != 0) {
+        sdp_version++;
+        rtsp_build_sdp(cache->text, sizeof(cache->text), multicast, &key);
+        cache->key = key;
+        cache->valid = true;
+        ESP_LOGI(TAG, "SDP rebuilt (v%u): streamid=%u %ux%u@%u, %u kbps",
+                 (unsigned int)sdp_version, key.tier, key.width, key.height, key.fps, key.bitrate_kbps);
+    }
+    return cache->text;
+}
+
+// 校验请求的 Session 头，不匹配时回复 454 并返回 false
+static bool rtsp_check_session(rtsp_client_t *c, int cseq, const char *req) {
+    const char *p = strstr(req, "Session:");
+    if (c->session_id == 0 && p == NULL) return true;
+    if (p && c->session_id != 0 && strtoul(p + 8, NULL, 16) == c->session_id) return true;
+
+    char err[128];
+    snprintf(err, sizeof(err),
+            "RTSP/1.0 454 Session Not Found\r\n"
+            "CSeq: %d\r\n\r\n", cseq);
+    send_rtsp_response(c->sock, cseq, err);
+    return false;
+}
+
+// 打开共享的单播 RTP/RTCP socket，只在首次 UDP SETUP 时创建，之后常驻
+static bool rtp_udp_open(void) {
+    if (udp_sock >= 0) return true;
+
+    udp_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    udp_rtcp_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp_sock < 0 || udp_rtcp_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create RTP/RTCP socket, errno=%d", errno);
+        goto fail;
+    }
+
+    // ✅ 设置 UDP 发送超时（防止 sendto 永久阻塞）
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = 50000};
+    setsockopt(udp_sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // ✅ 设置发送缓冲区大小
+    int send_buf_size = UDP_SEND_BUF_SIZE;
+    setsockopt(udp_sock, SOL_SOCKET, SO_SNDBUF, &send_buf_size, sizeof(send_buf_size));
+
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+    // 批量发送的 udp_pcb 同样绑定 RTP_PORT，两者都需 SO_REUSEADDR
+    int reuse = 1;
+    setsockopt(udp_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
+
+    struct sockaddr_in local_rtp_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(RTP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct sockaddr_in local_rtcp_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(RTCP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    // 绑定RTP端口
+    if (bind(udp_sock, (struct sockaddr *)&local_rtp_addr, sizeof(local_rtp_addr)) < 0) {
+        ESP_LOGE(TAG, "RTP bind failed on port %d, errno=%d", RTP_PORT, errno);
+        goto fail;
+    }
+
+    // 绑定RTCP端口
+    if (bind(udp_rtcp_sock, (struct sockaddr *)&local_rtcp_addr, sizeof(local_rtcp_addr)) < 0) {
+        ESP_LOGE(TAG, "RTCP bind failed on port %d, errno=%d", RTCP_PORT, errno);
+        goto fail;
+    }
+
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+    ucast_batch_ok = rtp_batch_open(&ucast_batch, RTP_PORT, 0, CONFIG_RTSP_UDP_BATCH_PKTS) == 0;
+    if (!ucast_batch_ok) {
+        ESP_LOGW(TAG, "RTP batch pcb unavailable (errno=%d), using sendto", ucast_batch.last_err);
+    }
+#endif
+
+    ESP_LOGI(TAG, "Unicast RTP/RTCP sockets on ports %d-%d", RTP_PORT, RTCP_PORT);
+    return true;
+
+fail:
+    if (udp_sock >= 0) close(udp_sock);
+    if (udp_rtcp_sock >= 0) close(udp_rtcp_sock);
+    udp_sock = -1;
+    udp_rtcp_sock = -1;
+    return false;
+}
+
+// 重新统计订阅的分层，调用方持有 rtp_dest_lock
+static void rtp_dest_tiers_update(void) {
+    uint8_t tiers = 0;
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        if (rtp_dests[i].session_id != 0) tiers |= LCD_CAMERA_TIER_BIT(rtp_dests[i].tier);
+    }
+    rtp_dest_tiers = tiers;
+}
+
+// PLAY: 发布会话的单播目的地，推流任务从下一帧开始发送
+static void rtp_dest_publish(rtsp_client_t *c) {
+    rtp_dest_t dest = {
+        .session_id = c->session_id,
+        .tcp_sock = c->tcp ? c->sock : -1,
+        .rtp_addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(c->rtp_port),
+            .sin_addr = c->peer.sin_addr,
+        },
+        .fec_port = c->fec_port,
+        .tier = c->tier,
+    };
+
+    xSemaphoreTake(rtp_dest_lock, portMAX_DELAY);
+    rtp_dest_t *slot = &rtp_dests[c - rtsp_clients];
+    if (slot->session_id == 0) rtp_dest_count++;
+    *slot = dest;
+    rtp_dest_tiers_update();
+    xSemaphoreGive(rtp_dest_lock);
+}
+
+// SET_PARAMETER 切换分层: 已发布的目的地从下一帧起改发新分层
+static void rtp_dest_set_tier(rtsp_client_t *c) {
+    rtp_dest_t *slot = &rtp_dests[c - rtsp_clients];
+    if (slot->session_id == 0) return;
+    xSemaphoreTake(rtp_dest_lock, portMAX_DELAY);
+    slot->tier = c->tier;
+    rtp_dest_tiers_update();
+    xSemaphoreGive(rtp_dest_lock);
+}
+
+// 撤下会话的单播目的地，返回后推流任务不再使用其地址或连接
+static void rtp_dest_withdraw(rtsp_client_t *c) {
+    rtp_dest_t *slot = &rtp_dests[c - rtsp_clients];
+    if (slot->session_id == 0) return;
+    xSemaphoreTake(rtp_dest_lock, portMAX_DELAY);
+    memset(slot, 0, sizeof(*slot));
+    slot->tcp_sock = -1;
+    rtp_dest_count--;
+    rtp_dest_tiers_update();
+    xSemaphoreGive(rtp_dest_lock);
+}
+
+// 处理一个完整的 RTSP 请求，返回 false 时关闭连接
+static bool rtsp_handle_request(rtsp_client_t *c, const char *buf, int len) {
+    ESP_LOGI(TAG, "RTSP request:\n%.*s", len, buf);
+
+    int cseq = 0;
+    const char *cseq_ptr = strstr(buf, "CSeq:");
+    if (cseq_ptr) {
+        cseq = atoi(cseq_ptr + 5);
+    }
+
+    if (strstr(buf, "OPTIONS")) {
+        char resp[256];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 200 OK\r\n"
+                 "CSeq: %d\r\n"
+                 "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n\r\n",
+                 cseq);
+        send_rtsp_response(c->sock, cseq, resp);
+
+    } else if (strstr(buf, "DESCRIBE")) {
+        // 组播 SDP 直接给出组地址/端口，客户端也可不经 SETUP 直接加入
+        const char *sdp = rtsp_get_sdp(rtsp_request_wants_multicast(buf), rtsp_request_tier(buf), c->sock);
+
+        char resp[1024];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 200 OK\r\n"
+                 "CSeq: %d\r\n"
+                 "Content-Type: application/sdp\r\n"
+                 "Content-Length: %d\r\n\r\n%s",
+                 cseq, (int)strlen(sdp), sdp);
+        send_rtsp_response(c->sock, cseq, resp);
+
+    } else if (strstr(buf, "SETUP")) {
+        if (!rtsp_check_session(c, cseq, buf)) return true;
+        while (c->session_id == 0) {
+            c->session_id = esp_random();
+        }
+        if (rtsp_request_is_fec_track(buf)) {
+#ifdef CONFIG_RTSP_FEC_ENABLE
+            char resp[256];
+            uint16_t fec_port = 0;
+            if (rtsp_request_wants_multicast(buf)) {
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+                snprintf(resp, sizeof(resp),
+                        "RTSP/1.0 200 OK\r\n"
+                        "CSeq: %d\r\n"
+                        "Transport: RTP/AVP;multicast;destination=%s;port=%d-%d;ttl=%d\r\n"
+                        "Session: " RTSP_SESSION_FMT "\r\n\r\n",
+                        cseq, RTP_MCAST_ADDR, RTP_MCAST_PORT + 2, RTP_MCAST_PORT + 3, RTP_MCAST_TTL, RTSP_SESSION_ARGS(c));
+#endif
+            } else if (!strstr(buf, "RTP/AVP/TCP") &&
+                       (fec_port = parse_client_rtp_port(buf)) != 0) {
+                c->fec_port = fec_port;
+                snprintf(resp, sizeof(resp),
+                        "RTSP/1.0 200 OK\r\n"
+                        "CSeq: %d\r\n"
+                        "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\n"
+                        "Session: " RTSP_SESSION_FMT "\r\n\r\n",
+                        cseq, fec_port, fec_port + 1, RTP_PORT, RTCP_PORT, RTSP_SESSION_ARGS(c));
+                ESP_LOGI(TAG, "FEC stream to client port %d, group size %d",
+                         fec_port, RTP_FEC_GROUP_SIZE);
+            } else {
+                // TCP 本身可靠，FEC 仅支持 UDP
+                snprintf(resp, sizeof(resp),
+                        "RTSP/1.0 461 Unsupported Transport\r\n"
+                        "CSeq: %d\r\n\r\n", cseq);
+            }
+#else
+            char resp[128];
+            snprintf(resp, sizeof(resp),
+                    "RTSP/1.0 404 Not Found\r\n"
+                    "CSeq: %d\r\n\r\n", cseq);
+#endif
+            send_rtsp_response(c->sock, cseq, resp);
+        } else if (rtsp_request_wants_multicast(buf)) {
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+            if (!rtp_mcast_open()) {
+                char err[128];
+                snprintf(err, sizeof(err),
+                        "RTSP/1.0 500 Internal Server Error\r\n"
+                        "CSeq: %d\r\n\r\n", cseq);
+                send_rtsp_response(c->sock, cseq, err);
+                return true;
+            }
+            c->multicast = true;
+            c->tier = LCD_CAMERA_TIER_FULL;
+            ESP_LOGI(TAG, "Using multicast transport for RTP");
+
+            char resp[256];
+            snprintf(resp, sizeof(resp),
+                    "RTSP/1.0 200 OK\r\n"
+                    "CSeq: %d\r\n"
+                    "Transport: RTP/AVP;multicast;destination=%s;port=%d-%d;ttl=%d\r\n"
+                    "Session: " RTSP_SESSION_FMT "\r\n\r\n",
+                    cseq, RTP_MCAST_ADDR, RTP_MCAST_PORT, RTP_MCAST_PORT + 1, RTP_MCAST_TTL, RTSP_SESSION_ARGS(c));
+            send_rtsp_response(c->sock, cseq, resp);
+#endif
+        } else if (strstr(buf, "RTP/AVP/TCP")) {
+#ifndef TCP_STREAM_ENABLE
+            ESP_LOGW(TAG, "TCP transport requested but disabled by server");
+            char err[128];
+            snprintf(err, sizeof(err),
+                    "RTSP/1.0 461 Unsupported Transport\r\n"
+                    "CSeq: %d\r\n\r\n", cseq);
+            send_rtsp_response(c->sock, cseq, err);
+            return true;  // 不支持TCP，继续等待客户端其他请求
+#endif
+            c->tcp = true;
+            c->rtp_port = 0;
+            c->tier = rtsp_request_tier(buf);
+            ESP_LOGI(TAG, "Using TCP transport for RTP, streamid=%u", c->tier);
+
+            char resp[256];
+            snprintf(resp, sizeof(resp),
+                    "RTSP/1.0 200 OK\r\n"
+                    "CSeq: %d\r\n"
+                    "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
+                    "Session: " RTSP_SESSION_FMT "\r\n\r\n",
+                    cseq, RTSP_SESSION_ARGS(c));
+            send_rtsp_response(c->sock, cseq, resp);
+
+        } else if (strstr(buf, "RTP/AVP")) {
+            uint16_t rtp_port = parse_client_rtp_port(buf);
+            if (rtp_port == 0) {
+                ESP_LOGE(TAG, "Failed to parse client RTP port");
+                char err[128];
+                snprintf(err, sizeof(err),
+                        "RTSP/1.0 400 Bad Request\r\n"
+                        "CSeq: %d\r\n\r\n", cseq);
+                send_rtsp_response(c->sock, cseq, err);
+                return true;
+            }
+            if (!rtp_udp_open()) {
+                char err[128];
+                snprintf(err, sizeof(err),
+                        "RTSP/1.0 500 Internal Server Error\r\n"
+                        "CSeq: %d\r\n\r\n", cseq);
+                send_rtsp_response(c->sock, cseq, err);
+                return true;
+            }
+
+            c->tcp = false;
+            c->rtp_port = rtp_port;
+            c->tier = rtsp_request_tier(buf);
+            ESP_LOGI(TAG, "UDP client IP: %s, RTP port: %d, RTCP port: %d, streamid=%u",
+                    inet_ntoa(c->peer.sin_addr), rtp_port, rtp_port + 1, c->tier);
+
+            char resp[256];
+            snprintf(resp, sizeof(resp),
+                    "RTSP/1.0 200 OK\r\n"
+                    "CSeq: %d\r\n"
+                    "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\n"
+                    "Session: " RTSP_SESSION_FMT "\r\n\r\n",
+                    cseq, rtp_port, rtp_port + 1, RTP_PORT, RTCP_PORT, RTSP_SESSION_ARGS(c));
+            send_rtsp_response(c->sock, cseq, resp);
+        } else {
+            char err[128];
+            snprintf(err, sizeof(err),
+                    "RTSP/1.0 461 Unsupported Transport\r\n"
+                    "CSeq: %d\r\n\r\n", cseq);
+            send_rtsp_response(c->sock, cseq, err);
+        }
+    } else if (strstr(buf, "SET_PARAMETER")) {
+        // 正文 "streamid: N" 切换分层，空正文视为保活
+        if (!rtsp_check_session(c, cseq, buf)) return true;
+        const char *body = strstr(buf, "\r\n\r\n") + 4;
+        const char *p = strstr(body, "streamid");
+        const char *status = "200 OK";
+        if (p) {
+            p += 8;
+            while (*p == ' ' || *p == ':' || *p == '=') p++;
+            int tier = atoi(p);
+            bool fixed = c->session_id == 0;
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+            fixed = fixed || c->multicast;     // 组播只有全分辨率层
+#endif
+            if (fixed) {
+                status = "455 Method Not Valid in This State";
+            } else if (*p < '0' || *p > '9' || tier >= RTSP_TIERS) {
+                status = "451 Parameter Not Understood";
+            } else if (tier != c->tier) {
+                c->tier = (uint8_t)tier;
+                rtp_dest_set_tier(c);
+                ESP_LOGI(TAG, "RTSP session %08X switched to streamid=%d", (unsigned int)c->session_id, tier);
+            }
+        }
+        char resp[160];
+        if (c->session_id != 0) {
+            snprintf(resp, sizeof(resp),
+                     "RTSP/1.0 %s\r\n"
+                     "CSeq: %d\r\n"
+                     "Session: " RTSP_SESSION_FMT "\r\n\r\n",
+                     status, cseq, RTSP_SESSION_ARGS(c));
+        } else {
+            snprintf(resp, sizeof(resp),
+                     "RTSP/1.0 %s\r\n"
+                     "CSeq: %d\r\n\r\n", status, cseq);
+        }
+        send_rtsp_response(c->sock, cseq, resp);
+
+    } else if (strstr(buf, "GET_PARAMETER")) {
+        // 常用作保活，活跃时间已在收包时刷新
+        if (!rtsp_check_session(c, cseq, buf)) return true;
+        char resp[128];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 200 OK\r\n"
+                 "CSeq: %d\r\n"
+                 "Session: " RTSP_SESSION_FMT "\r\n\r\n",
+                 cseq, RTSP_SESSION_ARGS(c));
+        send_rtsp_response(c->sock, cseq, resp);
+
+    } else if (strstr(buf, "PLAY")) {
+        bool ready = c->tcp || c->rtp_port != 0;
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+        ready = ready || c->multicast;
+#endif
+        if (c->session_id == 0 || !ready) {
+            char err[128];
+            snprintf(err, sizeof(err),
+                    "RTSP/1.0 455 Method Not Valid in This State\r\n"
+                    "CSeq: %d\r\n\r\n", cseq);
+            send_rtsp_response(c->sock, cseq, err);
+            return true;
+        }
+        if (!rtsp_check_session(c, cseq, buf)) return true;
+        char resp[256];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 200 OK\r\n"
+                 "CSeq: %d\r\n"
+                 "Session: " RTSP_SESSION_FMT "\r\n"
+                 "Range: npt=0.000-\r\n\r\n",
+                 cseq, RTSP_SESSION_ARGS(c));
+        send_rtsp_response(c->sock, cseq, resp);
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+        if (c->multicast) {
+            if (!c->mcast_playing) {
+                c->mcast_playing = true;
+                rtp_mcast.viewers++;
+            }
+            ESP_LOGI(TAG, "RTSP multicast streaming started, viewers=%d", rtp_mcast.viewers);
+            return true;
+        }
+#endif
+        rtp_dest_publish(c);
+        ESP_LOGI(TAG, "RTSP streaming started, %d unicast sessions", rtp_dest_count);
+
+    } else if (strstr(buf, "TEARDOWN")) {
+        if (!rtsp_check_session(c, cseq, buf)) return true;
+        char resp[256];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 200 OK\r\n"
+                 "CSeq: %d\r\n"
+                 "Session: " RTSP_SESSION_FMT "\r\n\r\n",
+                 cseq, RTSP_SESSION_ARGS(c));
+        send_rtsp_response(c->sock, cseq, resp);
+        return false;
+
+    } else {
+        char resp[128];
+        snprintf(resp, sizeof(resp),
+                 "RTSP/1.0 200 OK\r\n"
+                 "CSeq: %d\r\n\r\n", cseq);
+        send_rtsp_response(c->sock, cseq, resp);
+    }
+    return true;
+}
+
+static void rtsp_client_consume(rtsp_client_t *c, uint16_t n) {
+    memmove(c->rx, c->rx + n, c->rx_len - n);
+    c->rx_len -= n;
+}
+
+// 连接可读: 非阻塞读入接收缓冲，逐个处理其中完整的请求; 返回 false 时关闭连接
+static bool rtsp_client_rx(rtsp_client_t *c) {
+    int n = recv(c->sock, c->rx + c->rx_len, RTSP_RX_BUF_SIZE - c->rx_len, MSG_DONTWAIT);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+    if (n == 0) return false;
+    c->rx_len += n;
+    rtsp_client_touch(c);
+
+    while (c->rx_len > 0) {
+        if (c->skip > 0) {
+            uint16_t k = c->skip < c->rx_len ? (uint16_t)c->skip : c->rx_len;
+            rtsp_client_consume(c, k);
+            c->skip -= k;
+            continue;
+        }
+        if (c->rx[0] == '$') {
+            // interleaved 数据 (客户端经 TCP 回送的 RTCP)，整段跳过
+            if (c->rx_len < 4) break;
+            c->skip = 4 + (((uint8_t)c->rx[2] << 8) | (uint8_t)c->rx[3]);
+            ESP_LOGD(TAG, "Received RTCP or interleaved packet, ignored.");
+            continue;
+        }
+
+        c->rx[c->rx_len] = 0;
+        char *end = strstr(c->rx, "\r\n\r\n");
+        if (!end) {
+            if (c->rx_len >= RTSP_RX_BUF_SIZE) {
+                ESP_LOGW(TAG, "RTSP request exceeds %d bytes", RTSP_RX_BUF_SIZE);
+                return false;
+            }
+            break;
+        }
+        int req_len = end + 4 - c->rx;
+        const char *cl = strstr(c->rx, "Content-Length:");
+        if (cl && cl < end) {
+            // 负数或超出缓冲剩余空间的长度会使后续截断与 consume 越界，直接断开
+            char *cl_end;
+            long body_len = strtol(cl + 15, &cl_end, 10);
+            if (cl_end == cl + 15 || body_len < 0 || body_len > RTSP_RX_BUF_SIZE - req_len) {
+                ESP_LOGW(TAG, "RTSP request with invalid Content-Length");
+                return false;
+            }
+            req_len += (int)body_len;
+        }
+        if (c->rx_len < req_len) break;
+
+        // 请求按字符串处理，临时截断以免匹配到后面排队的请求
+        char saved = c->rx[req_len];
+        c->rx[req_len] = 0;
+        bool keep = rtsp_handle_request(c, c->rx, req_len);
+        c->rx[req_len] = saved;
+        if (!keep) return false;
+        rtsp_client_consume(c, req_len);
+    }
+    return true;
+}
+
+static void rtsp_client_close(rtsp_client_t *c, const char *reason) {
+    ESP_LOGI(TAG, "RTSP client %s disconnected (%s)", inet_ntoa(c->peer.sin_addr), reason);
+    rtp_dest_withdraw(c);
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    rtp_mcast_leave(c);
+#endif
+    close(c->sock);
+    c->sock = -1;
+}
+
+static void rtsp_client_accept(int listen_sock) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int sock = accept(listen_sock, (struct sockaddr *)&addr, &addr_len);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Accept failed, errno=%d", errno);
+        return;
+    }
+
+    rtsp_client_t *c = NULL;
+    int active = 1;
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        if (rtsp_clients[i].sock >= 0) {
+            active++;
+        } else if (!c) {
+            c = &rtsp_clients[i];
+        }
+    }
+    if (!c) {
+        ESP_LOGW(TAG, "Too many RTSP clients (%d), rejecting %s", RTSP_MAX_CLIENTS, inet_ntoa(addr.sin_addr));
+        close(sock);
+        return;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->sock = sock;
+    c->peer = addr;
+    rtsp_client_touch(c);
+    latest_client_ip = addr.sin_addr.s_addr;
+
+    struct timeval send_timeout = {.tv_sec = 0, .tv_usec = RTSP_SEND_TIMEOUT_MS * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    ESP_LOGI(TAG, "RTSP client connected from %s (%d/%d)", inet_ntoa(addr.sin_addr), active, RTSP_MAX_CLIENTS);
+}
+
+// RTCP socket 可读: 收到的包算作同一地址 UDP 会话的保活，再带源地址转给推流任务
+static void rtcp_rx(void) {
+    rtcp_msg_t msg;
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int n;
+    while ((n = recvfrom(udp_rtcp_sock, msg.data, sizeof(msg.data), MSG_DONTWAIT,
+                         (struct sockaddr *)&from, &from_len)) > 0) {
+        for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+            rtsp_client_t *c = &rtsp_clients[i];
+            if (c->sock >= 0 && c->rtp_port != 0 && c->peer.sin_addr.s_addr == from.sin_addr.s_addr) {
+                rtsp_client_touch(c);
+            }
+        }
+        msg.from = from;
+        msg.len = n;
+        if (!rtcp_queue || xQueueSend(rtcp_queue, &msg, 0) != pdTRUE) {
+            ESP_LOGD(TAG, "RTCP queue full, packet dropped");
+        }
+        from_len = sizeof(from);
+    }
+}
+
 static void rtsp_server_task(void *arg) {
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
-    char buf[2048];
-    int len;
+    struct sockaddr_in server_addr;
 
     int listen_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (listen_sock < 0) {
@@ -108,293 +1103,109 @@ static void rtsp_server_task(void *arg) {
         return;
     }
 
-    if (listen(listen_sock, 1) < 0) {
+    if (listen(listen_sock, RTSP_MAX_CLIENTS) < 0) {
         ESP_LOGE(TAG, "Listen failed");
         close(listen_sock);
         vTaskDelete(NULL);
         return;
     }
 
-    ESP_LOGI(TAG, "RTSP server listening on port %d", RTSP_PORT);
-
-    while (1) {
-        rtsp_client_socket = accept(listen_sock, (struct sockaddr *)&client_addr, &client_addr_len);
-        if (rtsp_client_socket < 0) {
-            ESP_LOGE(TAG, "Accept failed");
-            continue;
-        }
-		rtsp_client_connected = true;
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        rtsp_clients[i].sock = -1;
+    }
 
-        ESP_LOGI(TAG, "RTSP client connected from %s", inet_ntoa(client_addr.sin_addr));
-        latest_client_ip = client_addr.sin_addr.s_addr;
-        rtsp_streaming = false;
-        use_tcp_transport = true;  // 默认TCP，可根据SETUP覆盖
-        client_rtp_port = 0;
+    ESP_LOGI(TAG, "RTSP server listening on port %d, up to %d clients", RTSP_PORT, RTSP_MAX_CLIENTS);
 
-        // 关闭旧UDP socket
-        if (udp_sock >= 0) {
-            close(udp_sock);
-            udp_sock = -1;
+    while (1) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(listen_sock, &rfds);
+        int max_fd = listen_sock;
+        for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+            int sock = rtsp_clients[i].sock;
+            if (sock < 0) continue;
+            FD_SET(sock, &rfds);
+            if (sock > max_fd) max_fd = sock;
         }
         if (udp_rtcp_sock >= 0) {
-            close(udp_rtcp_sock);
-            udp_rtcp_sock = -1;
+            FD_SET(udp_rtcp_sock, &rfds);
+            if (udp_rtcp_sock > max_fd) max_fd = udp_rtcp_sock;
         }
 
-        while ((len = recv(rtsp_client_socket, buf, sizeof(buf) - 1, 0)) > 0) {
-            buf[len] = 0;
-
-            if (buf[0] == '$') {
-                ESP_LOGD(TAG, "Received RTCP or interleaved packet, ignored.");
-                continue;
-            }
-
-            ESP_LOGI(TAG, "RTSP request:\n%.*s", len, buf);
+        struct timeval tv = {.tv_sec = RTSP_POLL_MS / 1000, .tv_usec = (RTSP_POLL_MS % 1000) * 1000};
+        int ready = select(max_fd + 1, &rfds, NULL, NULL, &tv);
+        if (ready < 0) {
+            ESP_LOGE(TAG, "select failed, errno=%d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
 
-            int cseq = 0;
-            const char *cseq_ptr = strstr(buf, "CSeq:");
-            if (cseq_ptr) {
-                cseq = atoi(cseq_ptr + 5);
+        if (ready > 0) {
+            if (udp_rtcp_sock >= 0 && FD_ISSET(udp_rtcp_sock, &rfds)) {
+                rtcp_rx();
             }
-
-            if (strstr(buf, "OPTIONS")) {
-                char resp[256];
-                snprintf(resp, sizeof(resp),
-                         "RTSP/1.0 200 OK\r\n"
-                         "CSeq: %d\r\n"
-                         "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN\r\n\r\n",
-                         cseq);
-                send_rtsp_response(rtsp_client_socket, cseq, resp);
-
-            } else if (strstr(buf, "DESCRIBE")) {
-                const char *sdp =
-                    "v=0\r\n"
-                    "o=- 0 0 IN IP4 0.0.0.0\r\n"
-                    "s=ESP32-CAM Stream\r\n"
-                    "m=video 0 RTP/AVP 26\r\n"
-                    "c=IN IP4 0.0.0.0\r\n"
-                    "a=control:streamid=0\r\n"
-                    "a=framerate:10\r\n"
-                    "a=rtpmap:26 JPEG/90000\r\n";
-
-                char resp[512];
-                snprintf(resp, sizeof(resp),
-                         "RTSP/1.0 200 OK\r\n"
-                         "CSeq: %d\r\n"
-                         "Content-Type: application/sdp\r\n"
-                         "Content-Length: %d\r\n\r\n%s",
-                         cseq, (int)strlen(sdp), sdp);
-                send_rtsp_response(rtsp_client_socket, cseq, resp);
-
-            } else if (strstr(buf, "SETUP")) {
-                if (strstr(buf, "RTP/AVP/TCP")) {
-#ifndef TCP_STREAM_ENABLE					
-					ESP_LOGW(TAG, "TCP transport requested but disabled by server");
-					char err[128];
-					snprintf(err, sizeof(err),
-							"RTSP/1.0 461 Unsupported Transport\r\n"
-							"CSeq: %d\r\n\r\n", cseq);
-					send_rtsp_response(rtsp_client_socket, cseq, err);
-					continue;  // 不支持TCP，继续等待客户端其他请求
-#endif
-                    use_tcp_transport = true;
-                    ESP_LOGI(TAG, "Using TCP transport for RTP");
-
-                    if (udp_sock >= 0) {
-                        close(udp_sock);
-                        udp_sock = -1;
-                    }
-                    if (udp_rtcp_sock >= 0) {
-                        close(udp_rtcp_sock);
-                        udp_rtcp_sock = -1;
-                    }
-
-                    char resp[256];
-                    snprintf(resp, sizeof(resp),
-                            "RTSP/1.0 200 OK\r\n"
-                            "CSeq: %d\r\n"
-                            "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n"
-                            "Session: 12345678\r\n"
-                            "Timeout: 60\r\n\r\n",
-                            cseq);
-                    send_rtsp_response(rtsp_client_socket, cseq, resp);
-
-                } else if (strstr(buf, "RTP/AVP")) {
-                    use_tcp_transport = false;
-                    ESP_LOGI(TAG, "Using UDP transport for RTP");
-
-                    uint32_t parsed_ip = 0;
-                    client_rtp_port = parse_client_rtp_port_and_ip(buf, &parsed_ip);
-                    if (client_rtp_port == 0) {
-                        ESP_LOGE(TAG, "Failed to parse client RTP port");
-                        char err[128];
-                        snprintf(err, sizeof(err),
-                                "RTSP/1.0 400 Bad Request\r\n"
-                                "CSeq: %d\r\n\r\n", cseq);
-                        send_rtsp_response(rtsp_client_socket, cseq, err);
-                        break;
-                    }
-
-                    // 关闭旧UDP socket
-                    if (udp_sock >= 0) close(udp_sock);
-                    if (udp_rtcp_sock >= 0) close(udp_rtcp_sock);
-
-                    // 创建RTP socket
-                    udp_sock = socket(AF_INET, SOCK_DGRAM, 0);
-                    if (udp_sock < 0) {
-                        ESP_LOGE(TAG, "Failed to create RTP socket");
-                        break;
-                    }
-
-					// ✅ 设置 UDP 发送超时（防止 sendto 永久阻塞）
-					struct timeval timeout = {.tv_sec = 0, .tv_usec = 50000};
-					setsockopt(udp_sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-
-					// ✅ 设置发送缓冲区大小
-					int send_buf_size = UDP_SEND_BUF_SIZE;
-					setsockopt(udp_sock, SOL_SOCKET, SO_SNDBUF, &send_buf_size, sizeof(send_buf_size));
-
-                    // 创建RTCP socket
-                    udp_rtcp_sock = socket(AF_INET, SOCK_DGRAM, 0);
-                    if (udp_rtcp_sock < 0) {
-                        ESP_LOGE(TAG, "Failed to create RTCP socket");
-                        close(udp_sock);
-                        udp_sock = -1;
-                        break;
-                    }
-					
-                    struct sockaddr_in local_rtp_addr = {
-                        .sin_family = AF_INET,
-                        .sin_port = htons(RTP_PORT),
-                        .sin_addr.s_addr = htonl(INADDR_ANY),
-                    };
-                    
-                    struct sockaddr_in local_rtcp_addr = {
-                        .sin_family = AF_INET,
-                        .sin_port = htons(RTCP_PORT),
-                        .sin_addr.s_addr = htonl(INADDR_ANY),
-                    };
-
-                    // 绑定RTP端口
-                    if (bind(udp_sock, (struct sockaddr *)&local_rtp_addr, sizeof(local_rtp_addr)) < 0) {
-                        ESP_LOGE(TAG, "RTP bind failed on port %d, errno=%d", RTP_PORT, errno);
-                        close(udp_sock);
-                        close(udp_rtcp_sock);
-                        udp_sock = -1;
-                        udp_rtcp_sock = -1;
-                        break;
-                    }
-
-                    // 绑定RTCP端口
-                    if (bind(udp_rtcp_sock, (struct sockaddr *)&local_rtcp_addr, sizeof(local_rtcp_addr)) < 0) {
-                        ESP_LOGE(TAG, "RTCP bind failed on port %d, errno=%d", RTCP_PORT, errno);
-                        close(udp_sock);
-                        close(udp_rtcp_sock);
-                        udp_sock = -1;
-                        udp_rtcp_sock = -1;
-                        break;
-                    }
-
-                    udp_client_addr.sin_family = AF_INET;
-                    udp_client_addr.sin_addr.s_addr = parsed_ip;
-                    udp_client_addr.sin_port = htons(client_rtp_port);
-
-                    ESP_LOGI(TAG, "UDP client IP: %s, RTP port: %d, RTCP port: %d",
-                            inet_ntoa(udp_client_addr.sin_addr),
-                            client_rtp_port, client_rtp_port + 1);
-
-                    char resp[256];
-                    snprintf(resp, sizeof(resp),
-                            "RTSP/1.0 200 OK\r\n"
-                            "CSeq: %d\r\n"
-                            "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\n"
-                            "Session: 12345678\r\n\r\n",
-                            cseq, client_rtp_port, client_rtp_port + 1, RTP_PORT, RTCP_PORT);
-                    send_rtsp_response(rtsp_client_socket, cseq, resp);
-                } else {
-                    char err[128];
-                    snprintf(err, sizeof(err),
-                            "RTSP/1.0 461 Unsupported Transport\r\n"
-                            "CSeq: %d\r\n\r\n", cseq);
-                    send_rtsp_response(rtsp_client_socket, cseq, err);
+            for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+                rtsp_client_t *c = &rtsp_clients[i];
+                if (c->sock >= 0 && FD_ISSET(c->sock, &rfds) && !rtsp_client_rx(c)) {
+                    rtsp_client_close(c, "closed");
                 }
-            } else if (strstr(buf, "PLAY")) {
-                char resp[256];
-                snprintf(resp, sizeof(resp),
-                         "RTSP/1.0 200 OK\r\n"
-                         "CSeq: %d\r\n"
-                         "Session: 12345678\r\n"
-                         "Range: npt=0.000-\r\n\r\n",
-                         cseq);
-                send_rtsp_response(rtsp_client_socket, cseq, resp);
-                rtsp_streaming = true;
-                frame_count = 0;
-                last_stat_time = esp_timer_get_time() / 1000;
-                ESP_LOGI(TAG, "RTSP streaming started");
-
-            } else if (strstr(buf, "TEARDOWN")) {
-                char resp[256];
-                snprintf(resp, sizeof(resp),
-                         "RTSP/1.0 200 OK\r\n"
-                         "CSeq: %d\r\n"
-                         "Session: 12345678\r\n\r\n",
-                         cseq);
-                send_rtsp_response(rtsp_client_socket, cseq, resp);
-                rtsp_streaming = false;
-                break;
-
-            } else {
-                char resp[128];
-                snprintf(resp, sizeof(resp),
-                         "RTSP/1.0 200 OK\r\n"
-                         "CSeq: %d\r\n\r\n", cseq);
-                send_rtsp_response(rtsp_client_socket, cseq, resp);
+            }
+            if (FD_ISSET(listen_sock, &rfds)) {
+                rtsp_client_accept(listen_sock);
             }
         }
 
-        ESP_LOGI(TAG, "RTSP client disconnected");
-		rtsp_streaming = false;
-    	rtsp_client_connected = false;
-
-        if (udp_sock >= 0) {
-            close(udp_sock);
-            udp_sock = -1;
-        }
-        if (udp_rtcp_sock >= 0) {
-            close(udp_rtcp_sock);
-            udp_rtcp_sock = -1;
+        // 回收不发 TEARDOWN 就消失的客户端
+        uint32_t now_ms = rtsp_now_ms();
+        for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+            rtsp_client_t *c = &rtsp_clients[i];
+            if (c->sock >= 0 && rtsp_client_expired(c, now_ms)) {
+                ESP_LOGW(TAG, "RTSP session %08X timed out after %ds idle, reaping",
+                         (unsigned int)c->session_id, RTSP_SESSION_TIMEOUT_S);
+                rtsp_client_close(c, "timeout");
+            }
         }
-        close(rtsp_client_socket);
-        rtsp_client_socket = -1;
     }
 }
 
-// 添加RTCP发送函数
-static void send_rtcp_sr_report(uint32_t ntp_ts, uint32_t rtp_ts) {
-    if (udp_rtcp_sock < 0 || client_rtp_port == 0) {
-        ESP_LOGW(TAG, "Cannot send RTCP: no client port");
-        return;
+#define NTP_UNIX_OFFSET_S       2208988800ULL   // 1900-01-01 到 1970-01-01 的秒数
+#define NTP_WALL_CLOCK_MIN_S    1577836800LL    // 2020-01-01，系统时间早于此视为尚未校时
+
+// SR 的 NTP 时间 (微秒): 系统时间已校准 (SNTP 或 settimeofday) 时取墙钟并换算到 now_us 时刻;
+// 否则退回以开机为纪元的单调时钟，只能让接收端对齐本发送端的各路 RTP，不能与墙钟做同步
+static uint64_t rtcp_ntp_time_us(int64_t now_us) {
+    struct timeval tv;
+    if (gettimeofday(&tv, NULL) == 0 && tv.tv_sec >= NTP_WALL_CLOCK_MIN_S) {
+        int64_t wall_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec - (esp_timer_get_time() - now_us);
+        return (uint64_t)wall_us + NTP_UNIX_OFFSET_S * 1000000;
     }
-    
-    struct sockaddr_in rtcp_addr = udp_client_addr;
-    rtcp_addr.sin_port = htons(client_rtp_port + 1); // RTCP端口
-    
+    return (uint64_t)now_us;
+}
+
+// 添加RTCP发送函数，now_us 为 esp_timer 时基，NTP/RTP 时间戳取自同一时刻以便客户端做同步
+static void send_rtcp_sr_report(int sock, const struct sockaddr_in *rtcp_addr, int64_t now_us,
+                                uint32_t packets, uint32_t octets) {
+    uint64_t ntp_us = rtcp_ntp_time_us(now_us);
+    uint32_t ntp_sec = (uint32_t)(ntp_us / 1000000);
+    uint32_t ntp_frac = (uint32_t)(((ntp_us % 1000000) << 32) / 1000000);
+    uint32_t rtp_ts = rtp_ts_from_us(now_us);
+
     uint8_t rtcp_pkt[28] = {
         0x80, 0xC8, 0x00, 0x06, // SR header
         0x12, 0x34, 0x56, 0x78, // SSRC
-        (ntp_ts >> 24) & 0xFF, (ntp_ts >> 16) & 0xFF, (ntp_ts >> 8) & 0xFF, ntp_ts & 0xFF,
-        0x00, 0x00, 0x00, 0x00, // NTP timestamp fractional
+        (ntp_sec >> 24) & 0xFF, (ntp_sec >> 16) & 0xFF, (ntp_sec >> 8) & 0xFF, ntp_sec & 0xFF,
+        (ntp_frac >> 24) & 0xFF, (ntp_frac >> 16) & 0xFF, (ntp_frac >> 8) & 0xFF, ntp_frac & 0xFF,
         (rtp_ts >> 24) & 0xFF, (rtp_ts >> 16) & 0xFF, (rtp_ts >> 8) & 0xFF, rtp_ts & 0xFF,
-        0x00, 0x00, 0x00, 0x00, // Packet count
-        0x00, 0x00, 0x00, 0x00  // Octet count
+        (packets >> 24) & 0xFF, (packets >> 16) & 0xFF, (packets >> 8) & 0xFF, packets & 0xFF,
+        (octets >> 24) & 0xFF, (octets >> 16) & 0xFF, (octets >> 8) & 0xFF, octets & 0xFF
     };
     
-    int sent = sendto(udp_rtcp_sock, rtcp_pkt, sizeof(rtcp_pkt), 0,
-          (struct sockaddr *)&rtcp_addr, sizeof(rtcp_addr));
+    int sent = sendto(sock, rtcp_pkt, sizeof(rtcp_pkt), 0,
+          (const struct sockaddr *)rtcp_addr, sizeof(*rtcp_addr));
     
     if (sent > 0) {
         ESP_LOGD(TAG, "Sent RTCP SR report to %s:%d", 
-                inet_ntoa(rtcp_addr.sin_addr), ntohs(rtcp_addr.sin_port));
+                inet_ntoa(rtcp_addr->sin_addr), ntohs(rtcp_addr->sin_port));
     } else {
         ESP_LOGE(TAG, "Failed to send RTCP, errno=%d", errno);
     }
@@ -438,60 +1249,609 @@ static bool jpeg_has_dqt(const uint8_t *data, size_t len) {
 }
 #endif
 
-void rtsp_server_send_frame(uint8_t *jpeg, size_t len, uint8_t type) {
-    if (!rtsp_streaming || (!use_tcp_transport && udp_sock < 0) || len < 2) return;
+// 发送单个 RTP 包; dst 为 NULL 时走 RTSP TCP interleaved 通道 0
+// EAGAIN/ENOMEM/ENOBUFS 退避重试，其余错误置 *fatal; 调用耗时与重试次数记入 st
+static int rtp_send_packet(int sock, const uint8_t *pkt, int len,
+                           const struct sockaddr_in *dst, bool *fatal,
+                           rtsp_stats_counters_t *st) {
+    int retry = 0;
+    int delay = RTP_RETRY_DELAY_MS;
+    int sent = -1;
+    int64_t start_us = esp_timer_get_time();
+    *fatal = false;
+
+    while (sent < 0 && retry <= RTP_RETRY_LIMIT) {
+        if (dst == NULL) {
+            // interleaved 头与 RTP 包一次 writev 发出，避免大包在栈上拷贝
+            uint8_t ilv[4] = { '$', 0x00, (len >> 8) & 0xFF, len & 0xFF };
+            struct iovec iov[2] = {
+                { .iov_base = ilv, .iov_len = sizeof(ilv) },
+                { .iov_base = (void *)pkt, .iov_len = len },
+            };
+            sent = writev(sock, iov, 2);
+            // TCP 部分写入后只能从断点续写，不能回到循环顶部整包重发，否则 interleaved 帧错位;
+            // 续写失败时连接已不可用，置 *fatal 由调用方关闭会话
+            if (sent > 0 && sent < len + 4) {
+                int done = sent;
+                while (done < len + 4) {
+                    int n = (done < 4) ? send(sock, ilv + done, 4 - done, 0)
+                                       : send(sock, pkt + (done - 4), len + 4 - done, 0);
+                    if (n > 0) {
+                        done += n;
+                        continue;
+                    }
+                    int err = errno;
+                    if (n < 0 && (err == EAGAIN || err == ENOMEM || err == ENOBUFS) && retry < RTP_RETRY_LIMIT) {
+                        vTaskDelay(pdMS_TO_TICKS(delay));
+                        retry++;
+                        delay = (delay * 2 > 50) ? 50 : delay * 2;
+                        continue;
+                    }
+                    ESP_LOGE(TAG, "Interleaved packet cut after %d/%d bytes, errno=%d", done, len + 4, err);
+                    *fatal = true;
+                    break;
+                }
+                if (*fatal) {
+                    sent = -1;
+                    break;
+                }
+                sent = done;
+            }
+        } else {
+            sent = sendto(sock, pkt, len, 0, (const struct sockaddr *)dst, sizeof(*dst));
+        }
+
+        if (sent < 0) {
+            int err = errno;
+            if (err == EAGAIN || err == ENOMEM || err == ENOBUFS) {
+                vTaskDelay(pdMS_TO_TICKS(delay));
+                retry++;
+                delay = (delay * 2 > 50) ? 50 : delay * 2;
+            } else {
+                *fatal = true;
+                ESP_LOGE(TAG, "Fatal send error: %d", err);
+                break;
+            }
+        }
+    }
+    st->retries += retry;
+    rtsp_stats_send_call(st, (uint32_t)(esp_timer_get_time() - start_us));
+    return sent;
+}
 
-    static uint16_t seq = 0;
-    static uint32_t ssrc = 0x12345678;
-    static uint32_t rtp_timestamp = 0;
+// 按地址找到单播 UDP 目的地 (RTP/RTCP/FEC 端口均可)，端口都不符时退回按 IP 匹配
+static int rtp_dest_find(uint32_t addr, uint16_t port) {
+    int by_ip = -1;
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        const rtp_dest_t *d = &rtp_dests[i];
+        if (d->session_id == 0 || d->tcp_sock >= 0 || d->rtp_addr.sin_addr.s_addr != addr) continue;
+        uint16_t rtp_port = ntohs(d->rtp_addr.sin_port);
+        if (port == rtp_port || port == rtp_port + 1 || (d->fec_port && port == d->fec_port)) return i;
+        if (by_ip < 0) by_ip = i;
+    }
+    return by_ip;
+}
 
-    static uint8_t rtp_pkt_buf[RTP_HEADER_SIZE + JPEG_HEADER_SIZE + RTP_MAX_PAYLOAD];
+// 目的地 d 订阅了分层 tier; 会话号须与帧开始时同步的一致，
+// 边编码边发送的两段之间新发布或替换的会话要到下一帧才开始接收
+static inline bool rtp_dest_in_tier(int d, uint8_t tier) {
+    return rtp_dests[d].session_id != 0 && rtp_dests[d].session_id == rtp_dest_state[d].session_id &&
+           rtp_dest_state[d].tier == tier;
+}
 
-    uint64_t frame_start_us = esp_timer_get_time();
-    rtp_timestamp += 90000 / FRAME_RATE;
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+typedef void (*rtp_batch_drop_cb_t)(const rtp_batch_pkt_t *e);
+
+// 提交队列中的包，协议栈缓冲不足时按 rtp_send_packet 的策略退避重试;
+// 仍未发出的媒体包丢弃，有 on_drop 时逐包归到所属会话，否则按中途丢包计入 st
+static void rtp_batch_commit(rtp_batch_t *b, bool *fatal, rtsp_stats_counters_t *st,
+                             rtp_batch_drop_cb_t on_drop) {
+    int retry = 0;
+    int delay = RTP_RETRY_DELAY_MS;
+    *fatal = false;
+
+    while (rtp_batch_pending(b) > 0) {
+        int64_t start_us = esp_timer_get_time();
+        int ret = rtp_batch_flush(b);
+        rtsp_stats_send_call(st, (uint32_t)(esp_timer_get_time() - start_us));
+        if (ret < 0) {
+            *fatal = true;
+            ESP_LOGE(TAG, "Fatal batch send error: %d", b->last_err);
+            break;
+        }
+        if (rtp_batch_pending(b) == 0 || retry >= RTP_RETRY_LIMIT) break;
+        vTaskDelay(pdMS_TO_TICKS(delay));
+        retry++;
+        delay = (delay * 2 > 50) ? 50 : delay * 2;
+    }
+    st->retries += retry;
+    if (on_drop) {
+        for (int i = b->head; i < b->count; i++) {
+            if (b->pkts[i].flags & RTP_BATCH_F_MEDIA) on_drop(&b->pkts[i]);
+        }
+        rtp_batch_discard(b);
+    } else {
+        st->drops[RTSP_DROP_PKT_SEND] += rtp_batch_discard(b);
+    }
+}
 
-    if (jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
-        ESP_LOGW(TAG, "Invalid JPEG header");
+// 入队一个包，队列满或 pbuf 不足时先提交再重试; 返回 false 时由调用方逐包发送
+static bool rtp_batch_queue(rtp_batch_t *b, const struct sockaddr_in *dst,
+                            const uint8_t *hdr, size_t hdr_len,
+                            const uint8_t *payload, size_t payload_len,
+                            uint8_t flags, rtsp_stats_counters_t *st, rtp_batch_drop_cb_t on_drop) {
+    bool fatal = false;
+    if (rtp_batch_add(b, dst, hdr, hdr_len, payload, payload_len, flags) == 0) return true;
+    rtp_batch_commit(b, &fatal, st, on_drop);
+    if (fatal) return false;
+    return rtp_batch_add(b, dst, hdr, hdr_len, payload, payload_len, flags) == 0;
+}
+
+// 单播批量队列中被丢弃的媒体包: 入队时已计为发出，改记为该会话的中途丢包
+static void rtp_dest_batch_drop(const rtp_batch_pkt_t *e) {
+    int d = rtp_dest_find(e->addr, ntohs(e->port));
+    if (d < 0) return;
+    rtp_dest_state[d].stat.packets--;
+    rtp_dest_state[d].stat.drops[RTSP_DROP_PKT_SEND]++;
+}
+#endif
+
+#ifdef CONFIG_RTSP_NACK_ENABLE
+// 从会话所在分层的历史环取出 seq 对应的包原样重传 (同序号同时间戳) 给发出 NACK 的会话
+static void rtp_retransmit(uint16_t seq, int d, uint8_t *scratch) {
+    rtp_dest_state_t *ds = &rtp_dest_state[d];
+    uint16_t tier_seq_no = seq - ds->seq_offset;
+    if (ds->rtx_guard && (uint16_t)(tier_seq_no - ds->rtx_base) >= (uint16_t)(tier_seq[ds->tier] - ds->rtx_base)) {
+        ESP_LOGD(TAG, "NACK seq %u precedes tier switch", seq);
         return;
     }
+    const rtp_history_entry_t *e = rtp_history_get(&rtp_history[ds->tier], tier_seq_no);
+    if (!e) {
+        ESP_LOGD(TAG, "NACK seq %u not in history", seq);
+        return;
+    }
+    memcpy(scratch, e->hdr, RTP_HISTORY_HDR_SIZE);
+    memcpy(scratch + RTP_HISTORY_HDR_SIZE, e->frame->buf + e->offset, e->chunk);
+    rtp_put_seq(scratch, seq);
+
+    bool fatal = false;
+    if (rtp_send_packet(udp_sock, scratch, RTP_HISTORY_HDR_SIZE + e->chunk, &rtp_dests[d].rtp_addr, &fatal,
+                        &ds->stat) > 0) {
+        ds->stat.rtx_packets++;
+    }
+}
+#endif
 
-    frame_count++;
-    uint64_t now_ms = frame_start_us / 1000;
-    if (now_ms - last_stat_time >= 1000) {
-        float loss_rate = (packet_count + error_count) ? ((float)error_count * 100) / (packet_count + error_count) : 0;
-        ESP_LOGI(TAG, "Streaming: %u FPS, %u pkts, %u bytes, %u errs (%.1f%%)",
-                 (unsigned int)frame_count,
-                 (unsigned int)packet_count,
-                 (unsigned int)len,
-                 (unsigned int)error_count,
-                 loss_rate);
-        frame_count = 0;
-        packet_count = 0;
-        error_count = 0;
+// 解析会话 d 发来的 RTCP 复合包: RR 的丢包率用于调整包长，
+// Generic NACK 触发重传
+static void rtcp_handle_packet(const uint8_t *buf, int len, int d, uint8_t *scratch) {
+    while (len >= 4) {
+        uint8_t fmt = buf[0] & 0x1F;
+        uint8_t pt = buf[1];
+        int pkt_len = (((buf[2] << 8) | buf[3]) + 1) * 4;
+        if ((buf[0] >> 6) != 2 || pkt_len > len) break;
+
+        if (pt == RTCP_PT_RR && fmt >= 1 && pkt_len >= 8 + 24) {
+            // 第一个 report block: SSRC(4), fraction lost(1), 累计丢包(3), 最高序号(4), 抖动(4)
+            rtp_adapt_packet_size(d, buf[12]);
+            rtsp_stats_rtcp_rr(rtp_dest_state[d].stat_slot, buf[12],
+                               ((uint32_t)buf[13] << 16) | ((uint32_t)buf[14] << 8) | buf[15],
+                               ((uint32_t)buf[20] << 24) | ((uint32_t)buf[21] << 16) |
+                               ((uint32_t)buf[22] << 8) | buf[23]);
+        }
+#ifdef CONFIG_RTSP_NACK_ENABLE
+        if (pt == RTCP_PT_RTPFB && fmt == RTCP_FMT_NACK) {
+            // FCI 从第 12 字节开始: PID(16) + BLP(16)
+            for (int off = 12; off + 4 <= pkt_len; off += 4) {
+                uint16_t pid = (buf[off] << 8) | buf[off + 1];
+                uint16_t blp = (buf[off + 2] << 8) | buf[off + 3];
+                rtp_retransmit(pid, d, scratch);
+                for (int b = 0; b < 16; b++) {
+                    if (blp & (1 << b)) rtp_retransmit((uint16_t)(pid + b + 1), d, scratch);
+                }
+            }
+        }
+#else
+        (void)scratch;
+#endif
+        buf += pkt_len;
+        len -= pkt_len;
+    }
+}
+
+// 处理事件循环转来的接收报告/反馈，按源地址归到会话，找不到会话的直接丢弃
+static void rtcp_drain(uint8_t *scratch) {
+    rtcp_msg_t msg;
+    while (rtcp_queue && xQueueReceive(rtcp_queue, &msg, 0) == pdTRUE) {
+        int d = rtp_dest_find(msg.from.sin_addr.s_addr, ntohs(msg.from.sin_port));
+        if (d >= 0) rtcp_handle_packet(msg.data, msg.len, d, scratch);
+    }
+}
+
+// 单播会话或组播开关变化时开闭统计槽位，结束的会话保留在槽中供查询
+static void rtsp_stats_track_outputs(bool multicast) {
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        const rtp_dest_t *d = &rtp_dests[i];
+        rtp_dest_state_t *ds = &rtp_dest_state[i];
+        if (ds->session_id == d->session_id) continue;
+
+        if (ds->stat_slot >= 0) {
+            rtsp_stats_session_close(ds->stat_slot);
+            ds->stat_slot = -1;
+        }
+        ds->session_id = d->session_id;
+        ds->sent_packets = 0;
+        ds->sent_octets = 0;
+        ds->tier = d->tier;
+        ds->seq_offset = 0;
+        ds->fec_seq_offset = 0;
+        ds->rtx_guard = false;
+        ds->pkt_size = rtp_udp_packet_size_max();   // 新会话从 MTU 上限开始，之后随自己的 RR 调整
+        ds->clean_rr = 0;
+        if (d->session_id == 0) continue;
+
+        struct sockaddr_in peer = d->rtp_addr;
+        if (d->tcp_sock >= 0) {
+            socklen_t addr_len = sizeof(peer);
+            if (getpeername(d->tcp_sock, (struct sockaddr *)&peer, &addr_len) != 0) {
+                memset(&peer, 0, sizeof(peer));
+            }
+        }
+        ds->stat_slot = rtsp_stats_session_open(d->session_id, d->tcp_sock >= 0 ? RTSP_STATS_TCP : RTSP_STATS_UDP,
+                                                peer.sin_addr.s_addr, ntohs(peer.sin_port));
+        rtsp_stats_session_tier(ds->stat_slot, ds->tier);
+    }
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    if (multicast && stat_mcast_slot < 0) {
+        // 组播所有观众共享一路流，以全 1 作为会话号
+        stat_mcast_slot = rtsp_stats_session_open(0xFFFFFFFF, RTSP_STATS_MCAST,
+                                                  rtp_mcast.rtp_addr.sin_addr.s_addr, RTP_MCAST_PORT);
+    } else if (!multicast && stat_mcast_slot >= 0) {
+        rtsp_stats_session_close(stat_mcast_slot);
+        stat_mcast_slot = -1;
+    }
+#else
+    (void)multicast;
+#endif
+}
+
+// 在帧边界应用会话的分层切换: 新偏移让客户端序号 (媒体与 FEC) 接着旧分层连续递增
+static void rtp_dest_track_tiers(void) {
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        const rtp_dest_t *d = &rtp_dests[i];
+        rtp_dest_state_t *ds = &rtp_dest_state[i];
+        if (d->session_id == 0 || ds->session_id != d->session_id) continue;
+        if (ds->tier == d->tier) {
+            // 历史环已覆盖切换前的序号后解除限制
+            if (ds->rtx_guard && (uint16_t)(tier_seq[ds->tier] - ds->rtx_base) >= RTP_HISTORY_SLOTS) {
+                ds->rtx_guard = false;
+            }
+            continue;
+        }
+        ds->seq_offset = (uint16_t)(tier_seq[ds->tier] + ds->seq_offset - tier_seq[d->tier]);
+#ifdef CONFIG_RTSP_FEC_ENABLE
+        ds->fec_seq_offset = (uint16_t)(fec_encoder[ds->tier].seq + ds->fec_seq_offset - fec_encoder[d->tier].seq);
+#endif
+        ds->tier = d->tier;
+        ds->rtx_guard = true;
+        ds->rtx_base = tier_seq[d->tier];
+        rtsp_stats_session_tier(ds->stat_slot, ds->tier);
+    }
+}
+
+// 提交本帧累积的统计增量
+static void rtsp_stats_flush_frame(void) {
+    rtsp_stats_commit(-1, &stat_src);
+    memset(&stat_src, 0, sizeof(stat_src));
+    rtsp_stats_commit(-1, &stat_ubatch);
+    memset(&stat_ubatch, 0, sizeof(stat_ubatch));
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        rtp_dest_state_t *ds = &rtp_dest_state[i];
+        if (ds->stat_slot >= 0) rtsp_stats_commit(ds->stat_slot, &ds->stat);
+        memset(&ds->stat, 0, sizeof(ds->stat));
+    }
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    if (stat_mcast_slot >= 0) rtsp_stats_commit(stat_mcast_slot, &stat_mcast);
+    memset(&stat_mcast, 0, sizeof(stat_mcast));
+#endif
+}
+
+// 把一次整帧丢弃记到订阅该分层、仍在输出的会话上
+static void rtsp_stats_drop_frame(uint8_t tier, bool multicast, rtsp_drop_reason_t reason) {
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        if (rtp_dest_in_tier(i, tier)) rtp_dest_state[i].stat.drops[reason]++;
+    }
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    if (multicast) stat_mcast.drops[reason]++;
+#else
+    (void)multicast;
+#endif
+}
+
+// 每秒输出一次推流统计，取全局累计值与上次的差
+static void rtsp_stats_log(uint64_t now_ms) {
+    static uint64_t last_stat_time = 0;
+    if (last_stat_time == 0) {
         last_stat_time = now_ms;
+        stat_log_prev = *rtsp_stats_total();
+        return;
+    }
+    if (now_ms - last_stat_time < 1000) return;
+
+    const rtsp_stats_counters_t *t = rtsp_stats_total();
+    uint32_t elapsed_ms = (uint32_t)(now_ms - last_stat_time);
+    uint32_t frames = t->frames_in - stat_log_prev.frames_in;
+    uint32_t packets = t->packets - stat_log_prev.packets;
+    uint32_t calls = t->send_calls - stat_log_prev.send_calls;
+    uint32_t lost = (t->drops[RTSP_DROP_PKT_SEND] - stat_log_prev.drops[RTSP_DROP_PKT_SEND]) +
+                    (t->drops[RTSP_DROP_SEND_ABORT] - stat_log_prev.drops[RTSP_DROP_SEND_ABORT]);
+    uint32_t kbps = (uint32_t)((t->bytes_in - stat_log_prev.bytes_in) * 8 / elapsed_ms);
+    uint64_t frame_us = t->frame_us_total - stat_log_prev.frame_us_total;
+
+    for (int t = 0; t < RTSP_TIERS; t++) {
+        uint32_t tier_kbps = (uint32_t)((uint64_t)stream_tier_bytes[t] * 8 / elapsed_ms);
+        if (tier_kbps) {
+            stream_bitrate_kbps[t] = stream_bitrate_kbps[t] ? (stream_bitrate_kbps[t] * 3 + tier_kbps) / 4 : tier_kbps;
+        }
+        stream_tier_bytes[t] = 0;
+    }
+    float loss_rate = (packets + lost) ? ((float)lost * 100) / (packets + lost) : 0;
+    ESP_LOGI(TAG, "Streaming: %u FPS, %u pkts, %u kbps, %u lost (%.1f%%), %u rtx, %u admit drops",
+             (unsigned int)frames,
+             (unsigned int)packets,
+             (unsigned int)kbps,
+             (unsigned int)lost,
+             loss_rate,
+             (unsigned int)(t->rtx_packets - stat_log_prev.rtx_packets),
+             (unsigned int)(t->drops[RTSP_DROP_ADMISSION] - stat_log_prev.drops[RTSP_DROP_ADMISSION]));
+    ESP_LOGI(TAG, "Packetizer: %u B/pkt, %u pkt/s, %u us/frame send, %u pkt/call",
+             stream_pkt_size[LCD_CAMERA_TIER_FULL],
+             (unsigned int)(packets * 1000 / elapsed_ms),
+             (unsigned int)(frames ? frame_us / frames : 0),
+             (unsigned int)(calls ? packets / calls : 0));
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    const rtsp_stats_counters_t *m = rtsp_stats_session(stat_mcast_slot);
+    if (m && rtp_mcast.viewers > 0) {
+        ESP_LOGI(TAG, "Multicast: %d viewers, %u pkts, %u frames since start",
+                 rtp_mcast.viewers, (unsigned int)m->packets, (unsigned int)m->frames);
+    }
+#endif
+    stat_log_prev = *t;
+    last_stat_time = now_ms;
+}
+
+// 向单播目的地 d 发送一个媒体包; 首包失败或致命错误时该目的地本帧放弃，其余失败计为中途丢包
+// pkt 中的序号按目的地偏移改写 (调用方发完后恢复)，*copied 表示负载是否已拷进 pkt，逐包发送前才补拷
+static void rtp_dest_send(int d, uint8_t *pkt, int pkt_len, uint16_t seq, const uint8_t *body, size_t chunk,
+                          bool first, bool *copied) {
+    const rtp_dest_t *dst = &rtp_dests[d];
+    rtp_dest_state_t *ds = &rtp_dest_state[d];
+    bool fatal = false;
+    int sent;
+
+    rtp_put_seq(pkt, seq + ds->seq_offset);
+
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+    if (dst->tcp_sock < 0 && ucast_batch_ok &&
+        rtp_batch_queue(&ucast_batch, &dst->rtp_addr, pkt, RTP_PKT_HDR_SIZE, body, chunk, RTP_BATCH_F_MEDIA,
+                        &stat_ubatch, rtp_dest_batch_drop)) {
+        ds->stat.packets++;
+        ds->sent_packets++;
+        ds->sent_octets += pkt_len - RTP_HEADER_SIZE;
+        return;
+    }
+#endif
+    if (!*copied) {
+        memcpy(pkt + RTP_PKT_HDR_SIZE, body, chunk);
+        *copied = true;
+    }
+    if (dst->tcp_sock >= 0) {
+        sent = rtp_send_packet(dst->tcp_sock, pkt, pkt_len, NULL, &fatal, &ds->stat);
+    } else {
+        sent = rtp_send_packet(udp_sock, pkt, pkt_len, &dst->rtp_addr, &fatal, &ds->stat);
     }
 
-    size_t offset = 0;
-    bool frame_failed = false;
+    if (sent < 0) {
+        // 首包失败时尚未发出任何数据，整帧放弃; 帧已开始发送时其余包照发直到 marker
+        ds->stat.drops[first ? RTSP_DROP_SEND_ABORT : RTSP_DROP_PKT_SEND]++;
+        if (first || fatal) {
+            ds->failed = true;
+            // TCP 连接出错 (含半包) 后不能再写; 关闭收发让 RTSP 任务读到 EOF 后按正常流程撤下会话
+            if (fatal && dst->tcp_sock >= 0) shutdown(dst->tcp_sock, SHUT_RDWR);
+        } else {
+            ESP_LOGW(TAG, "RTP packet lost mid-frame, continue remaining packets");
+        }
+    } else {
+        ds->stat.packets++;
+        ds->sent_packets++;
+        ds->sent_octets += pkt_len - RTP_HEADER_SIZE;
+    }
+}
 
-    while (offset < len) {
-        if (esp_timer_get_time() - frame_start_us > RTP_FRAME_TIMEOUT_US) {
-            ESP_LOGW(TAG, "Drop frame due to timeout");
-            error_count++;
-            return;
+// 一帧的发送状态: 整帧发送时一次走完，边编码边发送时跨越多次编码回调 (每段打包期间持有 rtp_dest_lock)
+typedef struct {
+    lcd_camera_frame_t *frame;
+    uint8_t type;
+    uint8_t tier;
+    bool mcast_active;                  // 有组播观众 (SR 与统计槽)
+    bool multicast;                     // 本帧发往组播
+    int ucast_udp;
+    int ucast_tcp;
+    bool copy_body;
+    bool keep_history;
+    bool aborted;                       // 所有输出都已失败，剩余数据不再发送
+    bool failed;                        // 所有输出都在首包失败
+    size_t max_payload;
+    size_t offset;                      // 已打包的字节
+    size_t sent_pkts;
+    uint16_t seq;
+    uint32_t rtp_timestamp;
+    uint64_t start_us;
+    uint32_t send_us;                   // 打包发送本身的耗时，不含等待编码
+} rtp_frame_tx_t;
+
+static uint8_t rtp_pkt_buf[RTP_MAX_PACKET_SIZE];
+#ifdef CONFIG_RTSP_FEC_ENABLE
+static uint8_t fec_pkt_buf[RTP_HEADER_SIZE + RTP_FEC_HEADER_SIZE + RTP_FEC_LEVEL_HDR_SIZE + RTP_FEC_MAX_PROTECT];
+#endif
+static size_t stream_last_len[RTSP_TIERS];  // 上一帧长度，边编码边发送时用于准入预估
+
+// 开始发送一帧: 统计输出、检查 JPEG 头并做帧级准入，调用方持有 rtp_dest_lock;
+// frame 至少已有 2 字节，est_len 为预估的整帧长度; 返回 false 表示整帧不发送
+static bool rtp_frame_begin(rtp_frame_tx_t *tx, lcd_camera_frame_t *frame, uint8_t type,
+                            uint64_t start_us, size_t est_len) {
+    static uint32_t last_capture_seq = UINT32_MAX;
+    uint8_t tier = frame->tier;
+
+    memset(tx, 0, sizeof(*tx));
+    tx->frame = frame;
+    tx->type = type;
+    tx->tier = tier;
+    tx->start_us = start_us;
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    tx->mcast_active = rtp_mcast.viewers > 0 && rtp_mcast.rtp_sock >= 0;
+#endif
+    rtsp_stats_track_outputs(tx->mcast_active);
+    rtp_dest_track_tiers();
+    if (tier >= RTSP_TIERS) return false;
+
+    uint16_t udp_pkt_size = RTP_MAX_PACKET_SIZE;
+    for (int d = 0; d < RTSP_MAX_CLIENTS; d++) {
+        rtp_dest_state[d].failed = false;
+        if (!rtp_dest_in_tier(d, tier)) continue;
+        if (rtp_dests[d].tcp_sock >= 0) {
+            tx->ucast_tcp++;
+        } else {
+            tx->ucast_udp++;
+            if (rtp_dest_state[d].pkt_size < udp_pkt_size) udp_pkt_size = rtp_dest_state[d].pkt_size;
         }
+    }
+    tx->multicast = tx->mcast_active && tier == LCD_CAMERA_TIER_FULL;
+#ifdef CONFIG_RTSP_NACK_ENABLE
+    // 分层没有单播 UDP 会话时释放其历史环中的帧引用 (历史环只在发送任务内访问)
+    rtp_history_t *history = &rtp_history[tier];
+    if (tx->ucast_udp == 0 && history->frame_count > 0) {
+        rtp_history_clear(history);
+    }
+#endif
+    if ((tx->ucast_udp + tx->ucast_tcp == 0 && !tx->multicast) || frame->len < 2) return false;
+
+    // 同一帧内所有分包共用采集时刻换算的时间戳，丢帧时时间轴照常推进
+    tx->seq = tier_seq[tier];
+    tx->rtp_timestamp = rtp_ts_from_us(frame->timestamp_us);
+
+    // 同一次采集的各分层只算一个源帧
+    if (frame->seq != last_capture_seq) {
+        stat_src.frames_in++;
+        last_capture_seq = frame->seq;
+    }
+    rtsp_stats_log(start_us / 1000);
+
+    if (frame->buf[0] != 0xFF || frame->buf[1] != 0xD8) {
+        ESP_LOGW(TAG, "Invalid JPEG header");
+        rtsp_stats_drop_frame(tier, tx->multicast, RTSP_DROP_INVALID);
+        rtsp_stats_flush_frame();
+        return false;
+    }
+
+    // 分辨率变化会使 SDP 缓存失效，下次 DESCRIBE 时重建
+    stream_width[tier] = frame->width;
+    stream_height[tier] = frame->height;
+
+    rtcp_drain(rtp_pkt_buf);    // 先处理上一帧积累的 RR/NACK
+
+    // 包长按会话各自的 RR 调整，但同一分层的输出共用一个序号空间与重传历史，只能按一种包长打包:
+    // 有 UDP 会话时取其中最小者 (TCP 会话随之共用)，只有 TCP 时用大块，组播固定按 MTU;
+    // 不同分层互不影响，丢包的会话也不会把同分层的包长推高
+    size_t pkt_size = tx->ucast_udp ? udp_pkt_size
+                                    : (tx->ucast_tcp ? RTP_TCP_PACKET_SIZE : rtp_udp_packet_size_max());
+    if (tx->multicast && pkt_size > rtp_udp_packet_size_max()) pkt_size = rtp_udp_packet_size_max();
+    tx->max_payload = pkt_size - RTP_PKT_HDR_SIZE;
+    stream_pkt_size[tier] = (uint16_t)pkt_size;
+
+    // 准入: 存在积压且 (预估发送耗时 + 积压) 超出预算时整帧跳过，跳过一帧即让出一个帧间隔
+    size_t frame_pkts = (est_len + tx->max_payload - 1) / tx->max_payload;
+    uint32_t est_send_us = pkt_send_us_avg * frame_pkts;
+    if (send_backlog_us > 0 && est_send_us + send_backlog_us > RTP_FRAME_TIMEOUT_US) {
+        ESP_LOGD(TAG, "Skip frame: est %uus + backlog %uus > %dus",
+                 (unsigned int)est_send_us, (unsigned int)send_backlog_us, RTP_FRAME_TIMEOUT_US);
+        rtsp_stats_drop_frame(tier, tx->multicast, RTSP_DROP_ADMISSION);
+        rtsp_stats_flush_frame();
+        send_backlog_us = 0;
+        return false;
+    }
+
+#ifdef CONFIG_RTSP_NACK_ENABLE
+    tx->keep_history = tx->ucast_udp > 0;
+    if (tx->keep_history) {
+        rtp_history_begin_frame(history, frame);
+    }
+#endif
+
+    tx->copy_body = true;
+#if defined(CONFIG_RTSP_UDP_BATCH_ENABLE) && !defined(CONFIG_RTSP_FEC_ENABLE)
+    // 批量发送直接以帧缓冲区为负载入队，只有逐包发送与 FEC 编码需要拼出连续包
+    tx->copy_body = tx->ucast_tcp > 0 || (tx->ucast_udp > 0 && !ucast_batch_ok);
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    tx->copy_body = tx->copy_body || (tx->multicast && !mcast_batch_ok);
+#endif
+#endif
+    return true;
+}
+
+// 提交已入队的包; 单播包数已在入队时按会话计入，组播按批量计数并入
+static void rtp_frame_commit(void) {
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+    bool batch_fatal = false;
+    if (ucast_batch_ok) {
+        rtp_batch_commit(&ucast_batch, &batch_fatal, &stat_ubatch, rtp_dest_batch_drop);
+        ucast_batch.media_sent = 0;
+        ucast_batch.media_octets = 0;
+    }
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    if (mcast_batch_ok) {
+        rtp_batch_commit(&mcast_batch, &batch_fatal, &stat_mcast, NULL);
+        rtp_mcast.sent_packets += mcast_batch.media_sent;
+        rtp_mcast.sent_octets += mcast_batch.media_octets;
+        stat_mcast.packets += mcast_batch.media_sent;
+        mcast_batch.media_sent = 0;
+        mcast_batch.media_octets = 0;
+    }
+#endif
+#endif
+}
+
+// 把 frame->buf 中已就绪的数据打包发出; 帧未结束 (!done) 时只发满包且至少留下一个字节，
+// 保证帧的最后一个包在结束时才发出并带 marker
+static void rtp_frame_packets(rtp_frame_tx_t *tx, bool done) {
+    lcd_camera_frame_t *frame = tx->frame;
+    const uint8_t *jpeg = frame->buf;
+    size_t len = frame->len;
+    uint8_t tier = tx->tier;
+    uint16_t seq = tx->seq;
+    static uint32_t ssrc = RTP_SSRC;
+    int64_t t0 = esp_timer_get_time();
+#ifdef CONFIG_RTSP_NACK_ENABLE
+    rtp_history_t *history = &rtp_history[tier];
+#endif
+#ifdef CONFIG_RTSP_FEC_ENABLE
+    rtp_fec_encoder_t *fec = &fec_encoder[tier];
+#endif
 
-        size_t chunk = (len - offset > RTP_MAX_PAYLOAD) ? RTP_MAX_PAYLOAD : (len - offset);
+    while (!tx->aborted && tx->offset < len && (done || len - tx->offset > tx->max_payload)) {
+        size_t offset = tx->offset;
+        size_t chunk = (len - offset > tx->max_payload) ? tx->max_payload : (len - offset);
+        bool last = done && offset + chunk >= len;
         int i = 0;
 
         // RTP Header
         rtp_pkt_buf[i++] = 0x80;
-        rtp_pkt_buf[i++] = ((offset + chunk >= len) ? 0x80 : 0x00) | RTP_PAYLOAD_TYPE_MJPEG;
+        rtp_pkt_buf[i++] = (last ? 0x80 : 0x00) | RTP_PAYLOAD_TYPE_MJPEG;
         rtp_pkt_buf[i++] = (seq >> 8) & 0xFF; rtp_pkt_buf[i++] = seq & 0xFF;
-        rtp_pkt_buf[i++] = (rtp_timestamp >> 24) & 0xFF;
-        rtp_pkt_buf[i++] = (rtp_timestamp >> 16) & 0xFF;
-        rtp_pkt_buf[i++] = (rtp_timestamp >> 8) & 0xFF;
-        rtp_pkt_buf[i++] = rtp_timestamp & 0xFF;
+        rtp_pkt_buf[i++] = (tx->rtp_timestamp >> 24) & 0xFF;
+        rtp_pkt_buf[i++] = (tx->rtp_timestamp >> 16) & 0xFF;
+        rtp_pkt_buf[i++] = (tx->rtp_timestamp >> 8) & 0xFF;
+        rtp_pkt_buf[i++] = tx->rtp_timestamp & 0xFF;
         rtp_pkt_buf[i++] = (ssrc >> 24) & 0xFF; rtp_pkt_buf[i++] = (ssrc >> 16) & 0xFF;
         rtp_pkt_buf[i++] = (ssrc >> 8) & 0xFF; rtp_pkt_buf[i++] = ssrc & 0xFF;
 
@@ -500,85 +1860,295 @@ void rtsp_server_send_frame(uint8_t *jpeg, size_t len, uint8_t type) {
         rtp_pkt_buf[i++] = (offset >> 16) & 0xFF;
         rtp_pkt_buf[i++] = (offset >> 8) & 0xFF;
         rtp_pkt_buf[i++] = offset & 0xFF;
-        rtp_pkt_buf[i++] = type;
+        rtp_pkt_buf[i++] = tx->type;
         rtp_pkt_buf[i++] = JPEG_QUALITY;
-        rtp_pkt_buf[i++] = DISPLAY_H_RES;
-        rtp_pkt_buf[i++] = DISPLAY_V_RES;
+        rtp_pkt_buf[i++] = frame->width / 8;
+        rtp_pkt_buf[i++] = frame->height / 8;
 
-        memcpy(rtp_pkt_buf + i, jpeg + offset, chunk);
+        bool copied = tx->copy_body;
+        if (tx->copy_body) memcpy(rtp_pkt_buf + i, jpeg + offset, chunk);
         i += chunk;
 
-        int retry = 0;
-        int delay = RTP_RETRY_DELAY_MS;
-        int sent = -1;
-        bool fatal = false;
-
-        while (sent < 0 && retry <= RTP_RETRY_LIMIT && !fatal) {
-            if (use_tcp_transport) {
-                uint8_t tcp_pkt[4 + i];
-                tcp_pkt[0] = '$'; tcp_pkt[1] = 0x00;
-                tcp_pkt[2] = (i >> 8) & 0xFF; tcp_pkt[3] = i & 0xFF;
-                memcpy(tcp_pkt + 4, rtp_pkt_buf, i);
-                sent = send(rtsp_client_socket, tcp_pkt, i + 4, 0);
-            } else {
-                sent = sendto(udp_sock, rtp_pkt_buf, i, 0,
-                              (struct sockaddr *)&udp_client_addr, sizeof(udp_client_addr));
-            }
+#ifdef CONFIG_RTSP_NACK_ENABLE
+        // 发送失败的包同样入环，客户端 NACK 后仍可补发
+        if (tx->keep_history) {
+            rtp_history_put(history, seq, rtp_pkt_buf, frame, offset, chunk);
+        }
+#endif
 
-            if (sent < 0) {
-                int err = errno;
-                if (err == EAGAIN || err == ENOMEM || err == ENOBUFS) {
-                    vTaskDelay(pdMS_TO_TICKS(delay));
-                    retry++;
-                    delay = (delay * 2 > 50) ? 50 : delay * 2;
-                    if (retry > RTP_RETRY_LIMIT) break;
+        bool unicast = false;
+        for (int d = 0; d < RTSP_MAX_CLIENTS; d++) {
+            if (!rtp_dest_in_tier(d, tier) || rtp_dest_state[d].failed) continue;
+            rtp_dest_send(d, rtp_pkt_buf, i, seq, jpeg + offset, chunk, offset == 0, &copied);
+            if (!rtp_dest_state[d].failed) unicast = true;
+        }
+        rtp_put_seq(rtp_pkt_buf, seq);     // 组播与 FEC 使用分层自身的序号
+
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+        if (tx->multicast) {
+            bool queued = false;
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+            if (mcast_batch_ok) {
+                queued = rtp_batch_queue(&mcast_batch, &rtp_mcast.rtp_addr, rtp_pkt_buf, RTP_PKT_HDR_SIZE,
+                                         jpeg + offset, chunk, RTP_BATCH_F_MEDIA, &stat_mcast, NULL);
+            }
+#endif
+            if (!queued) {
+                if (!copied) {
+                    memcpy(rtp_pkt_buf + RTP_PKT_HDR_SIZE, jpeg + offset, chunk);
+                    copied = true;
+                }
+                bool fatal = false;
+                int sent = rtp_send_packet(rtp_mcast.rtp_sock, rtp_pkt_buf, i, &rtp_mcast.rtp_addr, &fatal,
+                                           &stat_mcast);
+                if (sent < 0) {
+                    stat_mcast.drops[RTSP_DROP_PKT_SEND]++;     // 组播不整帧放弃，失败的包都算中途丢失
                 } else {
-                    fatal = true;
-                    rtsp_streaming = false;
-                    ESP_LOGE(TAG, "Fatal send error: %d", err);
-                    break;
+                    rtp_mcast.sent_packets++;
+                    rtp_mcast.sent_octets += i - RTP_HEADER_SIZE;
+                    stat_mcast.packets++;
                 }
             }
         }
+#endif
 
-        if (sent < 0) {
-            error_count++;
-            if (offset == 0) {
-                frame_failed = true; // 首包失败，重试或丢弃
-                vTaskDelay(pdMS_TO_TICKS(5));
-                break;
-            } else {
-                // 非首包失败，直接跳过
-                ESP_LOGW(TAG, "RTP packet lost, continue remaining packets");
+        if (!unicast && !tx->multicast) {
+            tx->failed = offset == 0;
+            if (tx->failed) vTaskDelay(pdMS_TO_TICKS(5));
+            tx->aborted = true;
+            break;
+        }
+
+#ifdef CONFIG_RTSP_FEC_ENABLE
+        // 组满或帧尾时产出 FEC 包，发往订阅了 fec 轨道的目的地
+        int fec_len = rtp_fec_add(fec, rtp_pkt_buf, i, last, fec_pkt_buf, sizeof(fec_pkt_buf));
+        if (fec_len > 0) {
+            // FEC 包跟在所保护的媒体包之后入同一队列，保持发送顺序;
+            // FEC 序号与 SN base 按目的地偏移改写，发完后恢复
+            bool fatal = false;
+            uint16_t fec_seq = rtp_get_seq(fec_pkt_buf);
+            uint16_t sn_base = rtp_get_seq(fec_pkt_buf + RTP_HEADER_SIZE);
+            for (int d = 0; d < RTSP_MAX_CLIENTS; d++) {
+                const rtp_dest_t *dst = &rtp_dests[d];
+                rtp_dest_state_t *ds = &rtp_dest_state[d];
+                if (!rtp_dest_in_tier(d, tier) || ds->failed || dst->tcp_sock >= 0 || dst->fec_port == 0) continue;
+                rtp_put_seq(fec_pkt_buf, fec_seq + ds->fec_seq_offset);
+                rtp_put_seq(fec_pkt_buf + RTP_HEADER_SIZE, sn_base + ds->seq_offset);
+                struct sockaddr_in fec_addr = dst->rtp_addr;
+                fec_addr.sin_port = htons(dst->fec_port);
+                bool queued = false;
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+                queued = ucast_batch_ok && rtp_batch_queue(&ucast_batch, &fec_addr, NULL, 0, fec_pkt_buf, fec_len,
+                                                           RTP_BATCH_F_COPY, &stat_ubatch, rtp_dest_batch_drop);
+#endif
+                if (queued || rtp_send_packet(udp_sock, fec_pkt_buf, fec_len, &fec_addr, &fatal, &ds->stat) > 0) {
+                    ds->stat.fec_packets++;
+                }
             }
-        } else {
-            packet_count++;
+            rtp_put_seq(fec_pkt_buf, fec_seq);
+            rtp_put_seq(fec_pkt_buf + RTP_HEADER_SIZE, sn_base);
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+            if (tx->multicast) {
+                struct sockaddr_in fec_addr = rtp_mcast.rtp_addr;
+                fec_addr.sin_port = htons(RTP_MCAST_PORT + 2);
+                bool queued = false;
+#ifdef CONFIG_RTSP_UDP_BATCH_ENABLE
+                queued = mcast_batch_ok && rtp_batch_queue(&mcast_batch, &fec_addr, NULL, 0, fec_pkt_buf, fec_len,
+                                                           RTP_BATCH_F_COPY, &stat_mcast, NULL);
+#endif
+                if (queued || rtp_send_packet(rtp_mcast.rtp_sock, fec_pkt_buf, fec_len, &fec_addr, &fatal,
+                                              &stat_mcast) > 0) {
+                    stat_mcast.fec_packets++;
+                }
+            }
+#endif
         }
+#endif
 
         seq++;
-        offset += chunk;
+        tx->offset += chunk;
+        tx->sent_pkts++;
     }
+    // 帧未结束时立即提交本段的包，使发送与后续编码重叠
+    if (!done && seq != tx->seq) rtp_frame_commit();
+    tx->seq = seq;
+    tier_seq[tier] = seq;
+    tx->send_us += (uint32_t)(esp_timer_get_time() - t0);
+}
 
-    if (!frame_failed) {
-        vTaskDelay(pdMS_TO_TICKS(1));
+// 结束一帧: 提交批量队列、帧级统计、准入参数与 RTCP SR，调用方持有 rtp_dest_lock
+static void rtp_frame_end(rtp_frame_tx_t *tx) {
+    size_t len = tx->frame->len;
+    int64_t t0 = esp_timer_get_time();
+
+    rtp_frame_commit();
+#ifdef CONFIG_RTSP_NACK_ENABLE
+    if (tx->keep_history) {
+        rtp_history_end_frame(&rtp_history[tx->tier], tx->frame);
     }
+#endif
 
-    // RTCP SR 每5秒发送
-    static uint64_t last_rtcp_us = 0;
+    // 更新单包耗时与积压，供下一帧准入
     uint64_t now_us = esp_timer_get_time();
+    uint32_t frame_send_us = tx->send_us + (uint32_t)(now_us - t0);
+    stat_src.frame_us_total += frame_send_us;
+    stream_hist_observe(&stat_src.frame_hist, frame_send_us);
+    if (tx->sent_pkts > 0) {
+        // 采集到最后一个包交给协议栈的时延 (glass-to-wire)
+        rtsp_stats_wire_latency(&stat_src, (uint32_t)((int64_t)now_us - tx->frame->timestamp_us));
+    }
+    // 帧级计数: 有包发出的输出才算发出一帧
+    for (int d = 0; d < RTSP_MAX_CLIENTS; d++) {
+        rtp_dest_state_t *ds = &rtp_dest_state[d];
+        if (ds->stat.packets > 0) {
+            ds->stat.frames++;
+            ds->stat.bytes += len;
+        }
+    }
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+    if (stat_mcast.packets > 0) {
+        stat_mcast.frames++;
+        stat_mcast.bytes += len;
+    }
+#endif
+    rtsp_stats_flush_frame();
+    stream_last_len[tx->tier] = len;
+    if (tx->sent_pkts > 0) {
+        uint32_t pkt_us = frame_send_us / tx->sent_pkts;
+        pkt_send_us_avg = pkt_send_us_avg ? (pkt_send_us_avg * 7 + pkt_us) / 8 : pkt_us;
+    }
+    send_backlog_us = frame_send_us > FRAME_INTERVAL_US ? frame_send_us - FRAME_INTERVAL_US : 0;
+
+    // RTCP SR 每5秒发送 (不论本帧属于哪个分层)，单播按会话各自的发送计数
+    static uint64_t last_rtcp_us = 0;
     if (now_us - last_rtcp_us > 5000000) {
-        send_rtcp_sr_report(now_us / 1000, rtp_timestamp);
+        for (int d = 0; d < RTSP_MAX_CLIENTS; d++) {
+            const rtp_dest_t *dst = &rtp_dests[d];
+            if (dst->session_id == 0 || dst->session_id != rtp_dest_state[d].session_id || dst->tcp_sock >= 0) {
+                continue;
+            }
+            struct sockaddr_in rtcp_addr = dst->rtp_addr;
+            rtcp_addr.sin_port = htons(ntohs(dst->rtp_addr.sin_port) + 1); // RTCP端口
+            send_rtcp_sr_report(udp_rtcp_sock, &rtcp_addr, (int64_t)now_us,
+                                rtp_dest_state[d].sent_packets, rtp_dest_state[d].sent_octets);
+        }
+#ifdef CONFIG_RTSP_MULTICAST_ENABLE
+        if (tx->mcast_active) {
+            send_rtcp_sr_report(rtp_mcast.rtcp_sock, &rtp_mcast.rtcp_addr, (int64_t)now_us,
+                                rtp_mcast.sent_packets, rtp_mcast.sent_octets);
+        }
+#endif
         last_rtcp_us = now_us;
     }
+}
 
-    // 固定帧率控制 15 FPS
-    uint64_t frame_used_us = esp_timer_get_time() - frame_start_us;
+// 源帧字节在编码完成后计入 (边编码边发送时开始发送时尚不知道长度)
+static void rtp_frame_source_bytes(const lcd_camera_frame_t *frame) {
+    stat_src.bytes_in += frame->len;
+    if (frame->tier < RTSP_TIERS) stream_tier_bytes[frame->tier] += frame->len;
+}
+
+// 同一次采集的各分层共用一个帧间隔
+static uint32_t capture_seq = UINT32_MAX;
+static uint64_t capture_start_us = 0;
+
+static void rtsp_capture_track(const lcd_camera_frame_t *frame, uint64_t now_us) {
+    if (frame->seq != capture_seq) {
+        capture_seq = frame->seq;
+        capture_start_us = now_us;
+    }
+}
+
+// 固定帧率控制: 同一次采集的分层按编号依次到达，发完最后一个订阅的分层后按整次采集的耗时等待
+static void rtsp_frame_pace(const lcd_camera_frame_t *frame, bool failed) {
+    if (!failed) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    if (rtsp_stream_tiers_get() >> (frame->tier + 1)) return;
+    uint64_t frame_used_us = esp_timer_get_time() - capture_start_us;
     int wait_ms = (int)((FRAME_INTERVAL_US > frame_used_us) ? (FRAME_INTERVAL_US - frame_used_us) / 1000 : 0);
     if (wait_ms > 0) vTaskDelay(pdMS_TO_TICKS(wait_ms));
 }
 
+void rtsp_server_send_frame(lcd_camera_frame_t *frame, uint8_t type) {
+    if (rtp_dest_lock == NULL) return;
+
+    // 发送期间持锁，事件循环撤下的目的地 (及其 TCP 连接) 不会在帧中途失效
+    uint64_t frame_start_us = esp_timer_get_time();
+    rtsp_capture_track(frame, frame_start_us);
+    rtp_frame_tx_t tx;
+    xSemaphoreTake(rtp_dest_lock, portMAX_DELAY);
+    bool sent = rtp_frame_begin(&tx, frame, type, frame_start_us, frame->len);
+    if (sent) {
+        rtp_frame_packets(&tx, true);
+        rtp_frame_end(&tx);
+    }
+    xSemaphoreGive(rtp_dest_lock);
+    rtp_frame_source_bytes(frame);
+    if (sent) rtsp_frame_pace(frame, tx.failed);
+}
+
+void rtsp_server_send_chunk(lcd_camera_frame_t *frame, uint8_t type, bool done) {
+    static rtp_frame_tx_t chunk_tx;
+    static bool chunk_open = false;     // 已开始本帧
+    static bool chunk_sending = false;  // 本帧通过准入
+    if (rtp_dest_lock == NULL) return;
+    if (!chunk_open && frame->len < 2 && !done) return;    // 等到 SOI 再做合法性检查与准入
+
+    // 只在每段打包发送期间持锁，编码期间事件循环的 PLAY/TEARDOWN 不必等待;
+    // 帧内只发给帧开始时已在输出的会话 (见 rtp_dest_in_tier)，中途撤下的会话停止接收
+    uint64_t frame_start_us = esp_timer_get_time();
+    xSemaphoreTake(rtp_dest_lock, portMAX_DELAY);
+    if (!chunk_open) {
+        rtsp_capture_track(frame, frame_start_us);
+        chunk_open = true;
+        size_t est_len = frame->tier < RTSP_TIERS ? stream_last_len[frame->tier] : 0;
+        chunk_sending = rtp_frame_begin(&chunk_tx, frame, type, frame_start_us,
+                                        est_len > frame->len ? est_len : frame->len);
+    }
+    if (chunk_sending) rtp_frame_packets(&chunk_tx, done);
+    if (!done) {
+        xSemaphoreGive(rtp_dest_lock);
+        return;
+    }
+
+    if (chunk_sending && frame->len == 0) {
+        // 编码中途失败: 已发出的包没有 marker，接收端收不到帧尾，按残缺帧丢弃;
+        // 已有包发出时记为整帧中途放弃，尚未发包时才算非法帧
+        rtp_frame_commit();
+        rtsp_stats_drop_frame(chunk_tx.tier, chunk_tx.multicast,
+                              chunk_tx.sent_pkts > 0 ? RTSP_DROP_SEND_ABORT : RTSP_DROP_INVALID);
+        rtsp_stats_flush_frame();
+        chunk_sending = false;
+    } else if (chunk_sending) {
+        rtp_frame_end(&chunk_tx);
+    }
+    xSemaphoreGive(rtp_dest_lock);
+    chunk_open = false;
+    rtp_frame_source_bytes(frame);
+    if (chunk_sending) rtsp_frame_pace(frame, chunk_tx.failed);
+}
+
 void rtsp_server_start(void) {
-    xTaskCreatePinnedToCore(rtsp_server_task, "rtsp_server", 8192, NULL, 5, NULL, 1);
+    rtp_ts_base = esp_random();
+    for (int t = 0; t < RTSP_TIERS; t++) {
+#ifdef CONFIG_RTSP_FEC_ENABLE
+        rtp_fec_init(&fec_encoder[t], RTP_FEC_GROUP_SIZE, RTP_SSRC);
+#endif
+#ifdef CONFIG_RTSP_NACK_ENABLE
+        // 1/4 分层的帧约为全分辨率的 1/4，历史预算按比例分配
+        rtp_history_init(&rtp_history[t], t == LCD_CAMERA_TIER_FULL ? CONFIG_RTSP_NACK_HISTORY_BYTES
+                                                                    : CONFIG_RTSP_NACK_HISTORY_BYTES / 4);
+#endif
+    }
+    rtcp_queue = xQueueCreate(RTCP_QUEUE_LEN, sizeof(rtcp_msg_t));
+    rtp_dest_lock = xSemaphoreCreateMutex();
+    for (int i = 0; i < RTSP_MAX_CLIENTS; i++) {
+        rtp_dests[i].tcp_sock = -1;
+        rtp_dest_state[i].stat_slot = -1;
+    }
+    // 请求缓冲在客户端表中，任务栈只需容纳响应与 SDP
+    xTaskCreatePinnedToCore(rtsp_server_task, "rtsp_server", 6144, NULL, 5, NULL, 1);
 }
 
 void rtsp_server_on_ip_assigned(uint32_t client_ip) {
@@ -0,0 +1,366 @@
+// rtsp_stats.c
+#include "rtsp_stats.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "lwip/inet.h"
+#include "shell.h"
+
+#define RTSP_STATS_TEXT_BUF_SIZE  2048
+#define RTSP_STATS_READ_SPINS     8    // 写端被抢占时，读端自旋若干次后让出 CPU
+
+typedef struct {
+    volatile uint32_t seq;             // 奇数表示写入中
+    rtsp_stats_session_t data;
+} rtsp_stats_slot_t;
+
+static rtsp_stats_slot_t stats_total;
+static rtsp_stats_slot_t stats_sessions[RTSP_STATS_MAX_SESSIONS];
+
+static const char *const drop_names[RTSP_DROP_MAX] = {
+    "admission", "invalid", "send_abort", "pkt_send",
+};
+static const char *const transport_names[] = { "udp", "tcp", "mcast" };
+
+static inline void slot_write_begin(rtsp_stats_slot_t *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void slot_write_end(rtsp_stats_slot_t *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void slot_read(const rtsp_stats_slot_t *s, rtsp_stats_session_t *out) {
+    int spins = 0;
+    for (;;) {
+        uint32_t begin = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (!(begin & 1)) {
+            memcpy(out, (const void *)&s->data, sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == begin) return;
+        }
+        if (++spins >= RTSP_STATS_READ_SPINS) {
+            vTaskDelay(1);
+            spins = 0;
+        }
+    }
+}
+
+static void counters_add(rtsp_stats_counters_t *c, const rtsp_stats_counters_t *d, bool total) {
+    c->frames += d->frames;
+    c->bytes += d->bytes;
+    c->packets += d->packets;
+    c->fec_packets += d->fec_packets;
+    c->rtx_packets += d->rtx_packets;
+    c->retries += d->retries;
+    for (int i = 0; i < RTSP_DROP_MAX; i++) c->drops[i] += d->drops[i];
+    c->send_calls += d->send_calls;
+    c->send_us_total += d->send_us_total;
+    if (d->send_us_max > c->send_us_max) c->send_us_max = d->send_us_max;
+    if (total) {
+        c->frames_in += d->frames_in;
+        c->bytes_in += d->bytes_in;
+        c->frame_us_total += d->frame_us_total;
+        c->wire_frames += d->wire_frames;
+        c->wire_us_total += d->wire_us_total;
+        if (d->wire_us_max > c->wire_us_max) c->wire_us_max = d->wire_us_max;
+        stream_hist_merge(&c->frame_hist, &d->frame_hist);
+        stream_hist_merge(&c->wire_hist, &d->wire_hist);
+    }
+}
+
+int rtsp_stats_session_open(uint32_t session_id, rtsp_stats_transport_t transport,
+                            uint32_t peer_ip, uint16_t peer_port) {
+    // 优先空槽，其次最早结束的槽，全部活跃时复用最早开始的
+    int slot = -1;
+    for (int i = 0; i < RTSP_STATS_MAX_SESSIONS; i++) {
+        const rtsp_stats_session_t *d = &stats_sessions[i].data;
+        if (d->session_id == 0) {
+            slot = i;
+            break;
+        }
+        if (slot < 0) {
+            slot = i;
+            continue;
+        }
+        const rtsp_stats_session_t *cur = &stats_sessions[slot].data;
+        if (cur->active && !d->active) {
+            slot = i;
+        } else if (cur->active == d->active &&
+                   (d->active ? d->start_us < cur->start_us : d->end_us < cur->end_us)) {
+            slot = i;
+        }
+    }
+
+    rtsp_stats_slot_t *s = &stats_sessions[slot];
+    slot_write_begin(s);
+    memset(&s->data, 0, sizeof(s->data));
+    s->data.session_id = session_id;
+    s->data.transport = transport;
+    s->data.active = true;
+    s->data.peer_ip = peer_ip;
+    s->data.peer_port = peer_port;
+    s->data.start_us = esp_timer_get_time();
+    slot_write_end(s);
+    return slot;
+}
+
+void rtsp_stats_session_close(int slot) {
+    if (slot < 0 || slot >= RTSP_STATS_MAX_SESSIONS) return;
+    rtsp_stats_slot_t *s = &stats_sessions[slot];
+    slot_write_begin(s);
+    s->data.active = false;
+    s->data.end_us = esp_timer_get_time();
+    slot_write_end(s);
+}
+
+void rtsp_stats_session_tier(int slot, uint8_t tier) {
+    if (slot < 0 || slot >= RTSP_STATS_MAX_SESSIONS) return;
+    rtsp_stats_slot_t *s = &stats_sessions[slot];
+    slot_write_begin(s);
+    s->data.tier = tier;
+    slot_write_end(s);
+}
+
+void rtsp_stats_commit(int slot, const rtsp_stats_counters_t *delta) {
+    if (slot >= 0 && slot < RTSP_STATS_MAX_SESSIONS) {
+        rtsp_stats_slot_t *s = &stats_sessions[slot];
+        slot_write_begin(s);
+        counters_add(&s->data.c, delta, false);
+        slot_write_end(s);
+    }
+    slot_write_begin(&stats_total);
+    counters_add(&stats_total.data.c, delta, true);
+    slot_write_end(&stats_total);
+}
+
+void rtsp_stats_rtcp_rr(int slot, uint8_t fraction_lost, uint32_t cum_lost, uint32_t jitter) {
+    rtsp_stats_slot_t *targets[2] = { &stats_total, NULL };
+    if (slot >= 0 && slot < RTSP_STATS_MAX_SESSIONS) targets[1] = &stats_sessions[slot];
+    for (int i = 0; i < 2; i++) {
+        rtsp_stats_slot_t *s = targets[i];
+        if (!s) continue;
+        slot_write_begin(s);
+        s->data.c.rr_count++;
+        s->data.c.rr_fraction_lost = fraction_lost;
+        s->data.c.rr_cum_lost = cum_lost;
+        s->data.c.rr_jitter = jitter;
+        slot_write_end(s);
+    }
+}
+
+const rtsp_stats_counters_t *rtsp_stats_total(void) {
+    return &stats_total.data.c;
+}
+
+const rtsp_stats_counters_t *rtsp_stats_session(int slot) {
+    if (slot < 0 || slot >= RTSP_STATS_MAX_SESSIONS) return NULL;
+    return &stats_sessions[slot].data.c;
+}
+
+void rtsp_stats_snapshot(rtsp_stats_snapshot_t *out) {
+    out->now_us = esp_timer_get_time();
+    slot_read(&stats_total, &out->total);
+    for (int i = 0; i < RTSP_STATS_MAX_SESSIONS; i++) {
+        slot_read(&stats_sessions[i], &out->sessions[i]);
+    }
+}
+
+/* ---------------- 渲染 ---------------- */
+
+static void append(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+    if (*len >= size) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *len, size - *len, fmt, ap);
+    va_end(ap);
+    if (n > 0) *len = (*len + n < size) ? *len + n : size - 1;
+}
+
+static uint32_t send_us_avg(const rtsp_stats_counters_t *c) {
+    return c->send_calls ? (uint32_t)(c->send_us_total / c->send_calls) : 0;
+}
+
+static void render_counters_text(char *buf, size_t size, size_t *len, const rtsp_stats_counters_t *c) {
+    append(buf, size, len,
+           "  frames %u  bytes %llu  packets %u  fec %u  rtx %u  retries %u\r\n"
+           "  drops admission %u invalid %u send_abort %u pkt_send %u\r\n"
+           "  send calls %u  avg %u us  max %u us\r\n"
+           "  rtcp rr %u  fraction_lost %u/256  cum_lost %u  jitter %u\r\n",
+           (unsigned)c->frames, (unsigned long long)c->bytes, (unsigned)c->packets,
+           (unsigned)c->fec_packets, (unsigned)c->rtx_packets, (unsigned)c->retries,
+           (unsigned)c->drops[RTSP_DROP_ADMISSION], (unsigned)c->drops[RTSP_DROP_INVALID],
+           (unsigned)c->drops[RTSP_DROP_SEND_ABORT], (unsigned)c->drops[RTSP_DROP_PKT_SEND],
+           (unsigned)c->send_calls, (unsigned)send_us_avg(c), (unsigned)c->send_us_max,
+           (unsigned)c->rr_count, (unsigned)c->rr_fraction_lost, (unsigned)c->rr_cum_lost,
+           (unsigned)c->rr_jitter);
+}
+
+static void render_counters_json(char *buf, size_t size, size_t *len, const rtsp_stats_counters_t *c) {
+    append(buf, size, len,
+           "\"frames\":%u,\"bytes\":%llu,\"packets\":%u,\"fec_packets\":%u,\"rtx_packets\":%u,"
+           "\"retries\":%u,\"drops\":{",
+           (unsigned)c->frames, (unsigned long long)c->bytes, (unsigned)c->packets,
+           (unsigned)c->fec_packets, (unsigned)c->rtx_packets, (unsigned)c->retries);
+    for (int i = 0; i < RTSP_DROP_MAX; i++) {
+        append(buf, size, len, "%s\"%s\":%u", i ? "," : "", drop_names[i], (unsigned)c->drops[i]);
+    }
+    append(buf, size, len,
+           "},\"send_calls\":%u,\"send_us_avg\":%u,\"send_us_max\":%u,"
+           "\"rtcp_rr\":%u,\"fraction_lost\":%u,\"cum_lost\":%u,\"jitter\":%u",
+           (unsigned)c->send_calls, (unsigned)send_us_avg(c), (unsigned)c->send_us_max,
+           (unsigned)c->rr_count, (unsigned)c->rr_fraction_lost, (unsigned)c->rr_cum_lost,
+           (unsigned)c->rr_jitter);
+}
+
+static void peer_str(const rtsp_stats_session_t *s, char *out, size_t size) {
+    struct in_addr addr = { .s_addr = s->peer_ip };
+    snprintf(out, size, "%s:%u", inet_ntoa(addr), (unsigned)s->peer_port);
+}
+
+static uint32_t session_age_ms(const rtsp_stats_session_t *s, int64_t now_us) {
+    return (uint32_t)(((s->active ? now_us : s->end_us) - s->start_us) / 1000);
+}
+
+int rtsp_stats_render_text(char *buf, size_t size) {
+    rtsp_stats_snapshot_t *snap = malloc(sizeof(*snap));
+    if (!snap || size == 0) {
+        free(snap);
+        return 0;
+    }
+    rtsp_stats_snapshot(snap);
+
+    size_t len = 0;
+    buf[0] = '\0';
+    const rtsp_stats_counters_t *t = &snap->total.c;
+    append(buf, size, &len, "RTSP total: uptime %u s, source frames %u (%llu bytes), %u us/frame send\r\n",
+           (unsigned)(snap->now_us / 1000000), (unsigned)t->frames_in, (unsigned long long)t->bytes_in,
+           (unsigned)(t->frames_in ? t->frame_us_total / t->frames_in : 0));
+    append(buf, size, &len, "  glass-to-wire: avg %u us, max %u us (%u frames)\r\n",
+           (unsigned)(t->wire_frames ? t->wire_us_total / t->wire_frames : 0), (unsigned)t->wire_us_max,
+           (unsigned)t->wire_frames);
+    render_counters_text(buf, size, &len, t);
+
+    for (int i = 0; i < RTSP_STATS_MAX_SESSIONS; i++) {
+        const rtsp_stats_session_t *s = &snap->sessions[i];
+        if (s->session_id == 0) continue;
+        char peer[24];
+        peer_str(s, peer, sizeof(peer));
+        append(buf, size, &len, "session[%d] %08X %s %s tier %u %s, %u ms\r\n",
+               i, (unsigned)s->session_id, transport_names[s->transport], peer, (unsigned)s->tier,
+               s->active ? "active" : "ended", (unsigned)session_age_ms(s, snap->now_us));
+        render_counters_text(buf, size, &len, &s->c);
+    }
+    free(snap);
+    return (int)len;
+}
+
+int rtsp_stats_render_json(char *buf, size_t size) {
+    rtsp_stats_snapshot_t *snap = malloc(sizeof(*snap));
+    if (!snap || size == 0) {
+        free(snap);
+        return 0;
+    }
+    rtsp_stats_snapshot(snap);
+
+    size_t len = 0;
+    buf[0] = '\0';
+    const rtsp_stats_counters_t *t = &snap->total.c;
+    append(buf, size, &len, "{\"uptime_ms\":%llu,\"total\":{\"frames_in\":%u,\"bytes_in\":%llu,\"frame_us_avg\":%u,",
+           (unsigned long long)(snap->now_us / 1000), (unsigned)t->frames_in, (unsigned long long)t->bytes_in,
+           (unsigned)(t->frames_in ? t->frame_us_total / t->frames_in : 0));
+    append(buf, size, &len, "\"wire_us_avg\":%u,\"wire_us_max\":%u,",
+           (unsigned)(t->wire_frames ? t->wire_us_total / t->wire_frames : 0), (unsigned)t->wire_us_max);
+    render_counters_json(buf, size, &len, t);
+    append(buf, size, &len, "},\"sessions\":[");
+
+    bool first = true;
+    for (int i = 0; i < RTSP_STATS_MAX_SESSIONS; i++) {
+        const rtsp_stats_session_t *s = &snap->sessions[i];
+        if (s->session_id == 0) continue;
+        char peer[24];
+        peer_str(s, peer, sizeof(peer));
+        append(buf, size, &len, "%s{\"slot\":%d,\"id\":\"%08X\",\"transport\":\"%s\",\"peer\":\"%s\","
+               "\"tier\":%u,\"active\":%s,\"age_ms\":%u,",
+               first ? "" : ",", i, (unsigned)s->session_id, transport_names[s->transport], peer, (unsigned)s->tier,
+               s->active ? "true" : "false", (unsigned)session_age_ms(s, snap->now_us));
+        render_counters_json(buf, size, &len, &s->c);
+        append(buf, size, &len, "}");
+        first = false;
+    }
+    append(buf, size, &len, "]}");
+    free(snap);
+    return (int)len;
+}
+
+int rtsp_stats_render_metrics(char *buf, size_t size) {
+    static rtsp_stats_snapshot_t snap;
+    if (size == 0) return 0;
+    rtsp_stats_snapshot(&snap);
+
+    size_t len = 0;
+    buf[0] = '\0';
+    const rtsp_stats_counters_t *t = &snap.total.c;
+    stream_metrics_type(buf, size, &len, "camera_rtsp_source_frames_total", "counter");
+    stream_metrics_append(buf, size, &len, "camera_rtsp_source_frames_total %u\n", (unsigned)t->frames_in);
+    stream_metrics_type(buf, size, &len, "camera_rtsp_source_bytes_total", "counter");
+    stream_metrics_append(buf, size, &len, "camera_rtsp_source_bytes_total %llu\n", (unsigned long long)t->bytes_in);
+    stream_metrics_type(buf, size, &len, "camera_rtsp_frame_send_seconds", "histogram");
+    stream_hist_render(buf, size, &len, "camera_rtsp_frame_send_seconds", NULL, &t->frame_hist);
+    stream_metrics_type(buf, size, &len, "camera_rtsp_glass_to_wire_seconds", "histogram");
+    stream_hist_render(buf, size, &len, "camera_rtsp_glass_to_wire_seconds", NULL, &t->wire_hist);
+    stream_metrics_type(buf, size, &len, "camera_rtsp_frames_dropped_total", "counter");
+    for (int i = 0; i < RTSP_DROP_MAX; i++) {
+        stream_metrics_append(buf, size, &len, "camera_rtsp_frames_dropped_total{reason=\"%s\"} %u\n",
+                              drop_names[i], (unsigned)t->drops[i]);
+    }
+
+    // 每个会话槽位一组样本 (含已结束、尚未复用的会话); 会话号、传输方式与对端只放在 _info 上，
+    // 其余样本只带 slot 标签以控制输出长度
+    stream_metrics_type(buf, size, &len, "camera_rtsp_session_info", "gauge");
+    for (int i = 0; i < RTSP_STATS_MAX_SESSIONS; i++) {
+        const rtsp_stats_session_t *s = &snap.sessions[i];
+        if (s->session_id == 0) continue;
+        char peer[24];
+        peer_str(s, peer, sizeof(peer));
+        stream_metrics_append(buf, size, &len,
+            "camera_rtsp_session_info{slot=\"%d\",session=\"%08X\",transport=\"%s\",tier=\"%u\",peer=\"%s\"} 1\n",
+            i, (unsigned)s->session_id, transport_names[s->transport], (unsigned)s->tier, peer);
+    }
+#define SESSION_METRIC(name, type, fmt, expr)                                                   \
+    do {                                                                                        \
+        stream_metrics_type(buf, size, &len, name, type);                                       \
+        for (int i = 0; i < RTSP_STATS_MAX_SESSIONS; i++) {                                     \
+            const rtsp_stats_session_t *s = &snap.sessions[i];                                  \
+            if (s->session_id == 0) continue;                                                   \
+            stream_metrics_append(buf, size, &len, name "{slot=\"%d\"} " fmt "\n", i, (expr));  \
+        }                                                                                       \
+    } while (0)
+    SESSION_METRIC("camera_rtsp_session_active", "gauge", "%d", s->active ? 1 : 0);
+    SESSION_METRIC("camera_rtsp_session_frames_total", "counter", "%u", (unsigned)s->c.frames);
+    SESSION_METRIC("camera_rtsp_session_bytes_total", "counter", "%llu", (unsigned long long)s->c.bytes);
+    SESSION_METRIC("camera_rtsp_session_packets_total", "counter", "%u", (unsigned)s->c.packets);
+    SESSION_METRIC("camera_rtsp_session_rtx_packets_total", "counter", "%u", (unsigned)s->c.rtx_packets);
+    SESSION_METRIC("camera_rtsp_session_send_retries_total", "counter", "%u", (unsigned)s->c.retries);
+    SESSION_METRIC("camera_rtsp_session_fraction_lost", "gauge", "%.4f", s->c.rr_fraction_lost / 256.0);
+    SESSION_METRIC("camera_rtsp_session_cumulative_lost", "gauge", "%u", (unsigned)s->c.rr_cum_lost);
+    SESSION_METRIC("camera_rtsp_session_jitter_seconds", "gauge", "%.6f", s->c.rr_jitter / 90000.0);
+#undef SESSION_METRIC
+    return (int)len;
+}
+
+static int rtsp_stats_cmd(void) {
+    char *buf = malloc(RTSP_STATS_TEXT_BUF_SIZE);
+    if (!buf) return -1;
+    rtsp_stats_render_text(buf, RTSP_STATS_TEXT_BUF_SIZE);
+    shellWriteString(shellGetCurrent(), buf);
+    free(buf);
+    return 0;
+}
+SHELL_EXPORT_CMD(SHELL_CMD_PERMISSION(0)|SHELL_CMD_TYPE(SHELL_TYPE_CMD_FUNC)|SHELL_CMD_DISABLE_RETURN,
+rtsp_stats, rtsp_stats_cmd, show rtsp streaming statistics);
@@ -0,0 +1,44 @@
+// stream_metrics.h
+// 推流各阶段耗时直方图，以及渲染 Prometheus 文本格式 (text/plain; version=0.0.4) 的辅助函数
+// 渲染只写调用方提供的缓冲区，不分配内存; 缓冲区不足时截断
+#ifndef __STREAM_METRICS_H__
+#define __STREAM_METRICS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_METRICS_CONTENT_TYPE "text/plain; version=0.0.4"
+#define STREAM_HIST_BUCKETS         10          // 1 ms ~ 1 s，另加 +Inf
+
+typedef struct {
+    uint32_t buckets[STREAM_HIST_BUCKETS + 1];  // 各区间计数 (非累计)，最后一个为 +Inf
+    uint32_t count;
+    uint64_t sum_us;
+} stream_hist_t;
+
+// 记录一次耗时，可多任务并发调用
+void stream_hist_observe(stream_hist_t *h, uint32_t us);
+
+// dst += src，用于把单帧增量并入累计值 (调用方保证 dst 单写者)
+void stream_hist_merge(stream_hist_t *dst, const stream_hist_t *src);
+
+// 追加格式化文本，len 为已写入长度
+void stream_metrics_append(char *buf, size_t size, size_t *len, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+// 输出 "# TYPE name type" 行，type 为 counter/gauge/histogram
+void stream_metrics_type(char *buf, size_t size, size_t *len, const char *name, const char *type);
+
+// 输出直方图的 _bucket/_sum/_count 样本，单位秒; labels 形如 tier="0"，无标签传 NULL
+void stream_hist_render(char *buf, size_t size, size_t *len, const char *name, const char *labels,
+                        const stream_hist_t *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __STREAM_METRICS_H__
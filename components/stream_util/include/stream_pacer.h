@@ -0,0 +1,53 @@
+// stream_pacer.h
+// 推流客户端背压: 按客户端统计发送耗时 (EWMA) 与在途字节，落后时自动改为每 N 帧发一帧，
+// 跟上后逐级恢复; 快客户端始终保持 factor = 1，不受慢客户端影响
+#ifndef __STREAM_PACER_H__
+#define __STREAM_PACER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_PACER_FACTOR_MAX     8           // 最低降到 1/8 帧率
+#define STREAM_PACER_RECOVER_SENDS  8           // 连续多少帧有余量后恢复一级
+
+typedef struct {
+    uint32_t frame_us;                  // 源帧间隔
+    uint32_t inflight_max;              // 在途字节上限，超出时当前帧直接跳过
+    uint32_t send_us_avg;               // 单帧发送耗时 (EWMA 1/8)
+    uint32_t inflight;                  // 已交给协议栈、尚未完成的字节
+    uint32_t last_gen;                  // 上次发送的帧号
+    uint8_t factor;                     // 每 factor 帧发送一帧
+    uint8_t good;                       // 连续有余量的发送次数
+    uint32_t sent;                      // 累计发送帧数
+    uint32_t skipped;                   // 因降帧或在途超限跳过的帧数
+} stream_pacer_t;
+
+void stream_pacer_init(stream_pacer_t *p, uint32_t frame_us, uint32_t inflight_max);
+
+// 帧号为 gen 的新帧是否发给该客户端; 返回 false 时计入 skipped
+// gen 可以跳号 (客户端醒来时已错过若干帧)，错过的帧计入降帧间隔
+bool stream_pacer_due(stream_pacer_t *p, uint32_t gen);
+
+// 客户端积压 (如发送队列已满)，不经 stream_pacer_due 判断直接跳过一帧
+void stream_pacer_skip(stream_pacer_t *p);
+
+// 发送开始/结束: bytes 计入/移出在途字节，结束时按耗时调整降帧系数; 返回 true 表示系数变化
+void stream_pacer_begin(stream_pacer_t *p, uint32_t gen, size_t bytes);
+bool stream_pacer_end(stream_pacer_t *p, size_t bytes, uint32_t send_us);
+
+// 已 begin 但最终没有发出的帧 (客户端已断开): 只扣除在途字节
+void stream_pacer_cancel(stream_pacer_t *p, size_t bytes);
+
+// 新客户端接手同一个发送队列: 清空降帧状态与计数，保留在途字节 (队列中旧帧完成时扣除)
+void stream_pacer_restart(stream_pacer_t *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __STREAM_PACER_H__
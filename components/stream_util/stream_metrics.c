@@ -0,0 +1,61 @@
+// stream_metrics.c
+#include "stream_metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+// 区间上界 (us)，与渲染时的 le 标签一一对应
+static const uint32_t hist_bounds_us[STREAM_HIST_BUCKETS] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000,
+};
+static const char *const hist_bounds_le[STREAM_HIST_BUCKETS] = {
+    "0.001", "0.002", "0.005", "0.01", "0.02", "0.05", "0.1", "0.2", "0.5", "1",
+};
+
+void stream_hist_observe(stream_hist_t *h, uint32_t us) {
+    int i = 0;
+    while (i < STREAM_HIST_BUCKETS && us > hist_bounds_us[i]) i++;
+    __atomic_fetch_add(&h->buckets[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_us, (uint64_t)us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+}
+
+void stream_hist_merge(stream_hist_t *dst, const stream_hist_t *src) {
+    if (src->count == 0) return;
+    for (int i = 0; i <= STREAM_HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->sum_us += src->sum_us;
+    dst->count += src->count;
+}
+
+void stream_metrics_append(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+    if (*len >= size) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *len, size - *len, fmt, ap);
+    va_end(ap);
+    if (n > 0) *len = (*len + n < size) ? *len + n : size - 1;
+}
+
+void stream_metrics_type(char *buf, size_t size, size_t *len, const char *name, const char *type) {
+    stream_metrics_append(buf, size, len, "# TYPE %s %s\n", name, type);
+}
+
+void stream_hist_render(char *buf, size_t size, size_t *len, const char *name, const char *labels,
+                        const stream_hist_t *h) {
+    const char *sep = labels ? "," : "";
+    labels = labels ? labels : "";
+    // 并发写入时各字段可能相差一次记录，_count 取桶的累计值以保持自洽
+    uint32_t cumulative = 0;
+    for (int i = 0; i <= STREAM_HIST_BUCKETS; i++) {
+        cumulative += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        stream_metrics_append(buf, size, len, "%s_bucket{%s%sle=\"%s\"} %u\n", name, labels, sep,
+                              i < STREAM_HIST_BUCKETS ? hist_bounds_le[i] : "+Inf", (unsigned)cumulative);
+    }
+    uint64_t sum_us = __atomic_load_n(&h->sum_us, __ATOMIC_RELAXED);
+    const char *open = labels[0] ? "{" : "";
+    const char *close = labels[0] ? "}" : "";
+    stream_metrics_append(buf, size, len, "%s_sum%s%s%s %llu.%06u\n", name, open, labels, close,
+                          (unsigned long long)(sum_us / 1000000), (unsigned)(sum_us % 1000000));
+    stream_metrics_append(buf, size, len, "%s_count%s%s%s %u\n", name, open, labels, close, (unsigned)cumulative);
+}
@@ -0,0 +1,63 @@
+// stream_pacer.c
+#include "stream_pacer.h"
+#include <string.h>
+
+void stream_pacer_init(stream_pacer_t *p, uint32_t frame_us, uint32_t inflight_max) {
+    memset(p, 0, sizeof(*p));
+    p->frame_us = frame_us;
+    p->inflight_max = inflight_max;
+    p->factor = 1;
+}
+
+bool stream_pacer_due(stream_pacer_t *p, uint32_t gen) {
+    bool due = p->sent == 0 || gen - p->last_gen >= p->factor;
+    if (due && p->inflight_max && __atomic_load_n(&p->inflight, __ATOMIC_RELAXED) >= p->inflight_max) {
+        due = false;
+    }
+    if (!due) p->skipped++;
+    return due;
+}
+
+void stream_pacer_skip(stream_pacer_t *p) {
+    p->skipped++;
+}
+
+void stream_pacer_begin(stream_pacer_t *p, uint32_t gen, size_t bytes) {
+    p->last_gen = gen;
+    p->sent++;
+    __atomic_fetch_add(&p->inflight, (uint32_t)bytes, __ATOMIC_RELAXED);
+}
+
+void stream_pacer_cancel(stream_pacer_t *p, size_t bytes) {
+    __atomic_fetch_sub(&p->inflight, (uint32_t)bytes, __ATOMIC_RELAXED);
+}
+
+void stream_pacer_restart(stream_pacer_t *p) {
+    uint32_t inflight = __atomic_load_n(&p->inflight, __ATOMIC_RELAXED);
+    stream_pacer_init(p, p->frame_us, p->inflight_max);
+    __atomic_fetch_add(&p->inflight, inflight, __ATOMIC_RELAXED);
+}
+
+// 一帧的发送须在 factor 个帧间隔内完成: 超过 3/4 预算即降一级，
+// 连续若干帧低于降一级后预算的 1/2 才恢复，两个阈值之间不动以免来回振荡
+bool stream_pacer_end(stream_pacer_t *p, size_t bytes, uint32_t send_us) {
+    __atomic_fetch_sub(&p->inflight, (uint32_t)bytes, __ATOMIC_RELAXED);
+    p->send_us_avg = p->send_us_avg ? (p->send_us_avg * 7 + send_us) / 8 : send_us;
+
+    uint32_t budget_us = p->frame_us * p->factor;
+    if (p->send_us_avg > budget_us / 4 * 3 && p->factor < STREAM_PACER_FACTOR_MAX) {
+        p->factor++;
+        p->good = 0;
+        return true;
+    }
+    if (p->factor > 1 && p->send_us_avg < (budget_us - p->frame_us) / 2) {
+        if (++p->good >= STREAM_PACER_RECOVER_SENDS) {
+            p->factor--;
+            p->good = 0;
+            return true;
+        }
+    } else {
+        p->good = 0;
+    }
+    return false;
+}
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# gen_assets.py OUT_DIR FILE...
+# 构建时处理 www 下的网页资源:
+#   1. 文本资源中的 {{name}} 替换为带内容哈希的地址 /name?v=xxxxxxxx，被引用的资源因此可以长期缓存
+#   2. 以 mtime=0、不含文件名的 gzip 压缩，同样的输入总是得到同样的输出
+#   3. 生成 web_assets_table.h，列出路径、类型、ETag 与 target_add_binary_data 嵌入的符号
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+CONTENT_TYPES = {
+    '.html': 'text/html; charset=utf-8',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.svg': 'image/svg+xml',
+    '.ico': 'image/x-icon',
+    '.json': 'application/json',
+}
+TEXT_EXTS = ('.html', '.css', '.js', '.svg', '.json')
+REF_RE = re.compile(r'\{\{([A-Za-z0-9_.\-]+)\}\}')
+
+
+def digest(data):
+    return hashlib.sha256(data).hexdigest()
+
+
+def write_if_changed(path, data):
+    try:
+        with open(path, 'rb') as f:
+            if f.read() == data:
+                return
+    except OSError:
+        pass
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def main():
+    out_dir, files = sys.argv[1], sys.argv[2:]
+    os.makedirs(out_dir, exist_ok=True)
+    sources = {}
+    for path in sorted(files):
+        with open(path, 'rb') as f:
+            sources[os.path.basename(path)] = f.read()
+
+    # 先处理不含引用的资源，引用方在其后按被引用资源的最终哈希替换; 不支持循环引用
+    done = {}
+    pending = dict(sources)
+    while pending:
+        progress = False
+        for name, data in sorted(pending.items()):
+            refs = set(REF_RE.findall(data.decode('utf-8'))) if name.endswith(TEXT_EXTS) else set()
+            missing = refs - set(sources)
+            if missing:
+                sys.exit('%s: unknown asset reference %s' % (name, ', '.join(sorted(missing))))
+            if refs - set(done):
+                continue
+            if refs:
+                data = REF_RE.sub(lambda m: '/%s?v=%s' % (m.group(1), done[m.group(1)][1][:8]),
+                                  data.decode('utf-8')).encode('utf-8')
+            done[name] = (data, digest(data))
+            del pending[name]
+            progress = True
+        if not progress:
+            sys.exit('circular asset references: %s' % ', '.join(sorted(pending)))
+
+    entries = []
+    for name in sorted(done):
+        data, sha = done[name]
+        ext = os.path.splitext(name)[1]
+        gz = gzip.compress(data, compresslevel=9, mtime=0)
+        write_if_changed(os.path.join(out_dir, name + '.gz'), gz)
+        sym = '_binary_' + re.sub(r'[^A-Za-z0-9_]', '_', name + '.gz')
+        entries.append((name, CONTENT_TYPES.get(ext, 'application/octet-stream'), sha[:16], sym,
+                        ext != '.html', len(data), len(gz)))
+
+    lines = ['// 由 gen_assets.py 生成，勿手工修改', '#pragma once', '']
+    for e in entries:
+        lines.append('extern const uint8_t %s_start[] asm("%s_start");' % (e[3], e[3]))
+        lines.append('extern const uint8_t %s_end[] asm("%s_end");' % (e[3], e[3]))
+    lines += ['', 'static const web_asset_t web_assets[] = {']
+    for name, ctype, etag, sym, immutable, raw_len, gz_len in entries:
+        lines.append('    { "%s", "%s", "\\"%s\\"", %s_start, %s_end, %s, %d },  // %d -> %d bytes'
+                     % (name, ctype, etag, sym, sym, 'true' if immutable else 'false', raw_len, raw_len, gz_len))
+    lines += ['};', '']
+    write_if_changed(os.path.join(out_dir, 'web_assets_table.h'), '\n'.join(lines).encode('utf-8'))
+    print('web assets: %d files, %d -> %d bytes gzip' % (len(entries), sum(e[5] for e in entries),
+                                                          sum(e[6] for e in entries)))
+
+
+if __name__ == '__main__':
+    main()
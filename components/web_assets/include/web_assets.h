@@ -0,0 +1,41 @@
+// web_assets.h
+// 构建时预压缩的网页资源 (components/web_assets/www)，以 Content-Encoding: gzip 原样发送，
+// 不接受 gzip 的客户端回 406
+// 页面 (*.html) 与不带哈希的资源地址使用 Cache-Control: no-cache + ETag，刷新时只需一次 304;
+// 页面通过带哈希的地址 (/name?v=xxxxxxxx) 引用的 js/css 等资源可长期缓存 (immutable)
+#ifndef __WEB_ASSETS_H__
+#define __WEB_ASSETS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *name;                   // www 下的文件名
+    const char *content_type;
+    const char *etag;                   // 带引号的内容哈希
+    const uint8_t *start;               // gzip 数据
+    const uint8_t *end;
+    bool immutable;                     // 页面以带哈希的地址引用，该地址可长期缓存
+    uint32_t raw_len;                   // 压缩前长度
+} web_asset_t;
+
+const web_asset_t *web_asset_find(const char *name);
+
+// 把资源 name 注册为 GET uri; 页面中 {{name}} 形式的引用需要注册为 "/name"
+esp_err_t web_assets_register(httpd_handle_t server, const char *uri, const char *name);
+
+// 页面引用的公共资源 (viewer.js/viewer.css) 一次注册，返回注册的 uri 数
+int web_assets_register_common(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __WEB_ASSETS_H__
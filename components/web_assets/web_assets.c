@@ -0,0 +1,123 @@
+// web_assets.c
+#include "web_assets.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "web_assets_table.h"
+
+#define TAG "WEB_ASSETS"
+
+#define WEB_ASSETS_IMMUTABLE_CACHE  "public, max-age=31536000, immutable"
+
+// 页面公共引用的资源
+static const char *const common_assets[] = { "viewer.css", "viewer.js" };
+
+const web_asset_t *web_asset_find(const char *name) {
+    for (int i = 0; i < sizeof(web_assets) / sizeof(web_assets[0]); i++) {
+        if (strcmp(web_assets[i].name, name) == 0) return &web_assets[i];
+    }
+    return NULL;
+}
+
+// Accept-Encoding 中 coding 的 q 值: 未列出返回 -1，未带 q 参数为 1
+static float coding_q(const char *accept, const char *coding) {
+    size_t n = strlen(coding);
+    const char *p = accept;
+    while (*p) {
+        p += strspn(p, " \t,");
+        size_t len = strcspn(p, " \t;,");
+        const char *end = p + strcspn(p, ",");
+        if (len == n && strncasecmp(p, coding, n) == 0) {
+            const char *q = strstr(p, "q=");
+            return (q && q < end) ? strtof(q + 2, NULL) : 1.0f;
+        }
+        p = end;
+    }
+    return -1.0f;
+}
+
+// 客户端是否接受 gzip。未带 Accept-Encoding 表示任何编码都可以 (RFC 9110 12.5.3)，
+// 只有显式拒绝时不接受: gzip;q=0、空值，或未列出 gzip 而只要 identity / *;q=0
+static bool accepts_gzip(httpd_req_t *req) {
+    char accept[128];
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) return true;
+    if (accept[strspn(accept, " \t")] == '\0') return false;
+
+    float q = coding_q(accept, "gzip");
+    if (q < 0) q = coding_q(accept, "x-gzip");
+    if (q >= 0) return q > 0;
+    q = coding_q(accept, "*");
+    if (q >= 0) return q > 0;
+    return coding_q(accept, "identity") < 0;
+}
+
+// 只有带当前内容哈希的地址 (/name?v=xxxxxxxx) 可以长期缓存，不带哈希的别名每次都要验证
+static bool fingerprinted(httpd_req_t *req, const web_asset_t *asset) {
+    char query[48], v[16];
+    if (!asset->immutable) return false;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return false;
+    if (httpd_query_key_value(query, "v", v, sizeof(v)) != ESP_OK) return false;
+    // etag 为带引号的 16 位内容哈希，页面引用取其前 8 位
+    return strlen(v) == 8 && strncmp(v, asset->etag + 1, 8) == 0;
+}
+
+static esp_err_t asset_handler(httpd_req_t *req) {
+    const web_asset_t *asset = req->user_ctx;
+    char if_none_match[64];
+
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    // 只保存了 gzip 版本，显式拒绝 gzip 的客户端无法解码
+    if (!accepts_gzip(req)) {
+        httpd_resp_set_status(req, "406 Not Acceptable");
+        httpd_resp_set_type(req, "text/plain");
+        return httpd_resp_send(req, "gzip encoding required\n", HTTPD_RESP_USE_STRLEN);
+    }
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", fingerprinted(req, asset) ? WEB_ASSETS_IMMUTABLE_CACHE : "no-cache");
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, asset->etag) != NULL) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, asset->content_type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)asset->start, asset->end - asset->start);
+}
+
+esp_err_t web_assets_register(httpd_handle_t server, const char *uri, const char *name) {
+    const web_asset_t *asset = web_asset_find(name);
+    if (asset == NULL) {
+        ESP_LOGE(TAG, "No asset %s", name);
+        return ESP_ERR_NOT_FOUND;
+    }
+    httpd_uri_t asset_uri = {
+        .uri       = uri,
+        .method    = HTTP_GET,
+        .handler   = asset_handler,
+        .user_ctx  = (void *)asset
+    };
+    esp_err_t err = httpd_register_uri_handler(server, &asset_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register %s: %s", uri, esp_err_to_name(err));
+    } else {
+        ESP_LOGD(TAG, "%s -> %s, %u -> %u bytes", uri, name, (unsigned)asset->raw_len,
+                 (unsigned)(asset->end - asset->start));
+    }
+    return err;
+}
+
+int web_assets_register_common(httpd_handle_t server) {
+    int count = 0;
+    for (int i = 0; i < sizeof(common_assets) / sizeof(common_assets[0]); i++) {
+        char uri[32];
+        snprintf(uri, sizeof(uri), "/%s", common_assets[i]);
+        if (web_assets_register(server, uri, common_assets[i]) == ESP_OK) count++;
+    }
+    return count;
+}
@@ -0,0 +1,76 @@
+// 统计浮层: 每秒拉取 /stats，显示帧率、码率与各客户端的降帧系数
+// 页面可设置 viewer.local = function () { return ['...']; } 追加浏览器端测得的数据
+var viewer = (function () {
+  var overlay = document.getElementById('overlay');
+  var prev = null;
+
+  function ms(us) { return (us / 1000).toFixed(1) + ' ms'; }
+  function rate(cur, old, dt) { return old === undefined ? '-' : ((cur - old) / dt).toFixed(1); }
+
+  // http_server (模式 1): {"mjpeg":{...},"streams":[...]}
+  function mjpegLines(s, p, dt) {
+    var m = s.mjpeg, lines = [
+      'MJPEG ' + m.mode + '  clients ' + m.clients,
+      'sent ' + rate(m.frames, p && p.mjpeg.frames, dt) + ' fps  ' + m.send_kbps + ' kbps (in send)',
+      'writes/frame ' + m.writes_per_frame + '  segments/frame ' + m.segments_per_frame
+    ];
+    (s.streams || []).forEach(function (c) {
+      lines.push('fd ' + c.fd + ': 1/' + c.factor + '  send ' + ms(c.send_us_avg) +
+                 '  skipped ' + c.skipped);
+    });
+    return lines;
+  }
+
+  // rtsp_stats (模式 2): {"total":{...},"sessions":[...]}
+  function rtspLines(s, p, dt) {
+    var t = s.total, lines = [
+      'RTSP source ' + rate(t.frames_in, p && p.total.frames_in, dt) + ' fps  ' +
+        rate(t.bytes_in * 8 / 1000, p && p.total.bytes_in * 8 / 1000, dt) + ' kbps',
+      'glass-to-wire avg ' + ms(t.wire_us_avg) + '  max ' + ms(t.wire_us_max)
+    ];
+    s.sessions.forEach(function (c) {
+      if (!c.active) return;
+      lines.push(c.transport + ' ' + c.peer + ' tier ' + c.tier + '  lost ' +
+                 (c.fraction_lost * 100 / 256).toFixed(1) + '%  rtx ' + c.rtx_packets);
+    });
+    return lines;
+  }
+
+  // web_mjpeg_server (模式 3): 单个客户端的降帧状态
+  function wsLines(s) {
+    var lines = ['clients: ' + s.clients.length];
+    s.clients.forEach(function (c) {
+      lines.push('fd ' + c.fd + ': 1/' + c.factor + '  send ' + ms(c.send_us_avg) + '  inflight ' +
+                 (c.inflight / 1024).toFixed(0) + ' KB  queued ' + c.queued + '  skipped ' + c.skipped);
+    });
+    return lines;
+  }
+
+  function render(s, dt) {
+    var lines = s.mjpeg ? mjpegLines(s, prev, dt) : s.total ? rtspLines(s, prev, dt) : wsLines(s);
+    if (api.local) lines = api.local().concat(lines);
+    overlay.textContent = lines.join('\n');
+  }
+
+  var last = 0;
+  function poll() {
+    fetch('/stats', { cache: 'no-store' })
+      .then(function (r) { return r.json(); })
+      .then(function (s) {
+        var now = performance.now();
+        render(s, last ? (now - last) / 1000 : 1);
+        prev = s;
+        last = now;
+      })
+      .catch(function () { overlay.textContent = 'stats unavailable'; })
+      .then(function () { setTimeout(poll, 1000); });
+  }
+
+  var api = {
+    local: null,
+    toggle: function () { overlay.classList.toggle('hidden'); }
+  };
+  document.addEventListener('keydown', function (e) { if (e.key === 's') api.toggle(); });
+  poll();
+  return api;
+})();
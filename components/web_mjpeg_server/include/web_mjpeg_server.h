@@ -17,10 +17,22 @@ extern "C" {
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "lcd_camera.h"
 
 void web_mjpeg_server_start(void);
 bool web_mjpeg_server_is_client_connected(void);
-void web_mjpeg_server_send_jpeg(const uint8_t *jpeg_buf, size_t jpeg_len);
+// 广播一帧给所有 WebSocket 客户端; 每个客户端入队时各持有一个引用，调用方可立即释放自己的引用
+void web_mjpeg_server_send_frame(lcd_camera_frame_t *frame);
+
+// /metrics 响应体的渲染函数：写入 buf，返回长度
+typedef int (*web_mjpeg_metrics_render_t)(char *buf, size_t size);
+
+// 在 web_mjpeg_server_start 前注册 GET /metrics，未注册时不提供
+void web_mjpeg_server_register_metrics(web_mjpeg_metrics_render_t render);
+
+// 每个 WebSocket 客户端的降帧系数、发送耗时、在途字节与排队帧数 (Prometheus 文本格式)
+int web_mjpeg_server_render_metrics(char *buf, size_t size);
 
 #ifdef __cplusplus
 }
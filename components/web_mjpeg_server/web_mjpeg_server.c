@@ -1,97 +1,362 @@
 #include "web_mjpeg_server.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "stream_pacer.h"
+#include "stream_metrics.h"
+#include "web_assets.h"
 #include <string.h>
+#include <unistd.h>
 
 #define TAG "WEB_MJPEG"
 
+#define WEB_FRAME_US        (1000000 / CONFIG_CAMERA_STREAM_FRAME_RATE)
+#define WEB_INFLIGHT_MAX    (64 * 1024)     // 每个客户端的在途字节上限，超出时跳过新帧
+#define WEB_WS_MAX_CLIENTS  4               // 同时观看的 WebSocket 客户端上限，每个一个发送任务
+#define WEB_WS_QUEUE_FRAMES 2               // 每个客户端排队等待发送的帧数上限
+#define WEB_WS_QUEUE_LEN    (WEB_WS_QUEUE_FRAMES + 2)   // 另留两格给接入标记
+#define WEB_WS_TASK_STACK   4096
+#define WEB_WS_TASK_PRIO    5
+#define WEB_WS_RX_MAX       125             // 控制帧负载上限 (RFC 6455)，客户端不发送数据帧
+#define WEB_METRICS_BUF_SIZE (16 * 1024)    // 容纳完整的 /metrics 输出
+
+// 发送队列中的一项: frame 为 NULL 时表示 fd 接入该槽位
+typedef struct {
+    lcd_camera_frame_t *frame;
+    int fd;
+} ws_item_t;
+
+// 每个槽位一个发送任务和一个有界队列，慢客户端只积压自己的队列，不阻塞摄像头任务与其他客户端
+typedef struct {
+    int fd;                     // 正在推流的连接，-1 时不再入队新帧; 由发送任务在接入时置位
+    int claim_fd;               // 占用槽位的连接 (握手后即登记)，-1 空闲
+    QueueHandle_t queue;
+    stream_pacer_t pacer;       // 摄像头任务判断/计入，发送任务结算耗时
+} ws_client_t;
+
 static httpd_handle_t server = NULL;
-static int last_fd = -1;
-
-// HTML 网页，浏览器访问显示图像
-static const char *html_page =
-    "<!DOCTYPE html><html><head><meta charset='utf-8'><title>ESP32 MJPEG Stream</title></head>"
-    "<body style='margin:0;padding:0;background:black;'>"
-    "<img id='video' style='width:100vw;height:auto;' />"
-    "<script>"
-    "var socket = new WebSocket('ws://' + location.host + '/ws');"
-    "socket.binaryType = 'arraybuffer';"
-    "socket.onmessage = function(event) {"
-    "  var blob = new Blob([event.data], { type: 'image/jpeg' });"
-    "  var url = URL.createObjectURL(blob);"
-    "  var img = document.getElementById('video');"
-    "  if (img.src) URL.revokeObjectURL(img.src);"
-    "  img.src = url;"
-    "};"
-    "socket.onclose = function(event) {"
-    "  console.log('WebSocket closed');"
-    "};"
-    "socket.onerror = function(error) {"
-    "  console.log('WebSocket error: ' + error);"
-    "};"
-    "</script></body></html>";
-
-// HTTP GET "/" 返回网页
-static esp_err_t root_get_handler(httpd_req_t *req) {
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, html_page, HTTPD_RESP_USE_STRLEN);
-    return ESP_OK;
+static ws_client_t clients[WEB_WS_MAX_CLIENTS];
+static uint32_t frame_gen = 0;
+static web_mjpeg_metrics_render_t metrics_render;  // 未注册时不提供 /metrics
+static char *metrics_buf;   // 启动时分配一次 (优先 PSRAM)，httpd 单任务顺序处理请求
+
+// 槽位停止推流: 仅当仍由 fd 占用时清除，返回是否找到
+static bool ws_client_release(int fd) {
+    bool found = false;
+    for (int i = 0; i < WEB_WS_MAX_CLIENTS; i++) {
+        ws_client_t *c = &clients[i];
+        int expected = fd;
+        if (__atomic_compare_exchange_n(&c->claim_fd, &expected, -1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            expected = fd;
+            __atomic_compare_exchange_n(&c->fd, &expected, -1, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            found = true;
+        }
+    }
+    return found;
+}
+
+// 握手完成后登记客户端，由发送任务排空旧帧后接入
+static esp_err_t ws_client_open(int fd) {
+    for (int i = 0; i < WEB_WS_MAX_CLIENTS; i++) {
+        ws_client_t *c = &clients[i];
+        int expected = -1;
+        if (!__atomic_compare_exchange_n(&c->claim_fd, &expected, fd, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        ws_item_t item = { .frame = NULL, .fd = fd };
+        if (xQueueSend(c->queue, &item, pdMS_TO_TICKS(100)) != pdTRUE) {
+            __atomic_store_n(&c->claim_fd, -1, __ATOMIC_RELEASE);
+            ESP_LOGW(TAG, "WebSocket slot %d still draining, refusing fd=%d", i, fd);
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "WebSocket client connected, fd=%d slot=%d", fd, i);
+        return ESP_OK;
+    }
+    ESP_LOGW(TAG, "All %d WebSocket slots busy, refusing fd=%d", WEB_WS_MAX_CLIENTS, fd);
+    return ESP_FAIL;
+}
+
+// 发送任务: 按入队顺序处理接入标记与帧; 不属于当前客户端的帧只释放，不发送
+static void ws_sender_task(void *arg) {
+    ws_client_t *c = &clients[(int)(intptr_t)arg];
+    ws_item_t item;
+    while (1) {
+        if (xQueueReceive(c->queue, &item, portMAX_DELAY) != pdTRUE) continue;
+
+        if (item.frame == NULL) {
+            // 接入前已关闭的连接不再接入; 降帧状态清零后才对摄像头任务可见
+            if (__atomic_load_n(&c->claim_fd, __ATOMIC_ACQUIRE) == item.fd) {
+                stream_pacer_restart(&c->pacer);
+                __atomic_store_n(&c->fd, item.fd, __ATOMIC_RELEASE);
+            }
+            continue;
+        }
+
+        size_t len = item.frame->len;
+        if (__atomic_load_n(&c->fd, __ATOMIC_ACQUIRE) != item.fd) {
+            stream_pacer_cancel(&c->pacer, len);
+            lcd_camera_frame_unref(item.frame);
+            continue;
+        }
+
+        httpd_ws_frame_t ws_pkt = {
+            .final = true,
+            .fragmented = false,
+            .type = HTTPD_WS_TYPE_BINARY,
+            .payload = item.frame->buf,
+            .len = len,
+        };
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t err = httpd_ws_send_frame_async(server, item.fd, &ws_pkt);
+        lcd_camera_frame_unref(item.frame);
+        if (stream_pacer_end(&c->pacer, len, (uint32_t)(esp_timer_get_time() - start_us))) {
+            ESP_LOGI(TAG, "WebSocket client fd=%d: every %u frame(s), send %u us avg",
+                     item.fd, c->pacer.factor, (unsigned)c->pacer.send_us_avg);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send JPEG over WebSocket fd=%d: %d", item.fd, err);
+            // 停止入队，会话关闭时 close_fn 归还槽位
+            int expected = item.fd;
+            __atomic_compare_exchange_n(&c->fd, &expected, -1, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            httpd_sess_trigger_close(server, item.fd);
+        }
+    }
+}
+
+// 会话关闭 (含对端直接断开 TCP): 归还槽位; 设置了 close_fn 时须自行关闭 socket
+static void ws_session_close(httpd_handle_t hd, int sockfd) {
+    if (ws_client_release(sockfd)) {
+        ESP_LOGI(TAG, "WebSocket client closed, fd=%d", sockfd);
+    }
+    close(sockfd);
 }
 
-// WebSocket 连接处理，直接记录客户端 fd，不调用 httpd_ws_recv_frame
+// 握手时登记客户端; 之后处理客户端发来的帧: CLOSE 归还槽位并回应，PING 回 PONG，其余丢弃
 static esp_err_t websocket_handler(httpd_req_t *req) {
-    last_fd = httpd_req_to_sockfd(req);
-    ESP_LOGI(TAG, "WebSocket client connected, fd=%d", last_fd);
-    return ESP_OK;
+    int fd = httpd_req_to_sockfd(req);
+    if (req->method == HTTP_GET) {
+        return ws_client_open(fd);
+    }
+
+    uint8_t payload[WEB_WS_RX_MAX];
+    httpd_ws_frame_t frame = { 0 };
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) return err;
+    if (frame.len > sizeof(payload)) {
+        ESP_LOGW(TAG, "WebSocket fd=%d sent %u byte frame, closing", fd, (unsigned)frame.len);
+        return ESP_FAIL;
+    }
+    frame.payload = payload;
+    if (frame.len && (err = httpd_ws_recv_frame(req, &frame, frame.len)) != ESP_OK) return err;
+
+    switch (frame.type) {
+    case HTTPD_WS_TYPE_CLOSE: {
+        if (ws_client_release(fd)) {
+            ESP_LOGI(TAG, "WebSocket client sent close, fd=%d", fd);
+        }
+        // 回应时只带回状态码
+        httpd_ws_frame_t reply = { .final = true, .type = HTTPD_WS_TYPE_CLOSE,
+                                   .payload = payload, .len = frame.len >= 2 ? 2 : 0 };
+        httpd_ws_send_frame(req, &reply);
+        httpd_sess_trigger_close(req->handle, fd);
+        return ESP_OK;
+    }
+    case HTTPD_WS_TYPE_PING: {
+        httpd_ws_frame_t reply = { .final = true, .type = HTTPD_WS_TYPE_PONG,
+                                   .payload = payload, .len = frame.len };
+        return httpd_ws_send_frame(req, &reply);
+    }
+    default:
+        return ESP_OK;
+    }
 }
 
-static const httpd_uri_t root_uri = {
-    .uri = "/",
+// GET "/stats" 返回每个客户端的降帧系数、平均发送耗时、在途字节与排队帧数 (JSON)
+static esp_err_t stats_get_handler(httpd_req_t *req) {
+    char buf[128 + WEB_WS_MAX_CLIENTS * 160];
+    int len = snprintf(buf, sizeof(buf), "{\"clients\":[");
+    bool first = true;
+    for (int i = 0; i < WEB_WS_MAX_CLIENTS && len >= 0 && (size_t)len < sizeof(buf); i++) {
+        ws_client_t *c = &clients[i];
+        int fd = __atomic_load_n(&c->fd, __ATOMIC_ACQUIRE);
+        if (fd < 0) continue;
+        len += snprintf(buf + len, sizeof(buf) - len,
+            "%s{\"slot\":%d,\"fd\":%d,\"factor\":%u,\"send_us_avg\":%u,\"inflight\":%u,"
+            "\"queued\":%u,\"sent\":%u,\"skipped\":%u}",
+            first ? "" : ",", i, fd, c->pacer.factor, (unsigned)c->pacer.send_us_avg,
+            (unsigned)__atomic_load_n(&c->pacer.inflight, __ATOMIC_RELAXED),
+            (unsigned)uxQueueMessagesWaiting(c->queue),
+            (unsigned)c->pacer.sent, (unsigned)c->pacer.skipped);
+        first = false;
+    }
+    if (len >= 0 && (size_t)len < sizeof(buf)) {
+        len += snprintf(buf + len, sizeof(buf) - len, "]}");
+    }
+    if (len < 0 || (size_t)len >= sizeof(buf)) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "stats overflow");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, buf, len);
+}
+
+int web_mjpeg_server_render_metrics(char *buf, size_t size) {
+    size_t len = 0;
+    int connected = 0;
+    if (size == 0) return 0;
+    buf[0] = '\0';
+    for (int i = 0; i < WEB_WS_MAX_CLIENTS; i++) {
+        if (__atomic_load_n(&clients[i].fd, __ATOMIC_RELAXED) >= 0) connected++;
+    }
+    stream_metrics_type(buf, size, &len, "camera_ws_clients", "gauge");
+    stream_metrics_append(buf, size, &len, "camera_ws_clients %d\n", connected);
+
+    // 每个 WebSocket 客户端一组样本，按发送任务槽位区分
+    static const char *const client_metrics[][2] = {
+        { "camera_ws_client_decimation", "gauge" },
+        { "camera_ws_client_send_seconds_avg", "gauge" },
+        { "camera_ws_client_inflight_bytes", "gauge" },
+        { "camera_ws_client_queued_frames", "gauge" },
+        { "camera_ws_client_frames_sent_total", "counter" },
+        { "camera_ws_client_frames_skipped_total", "counter" },
+    };
+    for (int m = 0; m < sizeof(client_metrics) / sizeof(client_metrics[0]); m++) {
+        stream_metrics_type(buf, size, &len, client_metrics[m][0], client_metrics[m][1]);
+        for (int i = 0; i < WEB_WS_MAX_CLIENTS; i++) {
+            ws_client_t *c = &clients[i];
+            int fd = __atomic_load_n(&c->fd, __ATOMIC_ACQUIRE);
+            if (fd < 0) continue;
+            const stream_pacer_t *p = &c->pacer;
+            stream_metrics_append(buf, size, &len, "%s{slot=\"%d\",fd=\"%d\"} ", client_metrics[m][0], i, fd);
+            switch (m) {
+            case 0: stream_metrics_append(buf, size, &len, "%u\n", p->factor); break;
+            case 1: stream_metrics_append(buf, size, &len, "%u.%06u\n", (unsigned)(p->send_us_avg / 1000000),
+                                          (unsigned)(p->send_us_avg % 1000000)); break;
+            case 2: stream_metrics_append(buf, size, &len, "%u\n",
+                                          (unsigned)__atomic_load_n(&p->inflight, __ATOMIC_RELAXED)); break;
+            case 3: stream_metrics_append(buf, size, &len, "%u\n", (unsigned)uxQueueMessagesWaiting(c->queue)); break;
+            case 4: stream_metrics_append(buf, size, &len, "%u\n", (unsigned)p->sent); break;
+            default: stream_metrics_append(buf, size, &len, "%u\n", (unsigned)p->skipped); break;
+            }
+        }
+    }
+    return (int)len;
+}
+
+static esp_err_t metrics_get_handler(httpd_req_t *req) {
+    int len = metrics_render(metrics_buf, WEB_METRICS_BUF_SIZE);
+    if (len < 0) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "render failed");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, STREAM_METRICS_CONTENT_TYPE);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, metrics_buf, len);
+}
+
+void web_mjpeg_server_register_metrics(web_mjpeg_metrics_render_t render) {
+    metrics_render = render;
+}
+
+static const httpd_uri_t metrics_uri = {
+    .uri = "/metrics",
     .method = HTTP_GET,
-    .handler = root_get_handler
+    .handler = metrics_get_handler
+};
+
+static const httpd_uri_t stats_uri = {
+    .uri = "/stats",
+    .method = HTTP_GET,
+    .handler = stats_get_handler
 };
 
 static const httpd_uri_t ws_uri = {
     .uri = "/ws",
     .method = HTTP_GET,
     .handler = websocket_handler,
-    .is_websocket = true
+    .is_websocket = true,
+    .handle_ws_control_frames = true    // CLOSE/PING 交给 websocket_handler，关闭即归还槽位
 };
 
 void web_mjpeg_server_start(void) {
+    for (int i = 0; i < WEB_WS_MAX_CLIENTS; i++) {
+        ws_client_t *c = &clients[i];
+        c->fd = -1;
+        c->claim_fd = -1;
+        stream_pacer_init(&c->pacer, WEB_FRAME_US, WEB_INFLIGHT_MAX);
+        c->queue = xQueueCreate(WEB_WS_QUEUE_LEN, sizeof(ws_item_t));
+        if (!c->queue) {
+            ESP_LOGE(TAG, "Failed to allocate WebSocket send queue");
+            return;
+        }
+        xTaskCreate(ws_sender_task, "ws_send", WEB_WS_TASK_STACK, (void *)(intptr_t)i,
+                    WEB_WS_TASK_PRIO, NULL);
+    }
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.stack_size = 4096;
-    config.max_open_sockets = 4;
+    config.max_open_sockets = WEB_WS_MAX_CLIENTS + 3;  // 观看连接之外留给页面、静态资源与统计
     config.max_uri_handlers = 8;
+    config.close_fn = ws_session_close;
 
     if (httpd_start(&server, &config) == ESP_OK) {
-        httpd_register_uri_handler(server, &root_uri);
+        web_assets_register(server, "/", "ws.html");     // 预压缩的页面与统计浮层
+        web_assets_register_common(server);
         httpd_register_uri_handler(server, &ws_uri);
+        httpd_register_uri_handler(server, &stats_uri);
+        if (metrics_render) {
+            metrics_buf = heap_caps_malloc(WEB_METRICS_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (!metrics_buf) {
+                metrics_buf = heap_caps_malloc(WEB_METRICS_BUF_SIZE, MALLOC_CAP_8BIT);
+            }
+            if (metrics_buf) {
+                httpd_register_uri_handler(server, &metrics_uri);
+            } else {
+                ESP_LOGE(TAG, "Failed to allocate metrics buffer");
+            }
+        }
         ESP_LOGI(TAG, "HTTP MJPEG WebSocket server started");
     }
 }
 
 bool web_mjpeg_server_is_client_connected(void) {
-    return (last_fd >= 0);
+    for (int i = 0; i < WEB_WS_MAX_CLIENTS; i++) {
+        if (__atomic_load_n(&clients[i].fd, __ATOMIC_RELAXED) >= 0) return true;
+    }
+    return false;
 }
 
-// 推送 JPEG 图像到 WebSocket 客户端
-void web_mjpeg_server_send_jpeg(const uint8_t *jpeg_buf, size_t jpeg_len) {
-    if (!server || last_fd < 0 || !jpeg_buf || jpeg_len == 0) return;
+// 广播一帧: 每个客户端按自己的降帧状态决定是否入队，入队时持有一个引用，发送任务发完后释放
+void web_mjpeg_server_send_frame(lcd_camera_frame_t *frame) {
+    if (!server || !frame || frame->len == 0) return;
 
-    httpd_ws_frame_t ws_pkt = {
-        .final = true,
-        .fragmented = false,
-        .type = HTTPD_WS_TYPE_BINARY,
-        .payload = (uint8_t *)jpeg_buf,
-        .len = jpeg_len,
-    };
+    uint32_t gen = ++frame_gen;
+    for (int i = 0; i < WEB_WS_MAX_CLIENTS; i++) {
+        ws_client_t *c = &clients[i];
+        int fd = __atomic_load_n(&c->fd, __ATOMIC_ACQUIRE);
+        if (fd < 0) continue;
+        // 队列满说明该客户端已积压，直接跳过本帧而不是等待; 本任务是唯一的入队方，检查后空位不会被占
+        if (uxQueueSpacesAvailable(c->queue) == 0) {
+            stream_pacer_skip(&c->pacer);
+            continue;
+        }
+        if (!stream_pacer_due(&c->pacer, gen)) continue;
 
-    esp_err_t err = httpd_ws_send_frame_async(server, last_fd, &ws_pkt);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send JPEG over WebSocket: %d", err);
-        last_fd = -1; // 断开连接
-    } else {
-        // ESP_LOGI(TAG, "JPEG sent, size=%d bytes", jpeg_len);
+        // 入队前计入在途字节，否则发送任务可能先结算使计数回绕
+        stream_pacer_begin(&c->pacer, gen, frame->len);
+        ws_item_t item = { .frame = lcd_camera_frame_ref(frame), .fd = fd };
+        if (xQueueSend(c->queue, &item, 0) != pdTRUE) {
+            stream_pacer_cancel(&c->pacer, frame->len);
+            lcd_camera_frame_unref(frame);
+        }
     }
 }
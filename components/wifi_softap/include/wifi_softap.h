@@ -18,6 +18,9 @@ extern "C" {
 
 void wifi_user_init(void);
 
+// Wi-Fi 信号强度 (AP 模式为各客户端 RSSI)，Prometheus 文本格式，返回写入长度
+int wifi_render_metrics(char *buf, size_t size);
+
 
 #ifdef __cplusplus
 }
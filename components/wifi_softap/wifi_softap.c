@@ -7,6 +7,7 @@
 #include "lwip/ip4_addr.h"
 #include "esp_system.h"
 #include "wifi_softap.h"
+#include "stream_metrics.h"
 
 // 定义是否使用 WiFi STA 模式，否则使用 SoftAP 模式
 #define USE_WIFI_STA 0
@@ -120,3 +121,35 @@ void wifi_user_init() {
     ESP_LOGI(TAG, "WiFi AP started. SSID:%s, IP:" IPSTR, WIFI_AP_SSID, IP2STR(&ip_info.ip));
 #endif
 }
+
+int wifi_render_metrics(char *buf, size_t size) {
+    size_t len = 0;
+    if (size == 0) return 0;
+    buf[0] = '\0';
+#if USE_WIFI_STA
+    // STA 模式: 与上级 AP 之间的信号强度
+    wifi_ap_record_t ap;
+    stream_metrics_type(buf, size, &len, "camera_wifi_connected", "gauge");
+    bool connected = esp_wifi_sta_get_ap_info(&ap) == ESP_OK;
+    stream_metrics_append(buf, size, &len, "camera_wifi_connected %d\n", connected ? 1 : 0);
+    if (connected) {
+        stream_metrics_type(buf, size, &len, "camera_wifi_rssi_dbm", "gauge");
+        stream_metrics_append(buf, size, &len, "camera_wifi_rssi_dbm{bssid=\"" MACSTR "\"} %d\n",
+                              MAC2STR(ap.bssid), ap.rssi);
+    }
+#else
+    // AP 模式: 每个已连接客户端的信号强度
+    static wifi_sta_list_t list;
+    if (esp_wifi_ap_get_sta_list(&list) != ESP_OK) {
+        list.num = 0;
+    }
+    stream_metrics_type(buf, size, &len, "camera_wifi_stations", "gauge");
+    stream_metrics_append(buf, size, &len, "camera_wifi_stations %d\n", list.num);
+    stream_metrics_type(buf, size, &len, "camera_wifi_rssi_dbm", "gauge");
+    for (int i = 0; i < list.num; i++) {
+        stream_metrics_append(buf, size, &len, "camera_wifi_rssi_dbm{mac=\"" MACSTR "\"} %d\n",
+                              MAC2STR(list.sta[i].mac), list.sta[i].rssi);
+    }
+#endif
+    return (int)len;
+}
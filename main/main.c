@@ -1,9 +1,13 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "lcd_camera.h"
+#include "stream_metrics.h"
 #include "wifi_softap.h"
 #include "rtsp_server.h"
+#include "rtsp_stats.h"
 #include "http_server.h"
 #include "web_mjpeg_server.h"
 #include "shell_port.h"
@@ -16,13 +20,13 @@
 #define PUSH_STREAM_MODE	2
 
 // MJPEG 推送回调函数
-static void send_jpeg_callback(uint8_t *jpeg, size_t len, uint8_t type) {
+static void send_jpeg_callback(lcd_camera_frame_t *frame, uint8_t type) {
 #if PUSH_STREAM_MODE == 1
-	http_server_send_frame(jpeg, len);
+	http_server_send_frame(frame);
 #elif PUSH_STREAM_MODE == 2
-    rtsp_server_send_frame(jpeg, len, type);
+    rtsp_server_send_frame(frame, type);
 #elif PUSH_STREAM_MODE == 3
-	web_mjpeg_server_send_jpeg(jpeg, len);
+	web_mjpeg_server_send_frame(frame);
 #endif
 }
 
@@ -36,6 +40,57 @@ static bool stream_flag_callback(void) {
 #endif	
 }
 
+// 内部 RAM / PSRAM 堆与运行时间
+static int system_metrics_render(char *buf, size_t size) {
+	static const struct { const char *name; uint32_t caps; } heaps[] = {
+		{ "internal", MALLOC_CAP_INTERNAL },
+		{ "psram", MALLOC_CAP_SPIRAM },
+	};
+	size_t len = 0;
+	if (size == 0) return 0;
+	buf[0] = '\0';
+	stream_metrics_type(buf, size, &len, "camera_uptime_seconds", "counter");
+	stream_metrics_append(buf, size, &len, "camera_uptime_seconds %llu\n",
+						  (unsigned long long)(esp_timer_get_time() / 1000000));
+	stream_metrics_type(buf, size, &len, "camera_heap_total_bytes", "gauge");
+	for (int i = 0; i < sizeof(heaps) / sizeof(heaps[0]); i++) {
+		stream_metrics_append(buf, size, &len, "camera_heap_total_bytes{heap=\"%s\"} %u\n",
+							  heaps[i].name, (unsigned)heap_caps_get_total_size(heaps[i].caps));
+	}
+	stream_metrics_type(buf, size, &len, "camera_heap_free_bytes", "gauge");
+	for (int i = 0; i < sizeof(heaps) / sizeof(heaps[0]); i++) {
+		stream_metrics_append(buf, size, &len, "camera_heap_free_bytes{heap=\"%s\"} %u\n",
+							  heaps[i].name, (unsigned)heap_caps_get_free_size(heaps[i].caps));
+	}
+	stream_metrics_type(buf, size, &len, "camera_heap_min_free_bytes", "gauge");
+	for (int i = 0; i < sizeof(heaps) / sizeof(heaps[0]); i++) {
+		stream_metrics_append(buf, size, &len, "camera_heap_min_free_bytes{heap=\"%s\"} %u\n",
+							  heaps[i].name, (unsigned)heap_caps_get_minimum_free_size(heaps[i].caps));
+	}
+	stream_metrics_type(buf, size, &len, "camera_heap_largest_free_block_bytes", "gauge");
+	for (int i = 0; i < sizeof(heaps) / sizeof(heaps[0]); i++) {
+		stream_metrics_append(buf, size, &len, "camera_heap_largest_free_block_bytes{heap=\"%s\"} %u\n",
+							  heaps[i].name, (unsigned)heap_caps_get_largest_free_block(heaps[i].caps));
+	}
+	return (int)len;
+}
+
+// /metrics: 各组件依次写入同一个预分配缓冲区，每段都会留出结尾的 '\0'
+static int metrics_render(char *buf, size_t size) {
+	size_t len = 0;
+	len += lcd_camera_render_metrics(buf + len, size - len);
+#if PUSH_STREAM_MODE == 1
+	len += http_server_render_metrics(buf + len, size - len);
+#elif PUSH_STREAM_MODE == 2
+	len += rtsp_stats_render_metrics(buf + len, size - len);
+#elif PUSH_STREAM_MODE == 3
+	len += web_mjpeg_server_render_metrics(buf + len, size - len);
+#endif
+	len += wifi_render_metrics(buf + len, size - len);
+	len += system_metrics_render(buf + len, size - len);
+	return (int)len;
+}
+
 static void version_info_print(void)
 {
     logPrintln("Thread Operating System");
@@ -52,17 +107,29 @@ void app_main(void) {
 
     wifi_user_init();		// 初始化 SoftAP
 #if PUSH_STREAM_MODE == 1
-	http_server_start();    // 启动HTTP服务器
+	http_server_register_text("/stats", "application/json", http_server_render_stats);
+	http_server_register_text("/metrics", STREAM_METRICS_CONTENT_TYPE, metrics_render);
+	http_server_start();    // 启动HTTP服务器，/stats 查询 MJPEG 发送统计
 #elif PUSH_STREAM_MODE == 2
     rtsp_server_start();	// 初始化 RTSP Server
+	http_server_register_text("/stats", "application/json", rtsp_stats_render_json);
+	http_server_register_text("/metrics", STREAM_METRICS_CONTENT_TYPE, metrics_render);
+	http_server_start_text();	// 启动HTTP服务器 (不含 MJPEG 页面与推流)，/stats 查询推流统计，/metrics 供 Prometheus 抓取
 #elif PUSH_STREAM_MODE == 3	
-	web_mjpeg_server_start();	// 初始化 WEB Server
+	web_mjpeg_server_register_metrics(metrics_render);
+	web_mjpeg_server_start();	// 初始化 WEB Server，/stats 与 /metrics 查询每客户端降帧与在途字节
 #endif
 
     // 启动摄像头+LCD，注册 MJPEG 推送函数
     lcd_camera_config_t lcd_config = {
 		.stream_flag = stream_flag_callback,
-        .send_jpeg = send_jpeg_callback
+        .send_jpeg = send_jpeg_callback,
+#if PUSH_STREAM_MODE == 2
+		.stream_tiers = rtsp_stream_tiers_get,	// 只编码有会话订阅的分层
+#ifdef CONFIG_RTSP_SUBFRAME_ENABLE
+		.send_jpeg_chunk = rtsp_server_send_chunk,	// 边编码边发送
+#endif
+#endif
     };
 
     esp_err_t ret = lcd_camera_start(&lcd_config);
@@ -0,0 +1,132 @@
+/*
+ * frame_slot_stress.c
+ * HTTP MJPEG 最新帧槽 (components/http_server/http_server.c) 的主机并发压力测试 (Linux)
+ *
+ * 直接包含 http_server.c，用其中的 http_server_send_frame / latest_frame_get / 通知登记，
+ * 一个生产者线程按摄像头任务的方式发布帧后立即释放自己的引用，N 个读者线程按推流任务的方式
+ * 等通知、取最新帧、持有一段时间后释放; 奇数号读者不等通知而是连续取帧，使生产者经常撞上
+ * 正在取帧的读者，走到延后释放 (retire) 的路径。检查:
+ *   - 读到的帧内容与帧序号一致 (帧未被提前释放或复用，配合 ASan 检出 use-after-free)
+ *   - 每个读者看到的帧序号不回退 (不会读到比上次更旧的帧)
+ *   - 结束后所有帧都已释放 (LeakSanitizer)
+ *
+ * 编译: gcc -O1 -g -fsanitize=address,undefined -ffunction-sections -Wl,--gc-sections \
+ *           -I../host_stubs -I../../components/http_server/include -I../../components/lcd_camera/include \
+ *           -I../../components/stream_util/include -I../../components/web_assets/include \
+ *           -include ../host_stubs/sdkconfig.h -o frame_slot_stress frame_slot_stress.c \
+ *           ../host_stubs/host_port.c ../../components/stream_util/stream_pacer.c \
+ *           ../../components/stream_util/stream_metrics.c -lpthread
+ *       (换成 -fsanitize=thread 可检查数据竞争)
+ * 示例: ./frame_slot_stress 300000 4
+ */
+#include "../../components/http_server/http_server.c"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "host_port.h"
+
+#define STRESS_READERS_MAX 8    // 偶数号读者登记通知，至多 4 个，与 HTTP_STREAM_MAX_CLIENTS 一致
+
+typedef struct {
+    int id;
+    uint64_t reads;
+    uint64_t distinct;
+    uint64_t older;         // 读到比上次更旧的帧
+    uint64_t corrupt;       // 帧内容与序号不符
+} reader_t;
+
+static bool stop;
+
+static lcd_camera_frame_t *frame_make(uint32_t seq) {
+    lcd_camera_frame_t *f = calloc(1, sizeof(*f));
+    f->len = 256 + (random() % 4096);
+    f->buf = malloc(f->len);
+    memset(f->buf, (uint8_t)seq, f->len);
+    f->seq = seq;
+    f->refcount = 1;
+    return f;
+}
+
+static void *producer(void *arg) {
+    uint32_t frames = (uint32_t)(uintptr_t)arg;
+    host_task_register("camera");
+    for (uint32_t seq = 1; seq <= frames; seq++) {
+        lcd_camera_frame_t *f = frame_make(seq);
+        http_server_send_frame(f);
+        lcd_camera_frame_unref(f);
+        if ((seq & 63) == 0) sched_yield();
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// 与 mjpeg_stream 相同的取帧方式: 登记通知，按帧序号判断新帧，没有新帧时等通知
+static void *reader(void *arg) {
+    reader_t *r = arg;
+    char name[16];
+    snprintf(name, sizeof(name), "reader%d", r->id);
+    host_task_register(name);
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    bool poll = r->id & 1;
+    bool notified = !poll && stream_waiter_set(NULL, self);
+    uint32_t last_seq = 0;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+        lcd_camera_frame_t *f = latest_frame_get();
+        r->reads++;
+        if (f == NULL || f->seq == last_seq) {
+            lcd_camera_frame_unref(f);
+            if (!poll) ulTaskNotifyTake(pdTRUE, 1);
+            continue;
+        }
+        if (f->seq < last_seq) r->older++;
+        last_seq = f->seq;
+        r->distinct++;
+        // 模拟发送: 读取整帧，期间生产者继续发布
+        for (size_t i = 0; i < f->len; i += 61) {
+            if (f->buf[i] != (uint8_t)f->seq) {
+                r->corrupt++;
+                break;
+            }
+        }
+        if ((r->distinct & 7) == 0) usleep(50);
+        lcd_camera_frame_unref(f);
+    }
+    if (notified) stream_waiter_set(self, NULL);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 300000;
+    int readers = argc > 2 ? atoi(argv[2]) : 4;
+    if (readers < 1 || readers > STRESS_READERS_MAX) readers = 4;
+
+    pthread_t rt[STRESS_READERS_MAX], pt;
+    reader_t rs[STRESS_READERS_MAX] = { 0 };
+    for (int i = 0; i < readers; i++) {
+        rs[i].id = i;
+        pthread_create(&rt[i], NULL, reader, &rs[i]);
+    }
+    pthread_create(&pt, NULL, producer, (void *)(uintptr_t)frames);
+    pthread_join(pt, NULL);
+    for (int i = 0; i < readers; i++) pthread_join(rt[i], NULL);
+
+    // 所有读者已退出: 释放槽中的最新帧与延后列表，剩余的帧由 LeakSanitizer 报告
+    lcd_camera_frame_unref(__atomic_exchange_n(&latest_frame, NULL, __ATOMIC_SEQ_CST));
+    retired_release();
+
+    uint64_t older = 0, corrupt = 0;
+    for (int i = 0; i < readers; i++) {
+        printf("reader %d: %llu reads, %llu distinct frames, %llu older, %llu corrupt\n", i,
+               (unsigned long long)rs[i].reads, (unsigned long long)rs[i].distinct,
+               (unsigned long long)rs[i].older, (unsigned long long)rs[i].corrupt);
+        older += rs[i].older;
+        corrupt += rs[i].corrupt;
+    }
+    printf("%u frames published, %u retires deferred, retire list %d at exit\n", frames,
+           (unsigned)mjpeg_stats.retire_deferred, retired_count);
+    bool ok = older == 0 && corrupt == 0 && retired_count == 0;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#pragma once
+// 只声明 http_server.c 用到的接口; 主机测试不启动 httpd，链接时由 --gc-sections 去掉请求处理函数
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "esp_err.h"
+typedef void *httpd_handle_t;
+typedef enum { HTTP_GET, HTTP_POST } httpd_method_t;
+typedef struct httpd_req {
+    httpd_handle_t handle;
+    int method;
+    const char uri[513];
+    size_t content_len;
+    void *user_ctx;
+} httpd_req_t;
+typedef struct httpd_uri {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+    bool is_websocket;
+    bool handle_ws_control_frames;
+} httpd_uri_t;
+typedef struct {
+    size_t stack_size;
+    uint16_t max_open_sockets;
+    uint16_t max_uri_handlers;
+    void (*close_fn)(httpd_handle_t hd, int sockfd);
+} httpd_config_t;
+#define HTTPD_DEFAULT_CONFIG() { .stack_size = 4096, .max_open_sockets = 7, .max_uri_handlers = 8 }
+typedef enum { HTTPD_500_INTERNAL_SERVER_ERROR, HTTPD_404_NOT_FOUND } httpd_err_code_t;
+#define HTTPD_RESP_USE_STRLEN -1
+#define ESP_ERR_HTTPD_RESULT_TRUNC 0xb004
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t len);
+esp_err_t httpd_resp_send_err(httpd_req_t *r, httpd_err_code_t err, const char *msg);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t len);
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out);
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r);
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd);
+int httpd_req_to_sockfd(httpd_req_t *r);
@@ -0,0 +1,2 @@
+#pragma once
+typedef void *esp_lcd_panel_handle_t;
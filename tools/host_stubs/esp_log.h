@@ -0,0 +1,7 @@
+#pragma once
+#include <stdio.h>
+#define ESP_LOGE(t, fmt, ...) printf("E %s: " fmt "\n", t, ##__VA_ARGS__)
+#define ESP_LOGW(t, fmt, ...) printf("W %s: " fmt "\n", t, ##__VA_ARGS__)
+#define ESP_LOGI(t, fmt, ...) printf("I %s: " fmt "\n", t, ##__VA_ARGS__)
+#define ESP_LOGD(t, fmt, ...) do { } while (0)
+#define ESP_LOGV(t, fmt, ...) do { } while (0)
@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  1
+#define portMAX_DELAY 0xffffffffu
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(x) ((TickType_t)(x))
@@ -0,0 +1,8 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef void *QueueHandle_t;
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
@@ -0,0 +1,14 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t prio, TaskHandle_t *handle);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
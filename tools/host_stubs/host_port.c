@@ -0,0 +1,333 @@
+// host_port.c
+// host_stubs 声明的 ESP-IDF / FreeRTOS 接口在 Linux 上的实现:
+// 任务为分离的 pthread，tick 为 1 ms，队列与信号量用 mutex + cond，任务通知为每任务计数
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
+#include "lwip/netif.h"
+#include "lwip/inet.h"
+#include "lcd_camera.h"
+#include "host_port.h"
+
+#define HOST_MAX_TASKS 32
+
+typedef struct {
+    char name[16];
+    pthread_mutex_t m;
+    pthread_cond_t c;
+    uint32_t notify;
+    int64_t lock_wait_max_us;
+} host_task_t;
+
+static host_task_t tasks[HOST_MAX_TASKS];
+static int task_count;
+static pthread_mutex_t tasks_m = PTHREAD_MUTEX_INITIALIZER;
+static __thread host_task_t *self;
+
+static struct netif host_netif = { .mtu = 1500 };
+struct netif *netif_default = &host_netif;
+
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t esp_random(void) {
+    return (uint32_t)random() ^ ((uint32_t)random() << 16);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
+
+void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+char *inet_ntoa_r(struct in_addr addr, char *buf, int len) {
+    inet_ntop(AF_INET, &addr, buf, len);
+    return buf;
+}
+
+// 帧引用计数与 lcd_camera.c 相同
+lcd_camera_frame_t *lcd_camera_frame_ref(lcd_camera_frame_t *frame) {
+    if (frame) __atomic_add_fetch(&frame->refcount, 1, __ATOMIC_RELAXED);
+    return frame;
+}
+
+void lcd_camera_frame_unref(lcd_camera_frame_t *frame) {
+    if (frame && __atomic_sub_fetch(&frame->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(frame->buf);
+        free(frame);
+    }
+}
+
+void lcd_camera_get_resolution(uint16_t *width, uint16_t *height) {
+    *width = 640;
+    *height = 480;
+}
+
+/* ---------------- 任务 ---------------- */
+
+void host_task_register(const char *name) {
+    pthread_mutex_lock(&tasks_m);
+    if (task_count >= HOST_MAX_TASKS) {
+        pthread_mutex_unlock(&tasks_m);
+        fprintf(stderr, "host_port: too many tasks\n");
+        abort();
+    }
+    host_task_t *t = &tasks[task_count++];
+    pthread_mutex_unlock(&tasks_m);
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    pthread_mutex_init(&t->m, NULL);
+    pthread_cond_init(&t->c, NULL);
+    self = t;
+}
+
+static host_task_t *task_self(void) {
+    if (!self) host_task_register("main");
+    return self;
+}
+
+void host_task_report_lock_wait(void) {
+    for (int i = 0; i < task_count; i++) {
+        printf("lock wait max %-14s %lld us\n", tasks[i].name, (long long)tasks[i].lock_wait_max_us);
+    }
+}
+
+typedef struct {
+    TaskFunction_t fn;
+    void *arg;
+    char name[16];
+} task_start_t;
+
+static void *task_trampoline(void *p) {
+    task_start_t s = *(task_start_t *)p;
+    free(p);
+    host_task_register(s.name);
+    s.fn(s.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core) {
+    pthread_t th;
+    task_start_t *s = malloc(sizeof(*s));
+    s->fn = fn;
+    s->arg = arg;
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    if (pthread_create(&th, NULL, task_trampoline, s) != 0) {
+        free(s);
+        return pdFALSE;
+    }
+    pthread_detach(th);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t prio, TaskHandle_t *handle) {
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep((useconds_t)ticks * 1000);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return task_self();
+}
+
+// ticks 后的绝对时间，portMAX_DELAY 返回 false 表示一直等
+static bool deadline(TickType_t ticks, struct timespec *ts) {
+    if (ticks == portMAX_DELAY) return false;
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+    return true;
+}
+
+// 在 m 上等待 c，超时返回 false; 调用方持有 m
+static bool cond_wait(pthread_cond_t *c, pthread_mutex_t *m, bool timed, const struct timespec *ts) {
+    if (!timed) return pthread_cond_wait(c, m) == 0;
+    return pthread_cond_timedwait(c, m, ts) != ETIMEDOUT;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    host_task_t *t = task;
+    pthread_mutex_lock(&t->m);
+    t->notify++;
+    pthread_cond_signal(&t->c);
+    pthread_mutex_unlock(&t->m);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    host_task_t *t = task_self();
+    struct timespec ts;
+    bool timed = deadline(ticks, &ts);
+    pthread_mutex_lock(&t->m);
+    while (t->notify == 0 && ticks != 0) {
+        if (!cond_wait(&t->c, &t->m, timed, &ts)) break;
+    }
+    uint32_t n = t->notify;
+    if (n) t->notify = clear ? 0 : n - 1;
+    pthread_mutex_unlock(&t->m);
+    return n;
+}
+
+/* ---------------- 队列 ---------------- */
+
+typedef struct {
+    pthread_mutex_t m;
+    pthread_cond_t c;
+    size_t item_size;
+    size_t len;
+    size_t head;
+    size_t count;
+    uint8_t *buf;
+} host_queue_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size) {
+    host_queue_t *q = calloc(1, sizeof(*q));
+    pthread_mutex_init(&q->m, NULL);
+    pthread_cond_init(&q->c, NULL);
+    q->item_size = item_size;
+    q->len = len;
+    q->buf = malloc((size_t)len * item_size);
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    host_queue_t *q = queue;
+    struct timespec ts;
+    bool timed = deadline(ticks, &ts);
+    pthread_mutex_lock(&q->m);
+    while (q->count == q->len) {
+        if (ticks == 0 || !cond_wait(&q->c, &q->m, timed, &ts)) {
+            pthread_mutex_unlock(&q->m);
+            return pdFALSE;
+        }
+    }
+    memcpy(q->buf + ((q->head + q->count) % q->len) * q->item_size, item, q->item_size);
+    q->count++;
+    pthread_cond_broadcast(&q->c);
+    pthread_mutex_unlock(&q->m);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    host_queue_t *q = queue;
+    struct timespec ts;
+    bool timed = deadline(ticks, &ts);
+    pthread_mutex_lock(&q->m);
+    while (q->count == 0) {
+        if (ticks == 0 || !cond_wait(&q->c, &q->m, timed, &ts)) {
+            pthread_mutex_unlock(&q->m);
+            return pdFALSE;
+        }
+    }
+    memcpy(item, q->buf + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->len;
+    q->count--;
+    pthread_cond_broadcast(&q->c);
+    pthread_mutex_unlock(&q->m);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->m);
+    UBaseType_t n = q->count;
+    pthread_mutex_unlock(&q->m);
+    return n;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    host_queue_t *q = queue;
+    pthread_mutex_lock(&q->m);
+    UBaseType_t n = q->len - q->count;
+    pthread_mutex_unlock(&q->m);
+    return n;
+}
+
+/* ---------------- 信号量 ---------------- */
+
+// 互斥锁即上限为 1 的计数信号量 (不做优先级继承)，取不到时记录调用任务的等待时长
+typedef struct {
+    pthread_mutex_t m;
+    pthread_cond_t c;
+    UBaseType_t count;
+    UBaseType_t max;
+} host_sem_t;
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+    host_sem_t *s = calloc(1, sizeof(*s));
+    pthread_mutex_init(&s->m, NULL);
+    pthread_cond_init(&s->c, NULL);
+    s->count = initial;
+    s->max = max;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    host_sem_t *s = sem;
+    host_task_t *t = task_self();
+    struct timespec ts;
+    bool timed = deadline(ticks, &ts);
+    int64_t start_us = esp_timer_get_time();
+    BaseType_t ret = pdTRUE;
+    pthread_mutex_lock(&s->m);
+    while (s->count == 0) {
+        if (ticks == 0 || !cond_wait(&s->c, &s->m, timed, &ts)) {
+            ret = pdFALSE;
+            break;
+        }
+    }
+    if (ret == pdTRUE) s->count--;
+    pthread_mutex_unlock(&s->m);
+    int64_t wait_us = esp_timer_get_time() - start_us;
+    if (wait_us > t->lock_wait_max_us) t->lock_wait_max_us = wait_us;
+    return ret;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    host_sem_t *s = sem;
+    pthread_mutex_lock(&s->m);
+    BaseType_t ret = s->count < s->max ? pdTRUE : pdFALSE;
+    if (ret == pdTRUE) {
+        s->count++;
+        pthread_cond_signal(&s->c);
+    }
+    pthread_mutex_unlock(&s->m);
+    return ret;
+}
@@ -0,0 +1,10 @@
+// host_port.h
+// host_port.c 额外提供给主机测试程序的接口
+#pragma once
+#include <stdint.h>
+
+// 当前线程登记为名为 name 的任务 (主线程默认 "main")
+void host_task_register(const char *name);
+
+// 各任务在 xSemaphoreTake 上的最长等待 (us)，按任务名输出到 stdout
+void host_task_report_lock_wait(void);
@@ -0,0 +1,3 @@
+#pragma once
+#include <arpa/inet.h>
+char *inet_ntoa_r(struct in_addr addr, char *buf, int len);
@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+struct netif { uint16_t mtu; };
+extern struct netif *netif_default;
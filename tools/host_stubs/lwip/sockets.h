@@ -0,0 +1,9 @@
+#pragma once
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
@@ -0,0 +1,18 @@
+#pragma once
+// 与各组件 Kconfig 的默认值一致
+#define CONFIG_CAMERA_STREAM_FRAME_RATE 10
+#define CONFIG_RTSP_MAX_CLIENTS 4
+#define CONFIG_RTSP_SESSION_TIMEOUT_S 60
+#define CONFIG_RTSP_SIMULCAST_ENABLE 1
+#define CONFIG_RTSP_SUBFRAME_ENABLE 1
+#define CONFIG_RTSP_MULTICAST_ENABLE 1
+#define CONFIG_RTSP_MULTICAST_ADDR "239.255.42.42"
+#define CONFIG_RTSP_MULTICAST_PORT 5008
+#define CONFIG_RTSP_MULTICAST_TTL 1
+#define CONFIG_RTSP_FEC_ENABLE 1
+#define CONFIG_RTSP_FEC_GROUP_SIZE 4
+#define CONFIG_RTSP_NACK_ENABLE 1
+#define CONFIG_RTSP_NACK_HISTORY_BYTES 49152
+#define CONFIG_RTSP_UDP_BATCH_ENABLE 1
+#define CONFIG_RTSP_UDP_BATCH_PKTS 16
+#define CONFIG_HTTP_MJPEG_GATHER 1
@@ -0,0 +1,1159 @@
+/*
+ * rtsp_bench.c
+ * RTSP/RTP MJPEG 负载与一致性测试客户端 (Linux)
+ *
+ * 走完整的 OPTIONS/DESCRIBE/SETUP/PLAY 流程，通过 UDP、TCP interleaved 或组播接收
+ * RTP/JPEG，按 RTP 时间戳重组整帧，统计 FPS、有效吞吐、丢包、乱序与帧完成耗时
+ * (帧首包到最后一个分片到达)。收到 RTCP SR 后还按 SR 的 NTP/RTP 对应关系把帧时间戳
+ * 换算回服务器的采集时刻，统计采集到整帧收齐的管线时延 (两端时钟偏差取 SR 到达的最小单程估计)；
+ * 服务器已校时的 SR 还与本机墙钟比较，输出偏差。可同时模拟 N 个客户端，并对收到的 RTP 包按脚本丢弃，
+ * 用于验证 ULPFEC 恢复 (-f) 与 RTCP NACK 重传 (-k) 的效果。
+ * -P 模式不走 RTSP，直接比较逐包 sendto 与 rtp_batch (sendmmsg) 的发包速率。
+ *
+ * 编译: gcc -O2 -Wall -I../../components/rtsp_server -o rtsp_bench rtsp_bench.c \
+ *           ../../components/rtsp_server/rtp_batch.c -lpthread
+ * 示例: ./rtsp_bench -n 4 -t udp -d 30 -l 0.02 -k rtsp://192.168.4.1:554/mjpeg/1
+ *       ./rtsp_bench -P 127.0.0.1:6000 -S 1400 -B 32 -d 4
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "rtp_batch.h"
+
+#define RTP_HEADER_SIZE     12
+#define JPEG_HEADER_SIZE    8
+#define RTP_PT_JPEG         26
+#define RTCP_PT_SR          200
+#define NTP_UNIX_OFFSET_S   2208988800LL    // 1900-01-01 到 1970-01-01 的秒数
+#define NTP_WALL_CLOCK_MIN_S 1577836800LL   // 2020-01-01，更早的 SR NTP 视为服务器开机时钟
+#define RTCP_PT_RR          201
+#define RTCP_PT_RTPFB       205
+#define MAX_PACKET          65536
+#define MAX_FRAME_SIZE      (512 * 1024)
+#define MAX_FRAGS           2048
+#define PENDING_FRAMES      4
+#define FEC_STORE_SLOTS     512         // 2 的幂
+#define FEC_MAX_PROTECT     1500
+#define KEEPALIVE_MS        20000
+#define RR_INTERVAL_MS      1000
+
+enum { TRANSPORT_UDP, TRANSPORT_TCP, TRANSPORT_MCAST };
+
+typedef struct {
+    char host[128];
+    int port;
+    char url[512];
+    int transport;
+    int clients;
+    int duration_s;
+    double loss_rate;       // 模拟随机丢包率
+    int loss_burst;         // 每次丢包事件连续丢弃的包数
+    unsigned int seed;
+    bool fec;
+    bool nack;
+    bool quiet;
+    int switch_tier;            // -w: 运行到一半时经 SET_PARAMETER 切换到的 streamid，-1 不切换
+    const char *pps_target;     // -P host:port
+    int pps_size;               // 包长 (RTP 头 + JPEG 头 + 负载)
+    int pps_batch;              // 每批包数
+} bench_opts_t;
+
+// 统计量由客户端线程写，主线程周期性读取汇总
+typedef struct {
+    uint64_t packets;           // 网络上实际收到的 RTP 媒体包 (不含模拟丢弃)
+    uint64_t bytes;             // 媒体包负载字节
+    uint64_t sim_dropped;       // 模拟丢弃
+    uint64_t duplicates;
+    uint64_t late;              // 序号小于已见最大值的迟到包 (乱序)
+    uint64_t fec_packets;
+    uint64_t fec_recovered;
+    uint64_t nack_sent;         // 请求重传的包数
+    uint64_t rtx_received;      // 收到的已请求重传包
+    uint64_t frames_complete;
+    uint64_t frames_recovered;  // 经 FEC/重传补齐后完成的帧
+    uint64_t frames_incomplete;
+    uint64_t frames_invalid;    // 完整但缺少 SOI/EOI
+    uint64_t goodput_bytes;     // 完整帧字节
+    uint64_t latency_us_sum;
+    uint64_t latency_us_max;
+    uint64_t pipe_frames;       // 统计了管线时延的帧 (已收到 SR)
+    uint64_t pipe_us_sum;       // 采集 (服务器) 到整帧收齐
+    uint64_t pipe_us_max;
+    uint64_t expected;          // 按扩展序号推算应收包数
+} bench_stats_t;
+
+typedef struct {
+    bool used;
+    bool had_loss;
+    uint32_t ts;
+    uint32_t total;             // marker 包到达后得知帧长
+    uint32_t received;          // 去重后收到的字节
+    uint64_t first_us;
+    int nfrags;
+    uint32_t frag_offsets[MAX_FRAGS];
+    uint8_t *buf;
+} frame_slot_t;
+
+typedef struct {
+    uint16_t seq;
+    uint16_t len;
+    bool valid;
+    uint8_t data[RTP_HEADER_SIZE + FEC_MAX_PROTECT];
+} fec_store_t;
+
+typedef struct {
+    int id;
+    const bench_opts_t *opts;
+    pthread_t thread;
+    unsigned int rand_state;
+    int burst_left;
+
+    int ctrl_sock;
+    int rtp_sock;
+    int rtcp_sock;
+    int fec_sock;
+    struct sockaddr_in server_rtcp;
+    int cseq;
+    char session[64];
+    int session_timeout_s;
+    char media_control[128];
+    bool sdp_has_fec;
+
+    // 序号追踪
+    bool seq_init;
+    uint16_t max_seq;
+    uint32_t ext_max;           // 扩展最高序号 (含回绕计数)
+    uint32_t base_ext;
+    uint32_t source_ssrc;
+    uint8_t seen[65536 / 8];
+    uint8_t nacked[65536 / 8];
+    uint64_t rr_expected_prior;
+    uint64_t rr_received_prior;
+    uint64_t received_total;    // 原始到达 + 恢复的唯一包
+
+    // RTCP SR 时间映射
+    bool sr_valid;
+    uint32_t sr_rtp;
+    int64_t sr_server_us;       // SR 的 NTP 时间 (服务器时钟，us)
+    int64_t clock_offset_us;    // 本地时钟 - 服务器时钟，取各 SR 的最小值
+    uint32_t sr_count;
+    uint32_t sr_wall_count;     // NTP 时间为墙钟 (服务器已校时) 的 SR
+    int64_t sr_wall_offset_us;  // 本地墙钟 - SR 墙钟，取最小值 (单程时延 + 两端墙钟偏差)
+
+    frame_slot_t frames[PENDING_FRAMES];
+    fec_store_t *store;
+
+    // TCP interleaved 接收缓冲
+    uint8_t *ilv_buf;
+    size_t ilv_len;
+
+    bench_stats_t st;
+    volatile bool done;
+    bool failed;
+} client_t;
+
+#define STAT_ADD(c, field, v) __atomic_fetch_add(&(c)->st.field, (uint64_t)(v), __ATOMIC_RELAXED)
+#define STAT_GET(c, field)    __atomic_load_n(&(c)->st.field, __ATOMIC_RELAXED)
+
+static volatile bool g_stop = false;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static inline bool bit_get(const uint8_t *bits, uint16_t i) { return bits[i >> 3] & (1 << (i & 7)); }
+static inline void bit_set(uint8_t *bits, uint16_t i) { bits[i >> 3] |= (1 << (i & 7)); }
+static inline void bit_clr(uint8_t *bits, uint16_t i) { bits[i >> 3] &= ~(1 << (i & 7)); }
+
+/* ---------------- RTSP 控制 ---------------- */
+
+static int parse_url(bench_opts_t *o, const char *url) {
+    if (strncmp(url, "rtsp://", 7) != 0) return -1;
+    snprintf(o->url, sizeof(o->url), "%s", url);
+    const char *h = url + 7;
+    const char *end = strpbrk(h, ":/");
+    size_t hl = end ? (size_t)(end - h) : strlen(h);
+    if (hl == 0 || hl >= sizeof(o->host)) return -1;
+    memcpy(o->host, h, hl);
+    o->host[hl] = 0;
+    o->port = (end && *end == ':') ? atoi(end + 1) : 554;
+    return 0;
+}
+
+// 读取一个完整 RTSP 响应 (头 + Content-Length 正文)，TCP interleaved 数据包会被跳过
+static int rtsp_read_response(client_t *c, char *resp, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        if (len >= size - 1) return -1;
+        int n = recv(c->ctrl_sock, resp + len, 1, 0);
+        if (n <= 0) return -1;
+        // 响应之前可能夹带 interleaved 包
+        if (len == 0 && resp[0] == '$') {
+            uint8_t hdr[3];
+            if (recv(c->ctrl_sock, hdr, 3, MSG_WAITALL) != 3) return -1;
+            int plen = (hdr[1] << 8) | hdr[2];
+            uint8_t skip[MAX_PACKET];
+            if (plen > 0 && recv(c->ctrl_sock, skip, plen, MSG_WAITALL) != plen) return -1;
+            continue;
+        }
+        len++;
+        resp[len] = 0;
+        if (len >= 4 && memcmp(resp + len - 4, "\r\n\r\n", 4) == 0) break;
+    }
+    const char *cl = strcasestr(resp, "Content-Length:");
+    if (cl) {
+        int body = atoi(cl + 15);
+        if (body < 0 || len + body >= size) return -1;
+        if (body > 0 && recv(c->ctrl_sock, resp + len, body, MSG_WAITALL) != body) return -1;
+        len += body;
+        resp[len] = 0;
+    }
+    return (int)len;
+}
+
+static int rtsp_request(client_t *c, const char *method, const char *url, const char *extra,
+                        char *resp, size_t size) {
+    char req[1024];
+    int n = snprintf(req, sizeof(req), "%s %s RTSP/1.0\r\nCSeq: %d\r\nUser-Agent: rtsp_bench\r\n%s%s%s%s\r\n",
+                     method, url, ++c->cseq,
+                     c->session[0] ? "Session: " : "", c->session, c->session[0] ? "\r\n" : "",
+                     extra ? extra : "");
+    if (send(c->ctrl_sock, req, n, MSG_NOSIGNAL) != n) return -1;
+    if (!resp) return 0;
+    if (rtsp_read_response(c, resp, size) < 0) return -1;
+    int code = 0;
+    sscanf(resp, "RTSP/1.0 %d", &code);
+    return code;
+}
+
+// SET_PARAMETER 带 text/parameters 正文，应答由接收循环读走丢弃
+static int rtsp_set_parameter(client_t *c, const char *body) {
+    char req[512];
+    int n = snprintf(req, sizeof(req),
+                     "SET_PARAMETER %s RTSP/1.0\r\nCSeq: %d\r\nUser-Agent: rtsp_bench\r\n"
+                     "Session: %s\r\nContent-Type: text/parameters\r\nContent-Length: %d\r\n\r\n%s",
+                     c->opts->url, ++c->cseq, c->session, (int)strlen(body), body);
+    return send(c->ctrl_sock, req, n, MSG_NOSIGNAL) == n ? 0 : -1;
+}
+
+static void rtsp_parse_session(client_t *c, const char *resp) {
+    const char *s = strcasestr(resp, "Session:");
+    if (!s) return;
+    s += 8;
+    while (*s == ' ') s++;
+    size_t n = strcspn(s, ";\r\n");
+    if (n >= sizeof(c->session)) n = sizeof(c->session) - 1;
+    memcpy(c->session, s, n);
+    c->session[n] = 0;
+    const char *t = strstr(s, "timeout=");
+    if (t && t < strstr(s, "\r\n")) c->session_timeout_s = atoi(t + 8);
+}
+
+static void sdp_parse(client_t *c, const char *sdp) {
+    // 第一个 m= 段的 a=control 为媒体轨道，a=control:fec 为 FEC 轨道
+    const char *m = strstr(sdp, "m=video");
+    const char *ctl = m ? strstr(m, "a=control:") : NULL;
+    if (ctl) {
+        ctl += 10;
+        size_t n = strcspn(ctl, "\r\n");
+        if (n >= sizeof(c->media_control)) n = sizeof(c->media_control) - 1;
+        memcpy(c->media_control, ctl, n);
+        c->media_control[n] = 0;
+    } else {
+        strcpy(c->media_control, "streamid=0");
+    }
+    c->sdp_has_fec = strstr(sdp, "a=control:fec") != NULL;
+}
+
+static int udp_bind_pair(int *rtp, int *rtcp, int base_port) {
+    for (int port = base_port; port < 65000; port += 2) {
+        int a = socket(AF_INET, SOCK_DGRAM, 0);
+        int b = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+        addr.sin_port = htons(port);
+        int ok = bind(a, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        addr.sin_port = htons(port + 1);
+        ok = ok && bind(b, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (ok) {
+            int rcvbuf = 4 * 1024 * 1024;
+            setsockopt(a, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+            *rtp = a;
+            *rtcp = b;
+            return port;
+        }
+        close(a);
+        close(b);
+    }
+    return -1;
+}
+
+static int mcast_join(int sock, const char *group) {
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr.s_addr = inet_addr(group);
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    return setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+}
+
+// 组播 SETUP 应答给出的端口由服务器决定，在该端口上重新绑定并加入组
+static int mcast_open(int *sock, const char *group, int port) {
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    int one = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port),
+                                .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0 || mcast_join(s, group) < 0) {
+        close(s);
+        return -1;
+    }
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (*sock >= 0) close(*sock);
+    *sock = s;
+    return 0;
+}
+
+static int rtsp_setup_track(client_t *c, const char *control, bool fec_track) {
+    const bench_opts_t *o = c->opts;
+    char url[768], extra[256], resp[4096];
+    if (strncmp(control, "rtsp://", 7) == 0) {
+        snprintf(url, sizeof(url), "%s", control);
+    } else {
+        snprintf(url, sizeof(url), "%s/%s", o->url, control);
+    }
+
+    int base = 0;
+    int *rtp = fec_track ? &c->fec_sock : &c->rtp_sock;
+    int rtcp_dummy = -1;
+    int *rtcp = fec_track ? &rtcp_dummy : &c->rtcp_sock;
+
+    if (o->transport == TRANSPORT_TCP) {
+        snprintf(extra, sizeof(extra), "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n",
+                 fec_track ? 2 : 0, fec_track ? 3 : 1);
+    } else if (o->transport == TRANSPORT_MCAST) {
+        snprintf(extra, sizeof(extra), "Transport: RTP/AVP;multicast\r\n");
+    } else {
+        base = udp_bind_pair(rtp, rtcp, 40000 + c->id * 8 + (fec_track ? 4 : 0));
+        if (base < 0) return -1;
+        snprintf(extra, sizeof(extra), "Transport: RTP/AVP;unicast;client_port=%d-%d\r\n", base, base + 1);
+    }
+
+    int code = rtsp_request(c, "SETUP", url, extra, resp, sizeof(resp));
+    if (rtcp_dummy >= 0) close(rtcp_dummy);
+    if (code != 200) {
+        fprintf(stderr, "[client %d] SETUP %s failed: %d\n", c->id, control, code);
+        return -1;
+    }
+    rtsp_parse_session(c, resp);
+
+    const char *tr = strcasestr(resp, "Transport:");
+    if (o->transport == TRANSPORT_UDP && tr && !fec_track) {
+        const char *sp = strstr(tr, "server_port=");
+        int rtp_port = 0, rtcp_port = 0;
+        if (sp && sscanf(sp, "server_port=%d-%d", &rtp_port, &rtcp_port) >= 1) {
+            if (rtcp_port == 0) rtcp_port = rtp_port + 1;
+            struct hostent *he = gethostbyname(o->host);
+            c->server_rtcp.sin_family = AF_INET;
+            c->server_rtcp.sin_port = htons(rtcp_port);
+            if (he) memcpy(&c->server_rtcp.sin_addr, he->h_addr_list[0], 4);
+        }
+    } else if (o->transport == TRANSPORT_MCAST && tr) {
+        char group[64] = "";
+        int port = 0;
+        const char *d = strstr(tr, "destination=");
+        const char *p = strstr(tr, "port=");
+        if (d) sscanf(d, "destination=%63[^;\r\n]", group);
+        if (p) sscanf(p, "port=%d", &port);
+        if (!group[0] || port == 0 || mcast_open(rtp, group, port) < 0) {
+            fprintf(stderr, "[client %d] multicast join %s:%d failed\n", c->id, group, port);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int rtsp_connect_and_play(client_t *c) {
+    const bench_opts_t *o = c->opts;
+    struct hostent *he = gethostbyname(o->host);
+    if (!he) return -1;
+
+    c->ctrl_sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(o->port) };
+    memcpy(&addr.sin_addr, he->h_addr_list[0], 4);
+    if (connect(c->ctrl_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "[client %d] connect: %s\n", c->id, strerror(errno));
+        return -1;
+    }
+    int one = 1;
+    setsockopt(c->ctrl_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval tv = { .tv_sec = 5 };
+    setsockopt(c->ctrl_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char resp[4096];
+    if (rtsp_request(c, "OPTIONS", o->url, NULL, resp, sizeof(resp)) != 200) return -1;
+    char describe_url[600];
+    snprintf(describe_url, sizeof(describe_url), "%s", o->url);
+    if (o->transport == TRANSPORT_MCAST && !strstr(o->url, "multicast")) {
+        snprintf(describe_url, sizeof(describe_url), "%s/multicast", o->url);
+    }
+    if (rtsp_request(c, "DESCRIBE", describe_url, "Accept: application/sdp\r\n", resp, sizeof(resp)) != 200) return -1;
+    const char *body = strstr(resp, "\r\n\r\n");
+    sdp_parse(c, body ? body + 4 : resp);
+
+    if (rtsp_setup_track(c, c->media_control, false) < 0) return -1;
+    if (o->fec && c->sdp_has_fec) {
+        if (rtsp_setup_track(c, "fec", true) < 0) {
+            fprintf(stderr, "[client %d] FEC track unavailable, continuing without\n", c->id);
+        }
+    }
+    if (rtsp_request(c, "PLAY", o->url, "Range: npt=0.000-\r\n", resp, sizeof(resp)) != 200) return -1;
+    return 0;
+}
+
+/* ---------------- RTCP ---------------- */
+
+static void rtcp_send(client_t *c, const uint8_t *pkt, int len) {
+    if (c->opts->transport == TRANSPORT_TCP) {
+        uint8_t buf[4 + 512];
+        buf[0] = '$'; buf[1] = 1; buf[2] = len >> 8; buf[3] = len & 0xFF;
+        memcpy(buf + 4, pkt, len);
+        send(c->ctrl_sock, buf, len + 4, MSG_NOSIGNAL);
+    } else if (c->opts->transport == TRANSPORT_UDP && c->rtcp_sock >= 0 && c->server_rtcp.sin_port) {
+        sendto(c->rtcp_sock, pkt, len, 0, (struct sockaddr *)&c->server_rtcp, sizeof(c->server_rtcp));
+    }
+}
+
+static inline void put32(uint8_t *p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+
+// 周期性 RR: 同时作为会话保活，服务器据 fraction lost 调整包长
+static void rtcp_send_rr(client_t *c) {
+    if (!c->seq_init) return;
+    uint32_t ext_max = c->ext_max;
+    uint64_t expected = (uint64_t)ext_max - c->base_ext + 1;
+    uint64_t expected_interval = expected - c->rr_expected_prior;
+    uint64_t received_interval = c->received_total - c->rr_received_prior;
+    c->rr_expected_prior = expected;
+    c->rr_received_prior = c->received_total;
+    int64_t lost_interval = (int64_t)expected_interval - (int64_t)received_interval;
+    uint8_t fraction = (expected_interval == 0 || lost_interval <= 0) ? 0
+                       : (uint8_t)((lost_interval << 8) / expected_interval);
+    int64_t cum_lost = (int64_t)expected - (int64_t)c->received_total;
+    if (cum_lost < 0) cum_lost = 0;
+
+    uint8_t rr[32];
+    rr[0] = 0x81; rr[1] = RTCP_PT_RR; rr[2] = 0; rr[3] = 7;
+    put32(rr + 4, 0xBEC00000u + c->id);
+    put32(rr + 8, c->source_ssrc);
+    put32(rr + 12, ((uint32_t)fraction << 24) | ((uint32_t)cum_lost & 0xFFFFFF));
+    put32(rr + 16, ext_max);
+    memset(rr + 20, 0, 12);     // jitter / LSR / DLSR
+    rtcp_send(c, rr, sizeof(rr));
+}
+
+// RFC 4585 Generic NACK: 缺失区间 [first, first+count)
+static void rtcp_send_nack(client_t *c, uint16_t first, uint16_t count) {
+    uint8_t pkt[12 + 4 * 16];
+    int fci = 0;
+    uint16_t s = first;
+    while (count > 0 && fci < 16) {
+        uint16_t pid = s;
+        uint16_t blp = 0;
+        s++; count--;
+        for (int b = 0; b < 16 && count > 0; b++, s++, count--) blp |= 1 << b;
+        pkt[12 + fci * 4 + 0] = pid >> 8; pkt[12 + fci * 4 + 1] = pid & 0xFF;
+        pkt[12 + fci * 4 + 2] = blp >> 8; pkt[12 + fci * 4 + 3] = blp & 0xFF;
+        fci++;
+    }
+    int len = 12 + fci * 4;
+    pkt[0] = 0x81; pkt[1] = RTCP_PT_RTPFB;
+    pkt[2] = 0; pkt[3] = (len / 4) - 1;
+    put32(pkt + 4, 0xBEC00000u + c->id);
+    put32(pkt + 8, c->source_ssrc);
+    rtcp_send(c, pkt, len);
+}
+
+/* ---------------- 帧重组 ---------------- */
+
+static void frame_finish(client_t *c, frame_slot_t *f, bool complete) {
+    if (complete) {
+        uint64_t lat = now_us() - f->first_us;
+        STAT_ADD(c, frames_complete, 1);
+        STAT_ADD(c, goodput_bytes, f->total);
+        STAT_ADD(c, latency_us_sum, lat);
+        if (lat > c->st.latency_us_max) __atomic_store_n(&c->st.latency_us_max, lat, __ATOMIC_RELAXED);
+        if (f->had_loss) STAT_ADD(c, frames_recovered, 1);
+        if (c->sr_valid) {
+            // 帧时间戳即采集时刻，按 90 kHz 时钟相对最近的 SR 换算
+            int64_t capture_us = c->sr_server_us + (int64_t)(int32_t)(f->ts - c->sr_rtp) * 1000 / 90;
+            int64_t pipe = (int64_t)now_us() - (capture_us + c->clock_offset_us);
+            if (pipe < 0) pipe = 0;
+            STAT_ADD(c, pipe_frames, 1);
+            STAT_ADD(c, pipe_us_sum, pipe);
+            if ((uint64_t)pipe > c->st.pipe_us_max) __atomic_store_n(&c->st.pipe_us_max, pipe, __ATOMIC_RELAXED);
+        }
+        if (f->total < 4 || f->buf[0] != 0xFF || f->buf[1] != 0xD8 ||
+            f->buf[f->total - 2] != 0xFF || f->buf[f->total - 1] != 0xD9) {
+            STAT_ADD(c, frames_invalid, 1);
+        }
+    } else {
+        STAT_ADD(c, frames_incomplete, 1);
+    }
+    f->used = false;
+}
+
+static frame_slot_t *frame_get(client_t *c, uint32_t ts) {
+    frame_slot_t *free_slot = NULL, *oldest = NULL;
+    for (int i = 0; i < PENDING_FRAMES; i++) {
+        frame_slot_t *f = &c->frames[i];
+        if (f->used && f->ts == ts) return f;
+        if (!f->used && !free_slot) free_slot = f;
+        if (f->used && (!oldest || f->first_us < oldest->first_us)) oldest = f;
+    }
+    if (!free_slot) {
+        frame_finish(c, oldest, false);
+        free_slot = oldest;
+    }
+    free_slot->used = true;
+    free_slot->had_loss = false;
+    free_slot->ts = ts;
+    free_slot->total = 0;
+    free_slot->received = 0;
+    free_slot->nfrags = 0;
+    free_slot->first_us = now_us();
+    return free_slot;
+}
+
+static void frame_add(client_t *c, const uint8_t *pkt, int len, bool recovered) {
+    if (len < RTP_HEADER_SIZE + JPEG_HEADER_SIZE) return;
+    int cc = pkt[0] & 0x0F;
+    int hdr = RTP_HEADER_SIZE + cc * 4;
+    if (len < hdr + JPEG_HEADER_SIZE) return;
+    bool marker = pkt[1] & 0x80;
+    uint32_t ts = ((uint32_t)pkt[4] << 24) | ((uint32_t)pkt[5] << 16) | ((uint32_t)pkt[6] << 8) | pkt[7];
+    const uint8_t *jh = pkt + hdr;
+    uint32_t offset = ((uint32_t)jh[1] << 16) | ((uint32_t)jh[2] << 8) | jh[3];
+    const uint8_t *data = jh + JPEG_HEADER_SIZE;
+    uint32_t dlen = len - hdr - JPEG_HEADER_SIZE;
+    if (offset + dlen > MAX_FRAME_SIZE) return;
+
+    frame_slot_t *f = frame_get(c, ts);
+    if (recovered) f->had_loss = true;
+    for (int i = 0; i < f->nfrags; i++) {
+        if (f->frag_offsets[i] == offset) return;   // 重复分片
+    }
+    if (f->nfrags >= MAX_FRAGS) return;
+    f->frag_offsets[f->nfrags++] = offset;
+    memcpy(f->buf + offset, data, dlen);
+    f->received += dlen;
+    if (marker) f->total = offset + dlen;
+    if (f->total && f->received >= f->total) frame_finish(c, f, true);
+}
+
+/* ---------------- RTP 接收 ---------------- */
+
+// RTCP SR: 记录 NTP/RTP 对应关系，并用到达时刻估计两端时钟偏差
+static void rtcp_receive(client_t *c, const uint8_t *pkt, int len) {
+    uint64_t t = now_us();
+    struct timeval wall;
+    gettimeofday(&wall, NULL);
+    while (len >= 8) {
+        int plen = (((pkt[2] << 8) | pkt[3]) + 1) * 4;
+        if (plen > len) break;
+        if (pkt[1] == RTCP_PT_SR && plen >= 28) {
+            uint32_t ntp_sec = ((uint32_t)pkt[8] << 24) | ((uint32_t)pkt[9] << 16) | ((uint32_t)pkt[10] << 8) | pkt[11];
+            uint32_t ntp_frac = ((uint32_t)pkt[12] << 24) | ((uint32_t)pkt[13] << 16) | ((uint32_t)pkt[14] << 8) | pkt[15];
+            int64_t server_us = (int64_t)ntp_sec * 1000000 + (int64_t)(((uint64_t)ntp_frac * 1000000) >> 32);
+            int64_t offset = (int64_t)t - server_us;
+            if (!c->sr_valid || offset < c->clock_offset_us) c->clock_offset_us = offset;
+            c->sr_rtp = ((uint32_t)pkt[16] << 24) | ((uint32_t)pkt[17] << 16) | ((uint32_t)pkt[18] << 8) | pkt[19];
+            c->sr_server_us = server_us;
+            c->sr_valid = true;
+            c->sr_count++;
+            if ((int64_t)ntp_sec >= NTP_UNIX_OFFSET_S + NTP_WALL_CLOCK_MIN_S) {
+                int64_t wall_off = (int64_t)wall.tv_sec * 1000000 + wall.tv_usec - (server_us - NTP_UNIX_OFFSET_S * 1000000);
+                if (!c->sr_wall_count || wall_off < c->sr_wall_offset_us) c->sr_wall_offset_us = wall_off;
+                c->sr_wall_count++;
+            }
+        }
+        pkt += plen;
+        len -= plen;
+    }
+}
+
+static void rtp_process(client_t *c, const uint8_t *pkt, int len, bool recovered);
+
+// 按 RFC 5109 用 FEC 包与组内其余包恢复唯一缺失的包
+static void fec_process(client_t *c, const uint8_t *fec, int len) {
+    STAT_ADD(c, fec_packets, 1);
+    if (!c->store || len < RTP_HEADER_SIZE + 14) return;
+    const uint8_t *fh = fec + RTP_HEADER_SIZE;
+    uint16_t sn_base = (fh[2] << 8) | fh[3];
+    uint16_t prot_len = (fh[10] << 8) | fh[11];
+    uint16_t mask = (fh[12] << 8) | fh[13];
+    const uint8_t *payload = fh + 14;
+    if (prot_len > FEC_MAX_PROTECT || RTP_HEADER_SIZE + 14 + prot_len > len) return;
+
+    int missing = -1, nmissing = 0;
+    for (int i = 0; i < 16; i++) {
+        if (!(mask & (0x8000 >> i))) continue;
+        uint16_t s = sn_base + i;
+        const fec_store_t *e = &c->store[s & (FEC_STORE_SLOTS - 1)];
+        if (!(e->valid && e->seq == s)) {
+            missing = i;
+            nmissing++;
+        }
+    }
+    if (nmissing != 1) return;
+
+    uint8_t rec[RTP_HEADER_SIZE + FEC_MAX_PROTECT];
+    uint8_t b0 = fh[0], b1 = fh[1];
+    uint8_t ts[4] = { fh[4], fh[5], fh[6], fh[7] };
+    uint16_t length = (fh[8] << 8) | fh[9];
+    uint32_t ssrc = 0;
+    memset(rec, 0, sizeof(rec));
+    memcpy(rec + RTP_HEADER_SIZE, payload, prot_len);
+    for (int i = 0; i < 16; i++) {
+        if (!(mask & (0x8000 >> i)) || i == missing) continue;
+        const fec_store_t *e = &c->store[(uint16_t)(sn_base + i) & (FEC_STORE_SLOTS - 1)];
+        b0 ^= e->data[0];
+        b1 ^= e->data[1];
+        for (int k = 0; k < 4; k++) ts[k] ^= e->data[4 + k];
+        length ^= (uint16_t)(e->len - RTP_HEADER_SIZE);
+        for (int k = 0; k < e->len - RTP_HEADER_SIZE && k < prot_len; k++) {
+            rec[RTP_HEADER_SIZE + k] ^= e->data[RTP_HEADER_SIZE + k];
+        }
+        ssrc = ((uint32_t)e->data[8] << 24) | ((uint32_t)e->data[9] << 16) | ((uint32_t)e->data[10] << 8) | e->data[11];
+    }
+    if (length > prot_len) return;
+
+    uint16_t seq = sn_base + missing;
+    rec[0] = 0x80 | (b0 & 0x3F);
+    rec[1] = b1;
+    rec[2] = seq >> 8; rec[3] = seq & 0xFF;
+    memcpy(rec + 4, ts, 4);
+    put32(rec + 8, ssrc);
+    STAT_ADD(c, fec_recovered, 1);
+    rtp_process(c, rec, RTP_HEADER_SIZE + length, true);
+}
+
+// 模拟丢包: 随机触发，每次连续丢弃 loss_burst 个包
+static bool sim_drop(client_t *c) {
+    if (c->burst_left > 0) {
+        c->burst_left--;
+        return true;
+    }
+    if (c->opts->loss_rate > 0 && (double)rand_r(&c->rand_state) / RAND_MAX < c->opts->loss_rate) {
+        c->burst_left = c->opts->loss_burst - 1;
+        return true;
+    }
+    return false;
+}
+
+static void rtp_process(client_t *c, const uint8_t *pkt, int len, bool recovered) {
+    if (len < RTP_HEADER_SIZE || (pkt[0] >> 6) != 2) return;
+    uint16_t seq = (pkt[2] << 8) | pkt[3];
+
+    if (!c->seq_init) {
+        c->seq_init = true;
+        c->max_seq = seq - 1;
+        c->base_ext = 65536 + seq;
+        c->ext_max = c->base_ext - 1;
+        c->source_ssrc = ((uint32_t)pkt[8] << 24) | ((uint32_t)pkt[9] << 16) | ((uint32_t)pkt[10] << 8) | pkt[11];
+        memset(c->seen, 0, sizeof(c->seen));
+    }
+
+    int16_t delta = (int16_t)(seq - c->max_seq);
+    if (delta > 0) {
+        // 新的最大序号: 清掉跨过的区间 (回绕前的旧标记)，其中未到的即为缺失
+        for (uint16_t s = c->max_seq + 1; s != (uint16_t)(seq + 1); s++) {
+            bit_clr(c->seen, s);
+            bit_clr(c->nacked, s);
+        }
+        if (delta > 1 && c->opts->nack && c->opts->transport != TRANSPORT_MCAST) {
+            uint16_t first = c->max_seq + 1;
+            uint16_t count = delta - 1;
+            rtcp_send_nack(c, first, count);
+            for (uint16_t k = 0; k < count; k++) bit_set(c->nacked, first + k);
+            STAT_ADD(c, nack_sent, count);
+        }
+        c->ext_max += delta;
+        c->max_seq = seq;
+    } else {
+        if (bit_get(c->seen, seq)) {
+            STAT_ADD(c, duplicates, 1);
+            return;
+        }
+        if (!recovered) {
+            if (bit_get(c->nacked, seq)) STAT_ADD(c, rtx_received, 1);
+            else STAT_ADD(c, late, 1);
+        }
+        recovered = true;   // 迟到/重传补上的包所在帧计为经恢复完成
+    }
+    bit_set(c->seen, seq);
+    c->received_total++;
+
+    if (c->store && len <= (int)sizeof(c->store[0].data)) {
+        fec_store_t *e = &c->store[seq & (FEC_STORE_SLOTS - 1)];
+        e->seq = seq;
+        e->len = len;
+        e->valid = true;
+        memcpy(e->data, pkt, len);
+    }
+
+    __atomic_store_n(&c->st.expected, (uint64_t)c->ext_max - c->base_ext + 1, __ATOMIC_RELAXED);
+    frame_add(c, pkt, len, recovered);
+}
+
+static void rtp_receive(client_t *c, const uint8_t *pkt, int len, bool fec) {
+    if (sim_drop(c)) {
+        STAT_ADD(c, sim_dropped, 1);
+        return;
+    }
+    if (fec) {
+        fec_process(c, pkt, len);
+        return;
+    }
+    if (len >= 2 && (pkt[1] & 0x7F) != RTP_PT_JPEG) return;
+    STAT_ADD(c, packets, 1);
+    STAT_ADD(c, bytes, len);
+    rtp_process(c, pkt, len, false);
+}
+
+// TCP interleaved 流解析: '$' ch len16 data，其余为 RTSP 响应 (保活应答) 直接跳过
+static int ilv_consume(client_t *c) {
+    size_t pos = 0;
+    while (pos < c->ilv_len) {
+        uint8_t *p = c->ilv_buf + pos;
+        size_t avail = c->ilv_len - pos;
+        if (p[0] == '$') {
+            if (avail < 4) break;
+            size_t plen = (p[2] << 8) | p[3];
+            if (avail < 4 + plen) break;
+            if (p[1] == 0) rtp_receive(c, p + 4, plen, false);
+            else if (p[1] == 2) rtp_receive(c, p + 4, plen, true);
+            pos += 4 + plen;
+        } else {
+            uint8_t *end = memmem(p, avail, "\r\n\r\n", 4);
+            if (!end) break;
+            size_t hlen = end + 4 - p;
+            const char *cl = memmem(p, hlen, "Content-Length:", 15);
+            size_t body = cl ? (size_t)atoi(cl + 15) : 0;
+            if (avail < hlen + body) break;
+            pos += hlen + body;
+        }
+    }
+    memmove(c->ilv_buf, c->ilv_buf + pos, c->ilv_len - pos);
+    c->ilv_len -= pos;
+    return 0;
+}
+
+static void *client_thread(void *arg) {
+    client_t *c = arg;
+    const bench_opts_t *o = c->opts;
+    c->ctrl_sock = c->rtp_sock = c->rtcp_sock = c->fec_sock = -1;
+    c->session_timeout_s = 60;
+    c->rand_state = o->seed + c->id * 7919;
+    for (int i = 0; i < PENDING_FRAMES; i++) c->frames[i].buf = malloc(MAX_FRAME_SIZE);
+    if (o->fec) c->store = calloc(FEC_STORE_SLOTS, sizeof(fec_store_t));
+    if (o->transport == TRANSPORT_TCP) c->ilv_buf = malloc(2 * MAX_PACKET);
+
+    if (rtsp_connect_and_play(c) < 0) {
+        fprintf(stderr, "[client %d] RTSP setup failed\n", c->id);
+        c->failed = true;
+        goto out;
+    }
+
+    uint8_t pkt[MAX_PACKET];
+    uint64_t last_keepalive = now_us(), last_rr = now_us();
+    uint64_t switch_at = now_us() + (uint64_t)o->duration_s * 500000;
+    uint64_t keepalive_us = (uint64_t)(c->session_timeout_s > 0 ? c->session_timeout_s * 500 : KEEPALIVE_MS) * 1000;
+    if (keepalive_us > KEEPALIVE_MS * 1000ULL) keepalive_us = KEEPALIVE_MS * 1000ULL;
+
+    while (!g_stop) {
+        struct pollfd pfd[4];
+        int n = 0;
+        pfd[n++] = (struct pollfd){ .fd = c->ctrl_sock, .events = POLLIN };
+        if (c->rtp_sock >= 0) pfd[n++] = (struct pollfd){ .fd = c->rtp_sock, .events = POLLIN };
+        if (c->fec_sock >= 0) pfd[n++] = (struct pollfd){ .fd = c->fec_sock, .events = POLLIN };
+        if (c->rtcp_sock >= 0) pfd[n++] = (struct pollfd){ .fd = c->rtcp_sock, .events = POLLIN };
+        if (poll(pfd, n, 100) < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < n; i++) {
+            if (!(pfd[i].revents & (POLLIN | POLLERR | POLLHUP))) continue;
+            int fd = pfd[i].fd;
+            if (fd == c->ctrl_sock) {
+                if (o->transport == TRANSPORT_TCP) {
+                    ssize_t r = recv(fd, c->ilv_buf + c->ilv_len, 2 * MAX_PACKET - c->ilv_len, 0);
+                    if (r <= 0) { g_stop = true; break; }
+                    c->ilv_len += r;
+                    ilv_consume(c);
+                } else {
+                    char tmp[2048];
+                    if (recv(fd, tmp, sizeof(tmp), 0) <= 0) {
+                        fprintf(stderr, "[client %d] control connection closed\n", c->id);
+                        goto out;
+                    }
+                }
+            } else {
+                ssize_t r;
+                while ((r = recv(fd, pkt, sizeof(pkt), MSG_DONTWAIT)) > 0) {
+                    if (fd == c->rtp_sock) rtp_receive(c, pkt, r, false);
+                    else if (fd == c->fec_sock) rtp_receive(c, pkt, r, true);
+                    else rtcp_receive(c, pkt, r);
+                }
+            }
+        }
+
+        uint64_t t = now_us();
+        if (t - last_rr >= RR_INTERVAL_MS * 1000ULL) {
+            rtcp_send_rr(c);
+            last_rr = t;
+        }
+        if (t - last_keepalive >= keepalive_us) {
+            rtsp_request(c, "GET_PARAMETER", o->url, NULL, NULL, 0);
+            last_keepalive = t;
+        }
+        if (o->switch_tier >= 0 && t >= switch_at) {
+            char body[32];
+            snprintf(body, sizeof(body), "streamid: %d\r\n", o->switch_tier);
+            if (!o->quiet) printf("[client %d] switching to streamid=%d\n", c->id, o->switch_tier);
+            rtsp_set_parameter(c, body);
+            switch_at = UINT64_MAX;
+        }
+    }
+
+    rtsp_request(c, "TEARDOWN", o->url, NULL, NULL, 0);
+out:
+    for (int i = 0; i < PENDING_FRAMES; i++) {
+        if (c->frames[i].used) frame_finish(c, &c->frames[i], false);
+    }
+    if (c->ctrl_sock >= 0) close(c->ctrl_sock);
+    if (c->rtp_sock >= 0) close(c->rtp_sock);
+    if (c->rtcp_sock >= 0) close(c->rtcp_sock);
+    if (c->fec_sock >= 0) close(c->fec_sock);
+    for (int i = 0; i < PENDING_FRAMES; i++) free(c->frames[i].buf);
+    free(c->store);
+    free(c->ilv_buf);
+    c->done = true;
+    return NULL;
+}
+
+/* ---------------- 汇总输出 ---------------- */
+
+static void stats_sum(client_t *cl, int n, bench_stats_t *sum) {
+    memset(sum, 0, sizeof(*sum));
+    for (int i = 0; i < n; i++) {
+        client_t *c = &cl[i];
+        sum->packets += STAT_GET(c, packets);
+        sum->bytes += STAT_GET(c, bytes);
+        sum->sim_dropped += STAT_GET(c, sim_dropped);
+        sum->duplicates += STAT_GET(c, duplicates);
+        sum->late += STAT_GET(c, late);
+        sum->fec_packets += STAT_GET(c, fec_packets);
+        sum->fec_recovered += STAT_GET(c, fec_recovered);
+        sum->nack_sent += STAT_GET(c, nack_sent);
+        sum->rtx_received += STAT_GET(c, rtx_received);
+        sum->frames_complete += STAT_GET(c, frames_complete);
+        sum->frames_recovered += STAT_GET(c, frames_recovered);
+        sum->frames_incomplete += STAT_GET(c, frames_incomplete);
+        sum->frames_invalid += STAT_GET(c, frames_invalid);
+        sum->goodput_bytes += STAT_GET(c, goodput_bytes);
+        sum->latency_us_sum += STAT_GET(c, latency_us_sum);
+        uint64_t m = STAT_GET(c, latency_us_max);
+        if (m > sum->latency_us_max) sum->latency_us_max = m;
+        sum->pipe_frames += STAT_GET(c, pipe_frames);
+        sum->pipe_us_sum += STAT_GET(c, pipe_us_sum);
+        m = STAT_GET(c, pipe_us_max);
+        if (m > sum->pipe_us_max) sum->pipe_us_max = m;
+        sum->expected += STAT_GET(c, expected);
+    }
+}
+
+static void stats_print(const char *label, const bench_stats_t *s, const bench_stats_t *prev,
+                        double secs, int clients) {
+    uint64_t frames = s->frames_complete - (prev ? prev->frames_complete : 0);
+    uint64_t good = s->goodput_bytes - (prev ? prev->goodput_bytes : 0);
+    uint64_t lat_n = frames ? frames : 1;
+    uint64_t lat = s->latency_us_sum - (prev ? prev->latency_us_sum : 0);
+    uint64_t pipe_n = s->pipe_frames - (prev ? prev->pipe_frames : 0);
+    uint64_t pipe = s->pipe_us_sum - (prev ? prev->pipe_us_sum : 0);
+    // 重传包也计入 packets，恢复前的丢包率需扣除
+    uint64_t recv_net = s->packets - s->rtx_received;
+    uint64_t lost_net = s->expected > recv_net ? s->expected - recv_net : 0;
+    uint64_t residual = s->expected > s->packets + s->fec_recovered
+                        ? s->expected - s->packets - s->fec_recovered : 0;
+    printf("%s %6.1f fps/client  %8.1f kbps goodput  loss %5.2f%% (residual %5.2f%%)  "
+           "late %llu  dup %llu  fec %llu  rtx %llu/%llu  frames ok %llu (recovered %llu) "
+           "incomplete %llu invalid %llu  latency avg %.1f ms max %.1f ms  "
+           "capture->rx avg %.1f ms max %.1f ms\n",
+           label,
+           secs > 0 ? frames / secs / clients : 0.0,
+           secs > 0 ? good * 8 / secs / 1000.0 : 0.0,
+           s->expected ? 100.0 * lost_net / s->expected : 0.0,
+           s->expected ? 100.0 * residual / s->expected : 0.0,
+           (unsigned long long)s->late, (unsigned long long)s->duplicates,
+           (unsigned long long)s->fec_recovered,
+           (unsigned long long)s->rtx_received, (unsigned long long)s->nack_sent,
+           (unsigned long long)s->frames_complete, (unsigned long long)s->frames_recovered,
+           (unsigned long long)s->frames_incomplete, (unsigned long long)s->frames_invalid,
+           lat / (double)lat_n / 1000.0, s->latency_us_max / 1000.0,
+           pipe_n ? pipe / (double)pipe_n / 1000.0 : 0.0, s->pipe_us_max / 1000.0);
+    fflush(stdout);
+}
+
+/* ---------------- 发包速率 (-P) ---------------- */
+
+typedef struct {
+    int sock;
+    volatile bool stop;
+    uint64_t packets;
+} pps_sink_t;
+
+static void *pps_sink_thread(void *arg) {
+    pps_sink_t *sink = arg;
+    uint8_t buf[MAX_PACKET];
+    while (!sink->stop) {
+        if (recv(sink->sock, buf, sizeof(buf), 0) > 0) {
+            __atomic_fetch_add(&sink->packets, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+// 按固件的分包方式循环发送 64KB 合成帧; batch <= 1 时逐包拼包 + sendto，否则走 rtp_batch
+static uint64_t pps_run(const struct sockaddr_in *dst, int size, int batch, double secs) {
+    static uint8_t frame[64 * 1024];
+    uint8_t pkt[MAX_PACKET];
+    int payload = size - RTP_HEADER_SIZE - JPEG_HEADER_SIZE;
+    uint64_t sent = 0;
+    uint16_t seq = 0;
+    uint32_t ts = 0;
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    rtp_batch_t *b = NULL;
+    if (batch > 1) {
+        b = malloc(sizeof(*b));
+        if (rtp_batch_open(b, 0, 0, batch) < 0) {
+            fprintf(stderr, "rtp_batch_open: %s\n", strerror(b->last_err));
+            free(b);
+            close(sock);
+            return 0;
+        }
+    }
+
+    uint64_t start = now_us();
+    while (now_us() - start < secs * 1e6) {
+        for (int off = 0; off < (int)sizeof(frame); off += payload) {
+            int chunk = (int)sizeof(frame) - off < payload ? (int)sizeof(frame) - off : payload;
+            bool last = off + chunk >= (int)sizeof(frame);
+            uint8_t *h = pkt;
+            h[0] = 0x80; h[1] = (last ? 0x80 : 0) | RTP_PT_JPEG;
+            h[2] = seq >> 8; h[3] = seq & 0xFF;
+            put32(h + 4, ts);
+            put32(h + 8, 0x12345678);
+            h[12] = 0; h[13] = off >> 16; h[14] = off >> 8; h[15] = off;
+            h[16] = 1; h[17] = 0x3F; h[18] = 80; h[19] = 60;
+            seq++;
+            if (b) {
+                while (rtp_batch_add(b, dst, h, RTP_HEADER_SIZE + JPEG_HEADER_SIZE,
+                                     frame + off, chunk, RTP_BATCH_F_MEDIA) < 0) {
+                    if (rtp_batch_flush(b) < 0) goto out;
+                }
+            } else {
+                memcpy(pkt + RTP_HEADER_SIZE + JPEG_HEADER_SIZE, frame + off, chunk);
+                if (sendto(sock, pkt, RTP_HEADER_SIZE + JPEG_HEADER_SIZE + chunk, 0,
+                           (const struct sockaddr *)dst, sizeof(*dst)) > 0) {
+                    sent++;
+                }
+            }
+        }
+        while (b && rtp_batch_pending(b) > 0) {
+            if (rtp_batch_flush(b) < 0) goto out;
+        }
+        ts += 6000;
+    }
+out:
+    if (b) {
+        sent = b->media_sent;
+        rtp_batch_close(b);
+        free(b);
+    }
+    close(sock);
+    return sent;
+}
+
+static int pps_bench(const bench_opts_t *o) {
+    char host[128];
+    int port = 0;
+    if (sscanf(o->pps_target, "%127[^:]:%d", host, &port) != 2 || port <= 0) return -1;
+    if (o->pps_size <= RTP_HEADER_SIZE + JPEG_HEADER_SIZE || o->pps_size > 65000) return -1;
+    struct sockaddr_in dst = { .sin_family = AF_INET, .sin_port = htons(port) };
+    if (inet_pton(AF_INET, host, &dst.sin_addr) != 1) return -1;
+
+    // 目标为本机时起一个接收端，统计实际到达的包
+    pps_sink_t sink = { .sock = -1 };
+    pthread_t sink_thread;
+    if ((ntohl(dst.sin_addr.s_addr) >> 24) == 127) {
+        sink.sock = socket(AF_INET, SOCK_DGRAM, 0);
+        int rcvbuf = 8 * 1024 * 1024;
+        setsockopt(sink.sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        struct timeval tv = { .tv_usec = 100000 };
+        setsockopt(sink.sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (bind(sink.sock, (struct sockaddr *)&dst, sizeof(dst)) < 0) {
+            close(sink.sock);
+            sink.sock = -1;
+        } else {
+            pthread_create(&sink_thread, NULL, pps_sink_thread, &sink);
+        }
+    }
+
+    double secs = o->duration_s / 2.0;
+    const int batches[2] = { 1, o->pps_batch };
+    uint64_t pps[2] = {0};
+    for (int i = 0; i < 2; i++) {
+        uint64_t rx0 = __atomic_load_n(&sink.packets, __ATOMIC_RELAXED);
+        uint64_t sent = pps_run(&dst, o->pps_size, batches[i], secs);
+        usleep(200000);
+        uint64_t rx = __atomic_load_n(&sink.packets, __ATOMIC_RELAXED) - rx0;
+        pps[i] = (uint64_t)(sent / secs);
+        printf("%-10s batch %-3d %9llu pkt/s  %8.1f Mbit/s",
+               i == 0 ? "sendto" : "rtp_batch", batches[i], (unsigned long long)pps[i],
+               pps[i] * o->pps_size * 8 / 1e6);
+        if (sink.sock >= 0) printf("  received %.1f%%", sent ? 100.0 * rx / sent : 0.0);
+        printf("\n");
+    }
+    if (pps[0]) printf("speedup x%.2f\n", (double)pps[1] / pps[0]);
+
+    if (sink.sock >= 0) {
+        sink.stop = true;
+        pthread_join(sink_thread, NULL);
+        close(sink.sock);
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] rtsp://host[:port]/path\n"
+            "  -n N      concurrent clients (default 1)\n"
+            "  -t MODE   transport: udp | tcp | mcast (default udp)\n"
+            "  -d SEC    test duration in seconds (default 10)\n"
+            "  -l RATE   simulated random loss of received RTP packets, 0..1\n"
+            "  -b LEN    packets dropped per loss event (burst length, default 1)\n"
+            "  -s SEED   random seed for the loss script (default 1)\n"
+            "  -f        SETUP the FEC track when offered and recover with ULPFEC\n"
+            "  -k        send RTCP Generic NACK for missing packets (unicast)\n"
+            "  -q        print only the final summary\n"
+            "  -w N      switch to streamid=N with SET_PARAMETER halfway through the run\n"
+            "usage: %s -P host:port [-S size] [-B batch] [-d SEC]\n"
+            "  -P        raw packet-rate test: per-packet sendto vs rtp_batch, no RTSP\n"
+            "  -S SIZE   packet size incl. RTP and JPEG headers (default 1400)\n"
+            "  -B N      packets per batch (default 16)\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t o = { .transport = TRANSPORT_UDP, .clients = 1, .duration_s = 10,
+                       .loss_burst = 1, .seed = 1, .switch_tier = -1, .pps_size = 1400, .pps_batch = 16 };
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:d:l:b:s:fkqw:P:S:B:h")) != -1) {
+        switch (opt) {
+        case 'n': o.clients = atoi(optarg); break;
+        case 't':
+            if (!strcmp(optarg, "tcp")) o.transport = TRANSPORT_TCP;
+            else if (!strcmp(optarg, "mcast")) o.transport = TRANSPORT_MCAST;
+            else o.transport = TRANSPORT_UDP;
+            break;
+        case 'd': o.duration_s = atoi(optarg); break;
+        case 'l': o.loss_rate = atof(optarg); break;
+        case 'b': o.loss_burst = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+        case 's': o.seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'f': o.fec = true; break;
+        case 'k': o.nack = true; break;
+        case 'q': o.quiet = true; break;
+        case 'w': o.switch_tier = atoi(optarg); break;
+        case 'P': o.pps_target = optarg; break;
+        case 'S': o.pps_size = atoi(optarg); break;
+        case 'B': o.pps_batch = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (o.pps_target) {
+        if (pps_bench(&o) < 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        return 0;
+    }
+    if (optind >= argc || parse_url(&o, argv[optind]) < 0 || o.clients <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    client_t *cl = calloc(o.clients, sizeof(client_t));
+    for (int i = 0; i < o.clients; i++) {
+        cl[i].id = i;
+        cl[i].opts = &o;
+        pthread_create(&cl[i].thread, NULL, client_thread, &cl[i]);
+    }
+
+    bench_stats_t prev = {0}, cur;
+    uint64_t start = now_us(), last = start;
+    while (!g_stop) {
+        usleep(100000);
+        uint64_t t = now_us();
+        bool all_done = true;
+        for (int i = 0; i < o.clients; i++) all_done &= cl[i].done;
+        if (all_done || t - start >= (uint64_t)o.duration_s * 1000000ULL) g_stop = true;
+        if (!o.quiet && t - last >= 1000000) {
+            stats_sum(cl, o.clients, &cur);
+            stats_print("[1s]", &cur, &prev, (t - last) / 1e6, o.clients);
+            prev = cur;
+            last = t;
+        }
+    }
+
+    int failed = 0;
+    for (int i = 0; i < o.clients; i++) {
+        pthread_join(cl[i].thread, NULL);
+        failed += cl[i].failed;
+    }
+    stats_sum(cl, o.clients, &cur);
+    printf("---- %d client(s), %s, %.1f s, simulated loss %.2f%% burst %d ----\n",
+           o.clients, o.transport == TRANSPORT_TCP ? "tcp" : o.transport == TRANSPORT_MCAST ? "mcast" : "udp",
+           (now_us() - start) / 1e6, o.loss_rate * 100, o.loss_burst);
+    stats_print("[total]", &cur, NULL, (now_us() - start) / 1e6, o.clients);
+    if (cur.frames_complete + cur.frames_incomplete > 0) {
+        printf("frame completion rate %.2f%%, recovered-frame rate %.2f%%\n",
+               100.0 * cur.frames_complete / (cur.frames_complete + cur.frames_incomplete),
+               100.0 * cur.frames_recovered / (cur.frames_complete + cur.frames_incomplete));
+    }
+    for (int i = 0; i < o.clients; i++) {
+        if (!cl[i].sr_count) continue;
+        if (cl[i].sr_wall_count) {
+            printf("client %d: SR NTP vs local wall clock %+.2f ms (min of %u SR)\n",
+                   i, cl[i].sr_wall_offset_us / 1000.0, cl[i].sr_wall_count);
+        } else {
+            printf("client %d: SR NTP is server uptime (%u SR, wall clock not set)\n", i, cl[i].sr_count);
+        }
+    }
+    free(cl);
+    return failed == o.clients ? 2 : 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * rtsp_host.c
+ * 在 Linux 上运行 RTSP 服务组件 (components/rtsp_server)，配合 tools/rtsp_bench 做主机端对比测试
+ *
+ * 主线程代替摄像头任务产生合成 JPEG 帧 (帧率由服务端按 CONFIG_CAMERA_STREAM_FRAME_RATE 节拍控制)
+ * (仅 SOI/EOI 有效，内容按帧序号填充)，按 rtsp_stream_tiers_get() 给出的档位整帧发送，
+ * 或设置 CHUNK 后每 1 KB 调用一次 rtsp_server_send_chunk 模拟边编码边发送。
+ * 运行结束后输出 rtsp_stats 的 JSON、各任务最长锁等待，并把 Prometheus 指标写入 metrics.txt。
+ *
+ * 环境变量:
+ *   CHUNK=1        分块发送 (RTSP_SUBFRAME_ENABLE 路径)
+ *   ENC_US=N       每帧模拟编码耗时 (us)，分块时按字节比例分摊
+ *   PKT_US=N       模拟无线链路: 每个 RTP 包占用链路 N us (RTCP 等小包不排队)
+ *   QUEUE_PKTS=N   模拟链路发送队列深度 (包)，队满时 sendto/sendmmsg 阻塞，默认 16
+ *
+ * 编译 (在仓库根目录):
+ *   gcc -O1 -g -I tools/host_stubs -I components/rtsp_server -I components/rtsp_server/include \
+ *       -I components/letter_shell/include -I components/lcd_camera/include -I components/stream_util/include \
+ *       -include tools/host_stubs/sdkconfig.h -o rtsp_host tools/rtsp_host/rtsp_host.c \
+ *       components/rtsp_server/rtsp_server.c components/rtsp_server/rtp_fec.c components/rtsp_server/rtp_history.c \
+ *       components/rtsp_server/rtsp_stats.c components/rtsp_server/rtp_batch.c \
+ *       components/stream_util/stream_metrics.c tools/host_stubs/host_port.c \
+ *       -lpthread -Wl,--wrap=sendto -Wl,--wrap=sendmmsg
+ *   (TCP 交织传输需另加 -DTCP_STREAM_ENABLE，否则 SETUP 返回 461)
+ * 示例: PKT_US=800 CHUNK=1 ENC_US=60000 ./rtsp_host 30 30000
+ *       ./rtsp_bench -n 1 -t udp -d 25 rtsp://127.0.0.1:554/mjpeg/1
+ * 监听 554 端口需要 root 或 CAP_NET_BIND_SERVICE。
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "esp_timer.h"
+#include "lcd_camera.h"
+#include "rtsp_server.h"
+#include "rtsp_stats.h"
+#include "host_port.h"
+
+#define HOST_CHUNK_SIZE     1024
+#define HOST_STATS_BUF_SIZE 8192
+
+/* ---------------- letter_shell 替身 (rtsp_stats 的命令输出) ---------------- */
+
+void *shellGetCurrent(void) { return NULL; }
+
+unsigned short shellWriteString(void *shell, const char *string) {
+    (void)shell;
+    fputs(string, stdout);
+    return 0;
+}
+
+/* ---------------- 模拟无线链路 ----------------
+ * sendto/sendmmsg 只把 RTP 包放入链路队列 (队列满时阻塞，相当于 WiFi 发送缓冲占满)，
+ * 链路线程每 PKT_US 放出一个数据报。PKT_US 未设置时直接发送。 */
+
+ssize_t __real_sendto(int s, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t tolen);
+int __real_sendmmsg(int s, struct mmsghdr *msgs, unsigned int n, int flags);
+
+#define LINK_QUEUE_MAX      256
+#define LINK_PKT_MIN        100     // 更小的包 (RTCP) 不排队
+
+typedef struct {
+    int sock;
+    struct sockaddr_in addr;
+    size_t len;
+    uint8_t data[2048];
+} link_pkt_t;
+
+static link_pkt_t link_queue[LINK_QUEUE_MAX];
+static int link_head, link_count, link_depth = 16, link_pkt_us = -1;
+static pthread_mutex_t link_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t link_c = PTHREAD_COND_INITIALIZER;
+static pthread_once_t link_once = PTHREAD_ONCE_INIT;
+
+static void *link_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&link_m);
+        while (link_count == 0) pthread_cond_wait(&link_c, &link_m);
+        link_pkt_t p = link_queue[link_head];
+        pthread_mutex_unlock(&link_m);
+
+        usleep(link_pkt_us);
+        __real_sendto(p.sock, p.data, p.len, 0, (struct sockaddr *)&p.addr, sizeof(p.addr));
+
+        pthread_mutex_lock(&link_m);
+        link_head = (link_head + 1) % LINK_QUEUE_MAX;
+        link_count--;
+        pthread_cond_broadcast(&link_c);
+        pthread_mutex_unlock(&link_m);
+    }
+    return NULL;
+}
+
+static void link_init(void) {
+    link_pkt_us = getenv("PKT_US") ? atoi(getenv("PKT_US")) : 0;
+    if (getenv("QUEUE_PKTS")) link_depth = atoi(getenv("QUEUE_PKTS"));
+    if (link_depth < 1) link_depth = 1;
+    if (link_depth > LINK_QUEUE_MAX) link_depth = LINK_QUEUE_MAX;
+    if (link_pkt_us > 0) {
+        pthread_t t;
+        pthread_create(&t, NULL, link_thread, NULL);
+        pthread_detach(t);
+    }
+}
+
+static bool link_enabled(void) {
+    pthread_once(&link_once, link_init);
+    return link_pkt_us > 0;
+}
+
+static void link_put(int sock, const struct sockaddr *to, const struct iovec *iov, int iovcnt) {
+    pthread_mutex_lock(&link_m);
+    while (link_count >= link_depth) pthread_cond_wait(&link_c, &link_m);
+    link_pkt_t *p = &link_queue[(link_head + link_count) % LINK_QUEUE_MAX];
+    p->sock = sock;
+    p->addr = *(const struct sockaddr_in *)to;
+    p->len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size_t n = iov[i].iov_len;
+        if (p->len + n > sizeof(p->data)) n = sizeof(p->data) - p->len;
+        memcpy(p->data + p->len, iov[i].iov_base, n);
+        p->len += n;
+    }
+    link_count++;
+    pthread_cond_broadcast(&link_c);
+    pthread_mutex_unlock(&link_m);
+}
+
+ssize_t __wrap_sendto(int s, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t tolen) {
+    if (!link_enabled() || !to || to->sa_family != AF_INET || len < LINK_PKT_MIN) {
+        return __real_sendto(s, buf, len, flags, to, tolen);
+    }
+    struct iovec v = { (void *)buf, len };
+    link_put(s, to, &v, 1);
+    return len;
+}
+
+int __wrap_sendmmsg(int s, struct mmsghdr *msgs, unsigned int n, int flags) {
+    if (!link_enabled()) return __real_sendmmsg(s, msgs, n, flags);
+    for (unsigned int i = 0; i < n; i++) {
+        link_put(s, msgs[i].msg_hdr.msg_name, msgs[i].msg_hdr.msg_iov, msgs[i].msg_hdr.msg_iovlen);
+        msgs[i].msg_len = 0;
+        for (size_t k = 0; k < msgs[i].msg_hdr.msg_iovlen; k++) msgs[i].msg_len += msgs[i].msg_hdr.msg_iov[k].iov_len;
+    }
+    return n;
+}
+
+/* ---------------- 合成帧 ---------------- */
+
+static uint8_t *frame_fill(size_t size, uint32_t seq, uint8_t tier) {
+    uint8_t *buf = malloc(size);
+    for (size_t i = 0; i < size; i++) buf[i] = (uint8_t)(i * 7 + seq + tier);
+    buf[0] = 0xFF;
+    buf[1] = 0xD8;
+    buf[size - 2] = 0xFF;
+    buf[size - 1] = 0xD9;
+    return buf;
+}
+
+static void frame_send(uint32_t seq, uint8_t tier, size_t size, int64_t ts, int enc_us, bool chunked) {
+    lcd_camera_frame_t *f = calloc(1, sizeof(*f));
+    uint8_t *src = frame_fill(size, seq, tier);
+    f->timestamp_us = ts;
+    f->seq = seq;
+    f->width = tier ? 320 : 640;
+    f->height = tier ? 240 : 480;
+    f->tier = tier;
+    f->refcount = 1;
+
+    if (chunked) {
+        f->buf = malloc(size);
+        for (size_t o = 0; o < size; o += HOST_CHUNK_SIZE) {
+            size_t n = size - o > HOST_CHUNK_SIZE ? HOST_CHUNK_SIZE : size - o;
+            usleep((useconds_t)((int64_t)enc_us * n / size));
+            memcpy(f->buf + o, src + o, n);
+            f->len = o + n;
+            rtsp_server_send_chunk(f, 1, false);
+        }
+        rtsp_server_send_chunk(f, 1, true);
+        free(src);
+    } else {
+        usleep(enc_us);
+        f->buf = src;
+        f->len = size;
+        rtsp_server_send_frame(f, 1);
+    }
+    lcd_camera_frame_unref(f);
+}
+
+int main(int argc, char **argv) {
+    int secs = argc > 1 ? atoi(argv[1]) : 10;
+    size_t fsize = argc > 2 ? (size_t)atoi(argv[2]) : 30000;
+    int enc_us = getenv("ENC_US") ? atoi(getenv("ENC_US")) : 0;
+    bool chunked = getenv("CHUNK") != NULL;
+
+    host_task_register("camera");
+    rtsp_server_start();
+
+    int64_t end = esp_timer_get_time() + (int64_t)secs * 1000000;
+    uint32_t seq = 0;
+    while (esp_timer_get_time() < end) {
+        uint8_t tiers = rtsp_stream_tiers_get();
+        if (!tiers) {
+            usleep(20000);
+            continue;
+        }
+        uint32_t cap = seq++;
+        int64_t ts = esp_timer_get_time();
+        for (uint8_t t = 0; t < LCD_CAMERA_TIER_COUNT; t++) {
+            if (!(tiers & LCD_CAMERA_TIER_BIT(t))) continue;
+            frame_send(cap, t, t ? fsize / 4 : fsize, ts, enc_us, chunked);
+        }
+    }
+
+    static char out[HOST_STATS_BUF_SIZE];
+    rtsp_stats_render_json(out, sizeof(out));
+    printf("%s\n", out);
+    host_task_report_lock_wait();
+
+    int len = rtsp_stats_render_metrics(out, sizeof(out));
+    FILE *mf = fopen("metrics.txt", "w");
+    if (mf) {
+        fwrite(out, 1, len, mf);
+        fclose(mf);
+    }
+    return 0;
+}